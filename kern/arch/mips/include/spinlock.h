@@ -43,6 +43,10 @@ typedef unsigned spinlock_data_t;
 void spinlock_data_set(volatile spinlock_data_t *sd, unsigned val);
 spinlock_data_t spinlock_data_get(volatile spinlock_data_t *sd);
 spinlock_data_t spinlock_data_testandset(volatile spinlock_data_t *sd);
+spinlock_data_t spinlock_data_swap(volatile spinlock_data_t *sd,
+				   spinlock_data_t val);
+spinlock_data_t spinlock_data_cas(volatile spinlock_data_t *sd,
+				  spinlock_data_t old, spinlock_data_t new);
 
 ////////////////////////////////////////////////////////////
 
@@ -93,5 +97,66 @@ spinlock_data_testandset(volatile spinlock_data_t *sd)
 	return x;
 }
 
+SPINLOCK_INLINE
+spinlock_data_t
+spinlock_data_swap(volatile spinlock_data_t *sd, spinlock_data_t val)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	/*
+	 * Atomic exchange: store VAL and return what was there.
+	 * Same LL/SC sequence as above, but retried until the SC
+	 * succeeds, since there's no way to pretend here.
+	 */
+	do {
+		y = val;
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%2);"		/*   x = *sd */
+			"sc %1, 0(%2);"		/*   *sd = y; y = success? */
+			".set pop"		/* restore assembler mode */
+			: "=r" (x), "+r" (y) : "r" (sd));
+	} while (y == 0);
+	return x;
+}
+
+SPINLOCK_INLINE
+spinlock_data_t
+spinlock_data_cas(volatile spinlock_data_t *sd,
+		  spinlock_data_t old, spinlock_data_t new)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	/*
+	 * Compare-and-swap: if *SD is OLD, store NEW. Either way,
+	 * return what was in *SD; the store happened if that equals
+	 * OLD.
+	 *
+	 * Y starts out nonzero and is only replaced (by the SC
+	 * result) if the values match, so we retry only when they
+	 * matched but the SC failed.
+	 */
+	do {
+		y = 1;
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%3);"		/*   x = *sd */
+			"bne %0, %2, 1f;"	/*   if (x != old) done */
+			"move %1, %4;"		/*   y = new */
+			"sc %1, 0(%3);"		/*   *sd = y; y = success? */
+			"1:"
+			".set pop"		/* restore assembler mode */
+			: "=&r" (x), "+&r" (y)
+			: "r" (old), "r" (sd), "r" (new));
+	} while (x == old && y == 0);
+	return x;
+}
+
 
 #endif /* _MIPS_SPINLOCK_H_ */
@@ -29,6 +29,7 @@
 
 #include <types.h>
 #include <signal.h>
+#include <kern/wait.h>
 #include <lib.h>
 #include <mips/specialreg.h>
 #include <mips/trapframe.h>
@@ -39,7 +40,11 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
+#include "opt-A2.h"
 #include "opt-A3.h"
+#if OPT_A2
+#include <uthread.h>
+#endif
 
 /* in exception.S */
 extern void asm_usermode(struct trapframe *tf);
@@ -86,11 +91,10 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 		sig = SIGABRT;
 		break;
 	    case EX_MOD:
-#if OPT_A3
-		sig = SIGSEGV;
-		sys__exit(sig);
-		break;
-#endif
+		/*
+		 * A write to a read-only page: the time page, or with
+		 * OPT_A3 a text segment.
+		 */
 	    case EX_TLBL:
 	    case EX_TLBS:
 		sig = SIGSEGV;
@@ -114,12 +118,12 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 	}
 
 	/*
-	 * You will probably want to change this.
+	 * End the process as if killed by SIG. proc_exit ends any
+	 * other threads in it first.
 	 */
-
 	kprintf("Fatal user mode trap %u sig %d (%s, epc 0x%x, vaddr 0x%x)\n",
 		code, sig, trapcodenames[code], epc, vaddr);
-	panic("I don't know how to handle this\n");
+	proc_exit(_MKWAIT_SIG(sig));
 }
 
 /*
@@ -199,6 +203,19 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+#if OPT_A2
+		/*
+		 * Another thread is ending our process. Rather than go
+		 * back to user mode, drop to ordinary kernel context,
+		 * as if this were a syscall, and leave.
+		 */
+		if (!iskern && uthread_killed()) {
+			spl = splhigh();
+			splx(spl);
+			uthread_die();
+		}
+#endif
 		goto done2;
 	}
 
@@ -319,6 +336,12 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+#if OPT_A2
+	/* Don't go back to user mode if another thread is ending us. */
+	if (!iskern && uthread_killed()) {
+		uthread_die();
+	}
+#endif
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
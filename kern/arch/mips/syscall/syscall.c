@@ -35,6 +35,7 @@
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include <copyinout.h>
 #include "opt-A2.h"
 
 /*
@@ -81,6 +82,12 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+#if OPT_A2
+	off_t retval64;
+	bool is64;
+	int whence;
+	off_t pos;
+#endif
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -98,6 +105,10 @@ syscall(struct trapframe *tf)
 	 */
 
 	retval = 0;
+#if OPT_A2
+	retval64 = 0;
+	is64 = false;
+#endif
 
 	switch (callno) {
 	    case SYS_reboot:
@@ -108,6 +119,21 @@ syscall(struct trapframe *tf)
 		err = sys___time((userptr_t)tf->tf_a0,
 				 (userptr_t)tf->tf_a1);
 		break;
+
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_sched_setaffinity:
+		err = sys_sched_setaffinity((pid_t)tf->tf_a0,
+					    (uint32_t)tf->tf_a1);
+		break;
+
+	    case SYS_sched_getaffinity:
+		err = sys_sched_getaffinity((pid_t)tf->tf_a0,
+					    (userptr_t)tf->tf_a1);
+		break;
 #ifdef UW
 	case SYS_write:
 	  err = sys_write((int)tf->tf_a0,
@@ -136,8 +162,176 @@ syscall(struct trapframe *tf)
 	case SYS_fork:
 	  	err = sys_fork(tf, (pid_t *) &retval);
 	  	break;
+	case SYS_vfork:
+		err = sys_vfork(tf, (pid_t *) &retval);
+		break;
+	case SYS___spawn:
+		err = sys_spawn((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+				(pid_t *) &retval);
+		break;
 	case SYS_execv:
-		err = sys_execv((const char *)tf->tf_a0,(char**)tf->tf_a1);
+		err = sys_execv((userptr_t)tf->tf_a0,(userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS___thread_create:
+		err = sys_thread_create(tf, (userptr_t)tf->tf_a0,
+					(userptr_t)tf->tf_a1,
+					(userptr_t)tf->tf_a2, &retval);
+		break;
+
+	    case SYS_thread_join:
+		err = sys_thread_join(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_thread_exit:
+		sys_thread_exit((userptr_t)tf->tf_a0);
+		panic("unexpected return from sys_thread_exit");
+		break;
+
+	    case SYS_open:
+		err = sys_open((const_userptr_t)tf->tf_a0, tf->tf_a1,
+			       tf->tf_a2, &retval);
+		break;
+
+	    case SYS_read:
+		err = sys_read(tf->tf_a0, (userptr_t)tf->tf_a1, tf->tf_a2,
+			       &retval);
+		break;
+
+	    case SYS_readv:
+		err = sys_readv(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				tf->tf_a2, &retval);
+		break;
+
+	    case SYS_writev:
+		err = sys_writev(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				 tf->tf_a2, &retval);
+		break;
+
+	    /*
+	     * The positional calls take three 32-bit arguments, so the
+	     * 64-bit position doesn't fit in registers and is on the
+	     * stack.
+	     */
+	    case SYS_pread:
+		err = copyin((const_userptr_t)(tf->tf_sp + 16), &pos,
+			     sizeof(pos));
+		if (err) {
+			break;
+		}
+		err = sys_pread(tf->tf_a0, (userptr_t)tf->tf_a1, tf->tf_a2,
+				pos, &retval);
+		break;
+
+	    case SYS_pwrite:
+		err = copyin((const_userptr_t)(tf->tf_sp + 16), &pos,
+			     sizeof(pos));
+		if (err) {
+			break;
+		}
+		err = sys_pwrite(tf->tf_a0, (userptr_t)tf->tf_a1, tf->tf_a2,
+				 pos, &retval);
+		break;
+
+	    case SYS_preadv:
+		err = copyin((const_userptr_t)(tf->tf_sp + 16), &pos,
+			     sizeof(pos));
+		if (err) {
+			break;
+		}
+		err = sys_preadv(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				 tf->tf_a2, pos, &retval);
+		break;
+
+	    case SYS_pwritev:
+		err = copyin((const_userptr_t)(tf->tf_sp + 16), &pos,
+			     sizeof(pos));
+		if (err) {
+			break;
+		}
+		err = sys_pwritev(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				  tf->tf_a2, pos, &retval);
+		break;
+
+	    case SYS_close:
+		err = sys_close(tf->tf_a0);
+		break;
+
+	    case SYS_lseek:
+		/* fd in a0, 64-bit pos in a2/a3, whence on the stack */
+		err = copyin((const_userptr_t)(tf->tf_sp + 16), &whence,
+			     sizeof(whence));
+		if (err) {
+			break;
+		}
+		err = sys_lseek(tf->tf_a0,
+				((off_t)tf->tf_a2 << 32) | tf->tf_a3,
+				whence, &retval64);
+		is64 = true;
+		break;
+
+	    case SYS_dup:
+		err = sys_dup(tf->tf_a0, &retval);
+		break;
+
+	    case SYS_dup2:
+		err = sys_dup2(tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+	    case SYS_fstat:
+		err = sys_fstat(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_getdirentry:
+		err = sys_getdirentry(tf->tf_a0, (userptr_t)tf->tf_a1,
+				      tf->tf_a2, &retval);
+		break;
+
+	    case SYS_fsync:
+		err = sys_fsync(tf->tf_a0);
+		break;
+
+	    case SYS_ftruncate:
+		/* fd in a0, 64-bit length in a2/a3 */
+		err = sys_ftruncate(tf->tf_a0,
+				    ((off_t)tf->tf_a2 << 32) | tf->tf_a3);
+		break;
+
+	    case SYS_chdir:
+		err = sys_chdir((const_userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS___getcwd:
+		err = sys___getcwd((userptr_t)tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+	    case SYS_remove:
+		err = sys_remove((const_userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_mkdir:
+		err = sys_mkdir((const_userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_rmdir:
+		err = sys_rmdir((const_userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_rename:
+		err = sys_rename((const_userptr_t)tf->tf_a0,
+				 (const_userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_sync:
+		err = sys_sync();
+		break;
+
+	    case SYS_ring_setup:
+		err = sys_ring_setup(&retval);
+		break;
+
+	    case SYS_ring_enter:
+		err = sys_ring_enter(tf->tf_a0, &retval);
 		break;
 #endif //OPT_A2
  
@@ -157,6 +351,14 @@ syscall(struct trapframe *tf)
 		tf->tf_v0 = err;
 		tf->tf_a3 = 1;      /* signal an error */
 	}
+#if OPT_A2
+	else if (is64) {
+		/* Success, with a 64-bit result: high word in v0. */
+		tf->tf_v0 = (uint32_t)(retval64 >> 32);
+		tf->tf_v1 = (uint32_t)retval64;
+		tf->tf_a3 = 0;      /* signal no error */
+	}
+#endif
 	else {
 		/* Success. */
 		tf->tf_v0 = retval;
@@ -191,6 +393,7 @@ enter_forked_process(void *tf, unsigned long garbage)
 	(void)garbage;
 	KASSERT(tf);
 	struct trapframe tf_c = *(struct trapframe *)tf; // Shallow copy is enough
+	kfree(tf);
 	tf_c.tf_v0 = 0;
 	tf_c.tf_a3 = 0;
 	tf_c.tf_epc += 4;
@@ -201,3 +404,18 @@ enter_forked_process(struct trapframe *tf)
 	(void)tf;
 #endif // OPT_A2
 }
+
+#if OPT_A2
+/*
+ * Enter user mode for a new thread in an existing process. TF is set
+ * up to start it where it should, and is ours to free.
+ */
+void
+enter_new_thread(struct trapframe *tf)
+{
+	struct trapframe tf_c = *tf;
+
+	kfree(tf);
+	mips_usermode(&tf_c);
+}
+#endif
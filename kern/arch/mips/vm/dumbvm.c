@@ -29,6 +29,8 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/ring.h>
+#include <kern/timepage.h>
 #include <lib.h>
 #include <spl.h>
 #include <spinlock.h>
@@ -37,6 +39,7 @@
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <clock.h>
 #include "opt-A3.h"
 
 /*
@@ -47,10 +50,19 @@
 /* under dumbvm, always have 48k of user stack */
 #define DUMBVM_STACKPAGES    12
 
+/*
+ * Thread stacks are 32k each. They go below the main stack, with an
+ * unmapped page under each stack to catch overflows.
+ */
+#define DUMBVM_TSTACKPAGES   8
+#define DUMBVM_TSTACKTOP(n) \
+	(USERSTACK - (DUMBVM_STACKPAGES + 1) * PAGE_SIZE - \
+	 (n) * (DUMBVM_TSTACKPAGES + 1) * PAGE_SIZE)
+
 /*
  * Wrap rma_stealmem in a spinlock.
  */
-static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+static struct spinlock stealmem_lock = SPINLOCK_MCS_INITIALIZER("stealmem");
 
 #if OPT_A3
 /*
@@ -202,6 +214,8 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	struct addrspace *as;
 	int spl;
 	bool r_o = false;
+	bool timepage = false;
+	int tstack;
 
 	faultaddress &= PAGE_FRAME;
 
@@ -209,12 +223,8 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-#if OPT_A3
+		/* Text (with A3) and the time page are mapped read-only */
 		return EFAULT;
-#else
-		/* We always create pages read-write, so we can't get this */
-		panic("dumbvm: got VM_FAULT_READONLY\n");
-#endif
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
 		break;
@@ -304,6 +314,17 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 #endif
 	}
+	else if ((tstack = as_tstack_of(as, faultaddress)) >= 0) {
+		paddr = as->as_tstacks[tstack] - MIPS_KSEG0 + faultaddress -
+			(DUMBVM_TSTACKTOP(tstack) - DUMBVM_TSTACKPAGES * PAGE_SIZE);
+	}
+	else if (faultaddress == RING_VADDR && as->as_ring != 0) {
+		paddr = as->as_ring - MIPS_KSEG0;
+	}
+	else if (faultaddress == TIMEPAGE_VADDR && timepage_kvaddr() != 0) {
+		paddr = timepage_kvaddr() - MIPS_KSEG0;
+		timepage = true;
+	}
 	else {
 		return EFAULT;
 	}
@@ -325,6 +346,8 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		if (r_o && as->elf_loaded)
 			elo &= ~TLBLO_DIRTY;
 #endif
+		if (timepage)
+			elo &= ~TLBLO_DIRTY;
 		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
 		splx(spl);
@@ -335,6 +358,8 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	ehi = faultaddress;
 	if (r_o && as->elf_loaded)
 		elo &= ~TLBLO_DIRTY;
+	if (timepage)
+		elo &= ~TLBLO_DIRTY;
 	tlb_random(ehi, elo);
 #else
 	kprintf("dumbvm: Ran out of TLB entries - cannot handle page fault\n");
@@ -350,6 +375,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 struct addrspace *
 as_create(void)
 {
+	unsigned i;
 	struct addrspace *as = kmalloc(sizeof(struct addrspace));
 	if (as==NULL) {
 		return NULL;
@@ -377,17 +403,34 @@ as_create(void)
 #if OPT_A3
 	as->elf_loaded = false;
 #endif
+	spinlock_init(&as->as_ringlock);
+	as->as_ring = 0;
+	as->as_ringbusy = false;
+	for (i=0; i<AS_TSTACKS; i++) {
+		as->as_tstacks[i] = 0;
+	}
 	return as;
 }
 
 void
 as_destroy(struct addrspace *as)
 {
+	unsigned i;
+
 #if OPT_A3
 	free_kpages(PADDR_TO_KVADDR(as->pt.as_stackpbase.address));
 	free_kpages(PADDR_TO_KVADDR(as->pt.as_pbase1.address));
 	free_kpages(PADDR_TO_KVADDR(as->pt.as_pbase2.address));
 #endif
+	if (as->as_ring != 0) {
+		free_kpages(as->as_ring);
+	}
+	spinlock_cleanup(&as->as_ringlock);
+	for (i=0; i<AS_TSTACKS; i++) {
+		if (as->as_tstacks[i] != 0) {
+			free_kpages(as->as_tstacks[i]);
+		}
+	}
 	kfree(as);
 }
 
@@ -543,10 +586,51 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+int
+as_define_tstack(struct addrspace *as, unsigned n, vaddr_t *stackptr)
+{
+	KASSERT(n < AS_TSTACKS);
+
+	if (as->as_tstacks[n] == 0) {
+		as->as_tstacks[n] = alloc_kpages(DUMBVM_TSTACKPAGES);
+		if (as->as_tstacks[n] == 0) {
+			return ENOMEM;
+		}
+		bzero((void *)as->as_tstacks[n],
+		      DUMBVM_TSTACKPAGES * PAGE_SIZE);
+	}
+
+	*stackptr = DUMBVM_TSTACKTOP(n);
+	return 0;
+}
+
+int
+as_tstack_of(struct addrspace *as, vaddr_t addr)
+{
+	vaddr_t top;
+	unsigned n;
+
+	if (addr >= DUMBVM_TSTACKTOP(0)) {
+		return -1;
+	}
+	n = (DUMBVM_TSTACKTOP(0) - 1 - addr) /
+		((DUMBVM_TSTACKPAGES + 1) * PAGE_SIZE);
+	if (n >= AS_TSTACKS || as->as_tstacks[n] == 0) {
+		return -1;
+	}
+	top = DUMBVM_TSTACKTOP(n);
+	if (addr < top - DUMBVM_TSTACKPAGES * PAGE_SIZE) {
+		/* in the guard page */
+		return -1;
+	}
+	return n;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
 	struct addrspace *new;
+	unsigned i;
 
 	new = as_create();
 	if (new==NULL) {
@@ -595,6 +679,33 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
 		DUMBVM_STACKPAGES*PAGE_SIZE);
 #endif
+
+	/* The child gets its own copy of the syscall ring, if any. */
+	if (old->as_ring != 0) {
+		new->as_ring = alloc_kpages(1);
+		if (new->as_ring == 0) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+		memmove((void *)new->as_ring, (const void *)old->as_ring,
+			PAGE_SIZE);
+	}
+
+	/* And of the thread stacks; we may be running on one. */
+	for (i=0; i<AS_TSTACKS; i++) {
+		if (old->as_tstacks[i] == 0) {
+			continue;
+		}
+		new->as_tstacks[i] = alloc_kpages(DUMBVM_TSTACKPAGES);
+		if (new->as_tstacks[i] == 0) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+		memmove((void *)new->as_tstacks[i],
+			(const void *)old->as_tstacks[i],
+			DUMBVM_TSTACKPAGES * PAGE_SIZE);
+	}
+
 	*ret = new;
 	return 0;
 }
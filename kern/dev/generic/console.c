@@ -156,19 +156,30 @@ putch_intr(struct con_softc *cs, int ch)
 /*
  * Read a character, using interrupts to wait for I/O completion.
  */
+/*
+ * Take the next character out of the input buffer. The caller has
+ * done a P on cs_rsem for it.
+ */
 static
 int
-getch_intr(struct con_softc *cs)
+getch_take(struct con_softc *cs)
 {
 	unsigned char ret;
 
-	P(cs->cs_rsem);
 	ret = cs->cs_gotchars[cs->cs_gotchars_tail];
 	cs->cs_gotchars_tail =
 		(cs->cs_gotchars_tail + 1) % CONSOLE_INPUT_BUFFER_SIZE;
 	return ret;
 }
 
+static
+int
+getch_intr(struct con_softc *cs)
+{
+	P(cs->cs_rsem);
+	return getch_take(cs);
+}
+
 /*
  * Called from underlying device when a read-ready interrupt occurs.
  *
@@ -275,6 +286,28 @@ getch(void)
 	return getch_intr(cs);
 }
 
+/*
+ * Like getch, for user reads: a thread that's being killed (see
+ * thread_kill) gives up waiting, and gets EINTR with nothing read.
+ */
+static
+int
+getch_killable(char *ch)
+{
+	struct con_softc *cs = the_console;
+	int result;
+
+	KASSERT(cs != NULL);
+	KASSERT(!curthread->t_in_interrupt && curthread->t_iplhigh_count == 0);
+
+	result = P_killable(cs->cs_rsem);
+	if (result) {
+		return result;
+	}
+	*ch = getch_take(cs);
+	return 0;
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -320,7 +353,11 @@ con_io(struct device *dev, struct uio *uio)
 
 	while (uio->uio_resid > 0) {
 		if (uio->uio_rw==UIO_READ) {
-			ch = getch();
+			result = getch_killable(&ch);
+			if (result) {
+				lock_release(lk);
+				return result;
+			}
 			if (ch=='\r') {
 				ch = '\n';
 			}
@@ -36,10 +36,14 @@
 
 
 #include <vm.h>
+#include <spinlock.h>
 #include "opt-A3.h"
 
 struct vnode;
 
+/* How many extra stacks an address space can have, for user threads. */
+#define AS_TSTACKS  15
+
 #if OPT_A3
 typedef struct PTE{
 	paddr_t address;
@@ -77,6 +81,10 @@ struct addrspace {
   size_t as_npages2;
   paddr_t as_stackpbase; // replace this with page table
 #endif
+  struct spinlock as_ringlock; /* Protects as_ring and as_ringbusy */
+  vaddr_t as_ring;	/* Kernel address of the syscall ring page, or 0 */
+  bool as_ringbusy;	/* A thread is in ring_enter */
+  vaddr_t as_tstacks[AS_TSTACKS]; /* Kernel addresses of thread stacks, or 0 */
 };
 
 /*
@@ -113,6 +121,14 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_define_tstack - set up extra stack N, for a user thread, unless
+ *                it already exists, and hand back its initial stack
+ *                pointer. A stack stays until the address space is
+ *                destroyed, so it can be reused by later threads.
+ *
+ *    as_tstack_of - return which extra stack ADDR is in, or -1 if it
+ *                isn't in one.
  */
 
 struct addrspace *as_create(void);
@@ -129,6 +145,9 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_tstack(struct addrspace *as, unsigned n,
+                                   vaddr_t *initstackptr);
+int               as_tstack_of(struct addrspace *as, vaddr_t addr);
 
 
 /*
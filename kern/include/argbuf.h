@@ -0,0 +1,37 @@
+#ifndef _ARGBUF_H_
+#define _ARGBUF_H_
+
+/*
+ * Argument vectors in transit to a new program (execv, runprogram).
+ *
+ * The strings are packed end to end, NUL-terminated, into a single
+ * ARG_MAX buffer. On the way out the buffer is turned into the final
+ * user stack image, the argv pointer array followed by the strings,
+ * and copied out in one go. ARG_MAX bounds the strings and the
+ * pointer array together; more than that gets E2BIG.
+ */
+
+struct argbuf {
+	char *ab_buf;		/* ARG_MAX bytes */
+	size_t ab_len;		/* Bytes of packed strings */
+	int ab_argc;
+};
+
+/* Allocate the buffer, or free it. */
+int argbuf_init(struct argbuf *ab);
+void argbuf_cleanup(struct argbuf *ab);
+
+/* Collect a NULL-terminated argv from userspace. */
+int argbuf_copyin(struct argbuf *ab, userptr_t uargv);
+
+/* Collect ARGC kernel strings. */
+int argbuf_fromkernel(struct argbuf *ab, int argc, char **argv);
+
+/*
+ * Copy the arguments onto the user stack below *STACKPTR, which is
+ * moved down past them, and return the user address of argv. This
+ * rearranges the buffer, so it can only be done once.
+ */
+int argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr, userptr_t *uargv);
+
+#endif /* _ARGBUF_H_ */
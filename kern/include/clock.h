@@ -38,10 +38,18 @@
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU every LT_GRANULARITY usec. All it
+ * does is refresh the time page; timed operations use timeouts (see
+ * timeout.h), which hardclock() drives.
+ *
+ * The time page is a copy of the time of day that the VM system maps
+ * read-only into every address space (see <kern/timepage.h>).
+ * timepage_kvaddr() gives its kernel address, or 0 before
+ * timepage_bootstrap() has run.
  *
  * gettime() may be used to fetch the current time of day.
+ * gettime_ns() returns it as a single count of nanoseconds, for
+ * timing things.
  * getinterval() computes the time from time1 to time2.
  *
  * XXX we have struct timespec now, let's use it.
@@ -57,11 +65,15 @@
 #endif
 
 void hardclock_bootstrap(void);
+void timepage_bootstrap(void);
 
 void hardclock(void);
 void timerclock(void);
 
+vaddr_t timepage_kvaddr(void);
+
 void gettime(time_t *seconds, uint32_t *nanoseconds);
+uint64_t gettime_ns(void);
 
 void getinterval(time_t secs1, uint32_t nsecs,
                  time_t secs2, uint32_t nsecs2,
@@ -83,5 +95,17 @@ void clocksleep(int seconds);
  */
 void clocknap(int ticks);
 
+/*
+ * clocknap_ns() suspends execution for at least the given time, like
+ * nanosleep(2). The time is rounded up to whole hardclocks.
+ */
+void clocknap_ns(time_t secs, uint32_t nsecs);
+
+/*
+ * Same, but thread_kill can end the sleep early, and then this
+ * returns EINTR; otherwise 0.
+ */
+int clocknap_ns_killable(time_t secs, uint32_t nsecs);
+
 
 #endif /* _CLOCK_H_ */
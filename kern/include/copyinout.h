@@ -30,6 +30,9 @@
 #ifndef _COPYINOUT_H_
 #define _COPYINOUT_H_
 
+#include <setjmp.h>
+#include <thread.h>
+#include <current.h>
 
 /*
  * copyin/copyout/copyinstr/copyoutstr are standard BSD kernel functions.
@@ -69,5 +72,54 @@ int copyout(const void *src, userptr_t userdest, size_t len);
 int copyinstr(const_userptr_t usersrc, char *dest, size_t len, size_t *got);
 int copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *got);
 
+/*
+ * Each of the above sets up its own recovery from bad addresses, with
+ * a setjmp, every time it's called. Code that makes several copies in
+ * a row can set that up once instead:
+ *
+ *	user_access_begin(fail);
+ *	result = user_copyin(...);
+ *	...
+ *	result = user_copyout(...);
+ *	user_access_end();
+ *	...
+ * fail:
+ *	user_access_end() has been done for you; return EFAULT
+ *
+ * user_copyin, user_copyout, user_copyinstr and user_copyoutstr are
+ * like copyin and company, and may only be used between
+ * user_access_begin and user_access_end. They still check the
+ * addresses they're given and return EFAULT for kernel ones. A fault
+ * partway through any of them jumps to the label given to
+ * user_access_begin, in the same function.
+ *
+ * Local variables changed between user_access_begin and the fault
+ * have indeterminate values at the label, unless volatile. Windows
+ * can't be nested, so don't call copyin and company in one. Keep
+ * windows short and straight-line: a fault skips everything between
+ * it and the label, including lock releases and frees.
+ */
+void user_access_fail(void);
+
+#define user_access_begin(faillabel) \
+	do { \
+		KASSERT(curthread->t_machdep.tm_badfaultfunc == NULL); \
+		curthread->t_machdep.tm_badfaultfunc = user_access_fail; \
+		if (setjmp(curthread->t_machdep.tm_copyjmp)) { \
+			curthread->t_machdep.tm_badfaultfunc = NULL; \
+			goto faillabel; \
+		} \
+	} while (0)
+
+#define user_access_end() \
+	(curthread->t_machdep.tm_badfaultfunc = NULL)
+
+int user_copyin(const_userptr_t usersrc, void *dest, size_t len);
+int user_copyout(const void *src, userptr_t userdest, size_t len);
+int user_copyinstr(const_userptr_t usersrc, char *dest, size_t len,
+		   size_t *got);
+int user_copyoutstr(const char *src, userptr_t userdest, size_t len,
+		    size_t *got);
+
 
 #endif /* _COPYINOUT_H_ */
@@ -36,6 +36,12 @@
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
+/*
+ * Number of priority levels in each cpu's run queue. Level 0 is the
+ * highest priority; see schedule() in thread.c.
+ */
+#define RUNQUEUE_LEVELS 3
+
 /*
  * Per-cpu structure
  *
@@ -59,6 +65,7 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct thread *c_migrating;	/* Switched out, must move away */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 
 	/*
@@ -66,9 +73,37 @@ struct cpu {
 	 * Protected by the runqueue lock.
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
-	struct threadlist c_runqueue;	/* Run queue for this cpu */
+	struct threadlist c_runqueue[RUNQUEUE_LEVELS]; /* By priority */
 	struct spinlock c_runqueue_lock;
 
+	/*
+	 * Accessed by other cpus.
+	 * Protected by the thread cache lock.
+	 *
+	 * Exited threads whose struct thread and stack are kept
+	 * around (up to THREAD_CACHE_MAX of them) so thread_fork can
+	 * reuse them. Other cpus only touch this to empty it when
+	 * memory is short.
+	 */
+	struct threadlist c_threadcache;
+	struct spinlock c_threadcache_lock;
+
+	/*
+	 * Accessed by other cpus, without locking.
+	 *
+	 * Threads other cpus have woken up for us, not yet on our run
+	 * queue: a stack linked through t_wakenext, pushed and taken
+	 * whole with atomic operations (see thread_make_runnable).
+	 */
+	volatile spinlock_data_t c_wakeups;
+
+	/*
+	 * Queue nodes for the MCS spinlocks this cpu is holding or
+	 * waiting for. Allocated and freed only by this cpu; the cpu
+	 * ahead of us in a queue writes our node to hand us the lock.
+	 */
+	struct spinlock_mcsnode c_mcsnodes[SPINLOCK_MCSNODES];
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the IPI lock.
@@ -109,6 +144,12 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Return the number of cpus. Software cpu numbers (c_number) run from
+ * 0 to this minus one. Only meaningful after thread_start_cpus.
+ */
+unsigned cpu_count(void);
+
 /*
  * Return a string describing the CPU type.
  */
@@ -0,0 +1,95 @@
+#ifndef _FILETABLE_H_
+#define _FILETABLE_H_
+
+/*
+ * Open files and per-process file descriptor tables.
+ *
+ * An openfile is what open() creates: a vnode plus the access mode
+ * and the seek position. Descriptors made by dup/dup2 and copies of
+ * the table made by fork share one openfile, and with it the seek
+ * position; it goes away when the last descriptor for it is closed.
+ *
+ * Locking is all local to one table or one open file, so processes
+ * doing I/O on unrelated files never touch a common lock:
+ *
+ *    - ft_lock (a spinlock) protects the slots of one table. It's
+ *      held only long enough to look at or change a slot.
+ *    - of_reflock (a spinlock) protects an openfile's reference count.
+ *    - of_offsetlock (a sleep lock) serializes I/O through a seekable
+ *      file or a directory so that sharers see a consistent position.
+ *      Devices that can't seek (the console) have none and need no
+ *      locking beyond what the device does.
+ */
+
+#include <limits.h>
+#include <spinlock.h>
+
+struct vnode;
+struct lock;
+
+struct openfile {
+	struct vnode *of_vnode;
+	int of_flags;			/* Access mode plus O_APPEND */
+	bool of_seekable;
+	struct lock *of_offsetlock;	/* NULL for unseekable devices */
+	off_t of_offset;		/* Protected by of_offsetlock */
+	struct spinlock of_reflock;
+	unsigned of_refcount;
+};
+
+struct filetable {
+	struct spinlock ft_lock;
+	struct openfile *ft_files[OPEN_MAX];
+};
+
+/*
+ * Open PATH (which is consumed, as with vfs_open) with open(2) FLAGS
+ * and MODE, returning an openfile with one reference.
+ */
+int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret);
+
+/* Add or drop a reference. Dropping the last one closes the file. */
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+/*
+ * Create an empty table; destroy one, closing everything in it; or
+ * make a copy of one that shares all its open files, for fork.
+ */
+struct filetable *filetable_create(void);
+void filetable_destroy(struct filetable *ft);
+int filetable_copy(struct filetable *src, struct filetable **ret);
+
+/*
+ * Open the console as descriptors 0, 1 and 2, for the first process.
+ */
+int filetable_openstd(struct filetable *ft);
+
+/*
+ * Look up descriptor FD, returning its openfile with a reference
+ * added (drop it with openfile_decref when done). EBADF if FD isn't
+ * open.
+ */
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+
+/*
+ * Put OF in the lowest free slot, consuming the caller's reference,
+ * and return the descriptor. EMFILE if the table is full.
+ */
+int filetable_place(struct filetable *ft, struct openfile *of, int *fd);
+
+/*
+ * Put OF in slot FD, consuming the caller's reference, and return
+ * whatever was there before (or NULL) in OLDRET for the caller to
+ * release. EBADF if FD is out of range.
+ */
+int filetable_placeat(struct filetable *ft, struct openfile *of, int fd,
+		      struct openfile **oldret);
+
+/*
+ * Empty slot FD and hand back the table's reference to what was in
+ * it. EBADF if FD isn't open.
+ */
+int filetable_remove(struct filetable *ft, int fd, struct openfile **ret);
+
+#endif /* _FILETABLE_H_ */
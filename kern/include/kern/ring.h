@@ -0,0 +1,61 @@
+#ifndef _KERN_RING_H_
+#define _KERN_RING_H_
+
+/*
+ * System call submission ring, shared between a process and the
+ * kernel.
+ *
+ * ring_setup() maps one page holding a struct ring at RING_VADDR in
+ * the caller's address space. To make calls, fill in entries at
+ * r_sq[r_sqtail % RING_ENTRIES] and advance r_sqtail, then call
+ * ring_enter(n): the kernel runs up to n queued entries in order,
+ * advancing r_sqhead, and posts one completion per entry at
+ * r_cq[r_cqtail % RING_ENTRIES], advancing r_cqtail. The caller
+ * consumes completions by advancing r_cqhead. All four indexes count
+ * up forever and are only reduced mod RING_ENTRIES to index.
+ *
+ * The kernel stops early if the completion queue fills up, so each
+ * ring_enter returns how many entries it consumed. A completion's
+ * result is what the call would have returned, or -errno. Only one
+ * thread may be in ring_enter at a time; another fails with EBUSY.
+ *
+ * The ring page is copied on fork, and doesn't survive exec.
+ */
+
+#define RING_VADDR    0x00001000	/* Where ring_setup maps it */
+#define RING_ENTRIES  128		/* Must be a power of two */
+
+/* Operations. sqe_fd, sqe_buf and sqe_len are used as noted. */
+#define RING_OP_NOP      0	/* does nothing, returns 0 */
+#define RING_OP_READ     1	/* read(fd, buf, len) */
+#define RING_OP_WRITE    2	/* write(fd, buf, len) */
+#define RING_OP_GETPID   3	/* getpid() */
+#define RING_OP_WAITPID  4	/* waitpid(fd, buf, len) */
+
+struct ring_sqe {
+	__u32 sqe_op;			/* RING_OP_* */
+	__i32 sqe_fd;
+#ifdef _KERNEL
+	userptr_t sqe_buf;
+#else
+	void *sqe_buf;
+#endif
+	__u32 sqe_len;
+	__u32 sqe_data;			/* Copied to the completion */
+};
+
+struct ring_cqe {
+	__u32 cqe_data;			/* sqe_data of the entry */
+	__i32 cqe_res;			/* Result, or -errno */
+};
+
+struct ring {
+	volatile __u32 r_sqhead;	/* Advanced by the kernel */
+	volatile __u32 r_sqtail;	/* Advanced by the process */
+	volatile __u32 r_cqhead;	/* Advanced by the process */
+	volatile __u32 r_cqtail;	/* Advanced by the kernel */
+	struct ring_sqe r_sq[RING_ENTRIES];
+	struct ring_cqe r_cq[RING_ENTRIES];
+};
+
+#endif /* _KERN_RING_H_ */
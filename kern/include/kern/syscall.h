@@ -54,6 +54,10 @@
 #define SYS_waitpid      4
 #define SYS_getpid       5
 #define SYS_getppid      6
+#define SYS___spawn      123
+#define SYS___thread_create 126
+#define SYS_thread_join  127
+#define SYS_thread_exit  128
 //                              (virtual memory)
 #define SYS_sbrk         7
 #define SYS_mmap         8
@@ -93,6 +97,8 @@
 //                              (process priority control)
 //#define SYS_getpriority 38
 //#define SYS_setpriority 39
+#define SYS_sched_setaffinity 121
+#define SYS_sched_getaffinity 122
 //                              (process groups, sessions, and job control)
 //#define SYS_getpgid    40
 //#define SYS_setpgid    41
@@ -109,13 +115,13 @@
 #define SYS_close        49
 #define SYS_read         50
 #define SYS_pread        51
-//#define SYS_readv      52
-//#define SYS_preadv     53
+#define SYS_readv        52
+#define SYS_preadv       53
 #define SYS_getdirentry  54
 #define SYS_write        55
 #define SYS_pwrite       56
-//#define SYS_writev     57
-//#define SYS_pwritev    58
+#define SYS_writev       57
+#define SYS_pwritev      58
 #define SYS_lseek        59
 #define SYS_flock        60
 #define SYS_ftruncate    61
@@ -195,6 +201,8 @@
 //                              -- Other --
 #define SYS_sync         118
 #define SYS_reboot       119
+#define SYS_ring_setup   124
+#define SYS_ring_enter   125
 //#define SYS___sysctl   120
 
 /*CALLEND*/
@@ -0,0 +1,26 @@
+#ifndef _KERN_TIMEPAGE_H_
+#define _KERN_TIMEPAGE_H_
+
+/*
+ * The time page: one page holding the time of day, mapped read-only
+ * at TIMEPAGE_VADDR in every address space so that user code can read
+ * the clock without a system call.
+ *
+ * The kernel refreshes it from timerclock(), so it only advances
+ * every LT_GRANULARITY usec; __time() is still the way to get the
+ * time to the nanosecond.
+ *
+ * tp_seq is odd while an update is in progress. To read the page,
+ * wait for tp_seq to be even, read the time, and start over if
+ * tp_seq has changed in the meantime.
+ */
+
+#define TIMEPAGE_VADDR  0x00002000
+
+struct timepage {
+	volatile __u32 tp_seq;
+	volatile __u32 tp_nsec;
+	volatile __time_t tp_sec;
+};
+
+#endif /* _KERN_TIMEPAGE_H_ */
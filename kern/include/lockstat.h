@@ -0,0 +1,77 @@
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics (options lockstat).
+ *
+ * For every spinlock and sleep lock that has a name, count the
+ * acquisitions, how many of them had to wait, the total and longest
+ * wait, and the total time the lock was held. Locks with the same
+ * name share one set of statistics, so e.g. all the per-process
+ * locks show up as one line. Times come from the realtime clock and
+ * are in nanoseconds.
+ *
+ * Counters are kept per cpu and only touched with interrupts off, so
+ * recording costs no locking beyond the lock being measured; the
+ * report adds them up. Nothing is recorded until lockstat_bootstrap
+ * has run.
+ *
+ * With the option off, none of this exists.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+/*
+ * Per-lock bookkeeping, embedded in struct spinlock and struct lock.
+ * All zeros is a valid untracked state, so static spinlock
+ * initializers don't need to mention it.
+ */
+struct lockstat_lk {
+	const char *ls_name;	/* NULL to not track this lock */
+	unsigned ls_id;		/* Table slot plus one; 0 if not looked up */
+	bool ls_spin;		/* Spinlock (vs. sleep lock) */
+	uint64_t ls_stamp;	/* When the current holder got it, or 0 */
+};
+
+/* Most distinct lock names tracked; the rest are lumped together. */
+#define LOCKSTAT_MAXNAMES  128
+#define LOCKSTAT_NAMELEN   24
+
+/* Call once during startup, after thread_start_cpus. */
+void lockstat_bootstrap(void);
+
+/*
+ * Set the name to track a lock under. NAME is not copied and must
+ * stay valid until the lock is cleaned up.
+ */
+void lockstat_init(struct lockstat_lk *ls, const char *name, bool spin);
+
+/*
+ * Start timing an acquisition. Returns 0 if this lock isn't being
+ * tracked (yet), in which case the other calls do nothing.
+ */
+uint64_t lockstat_start(struct lockstat_lk *ls);
+
+/*
+ * Record that the lock was obtained, after waiting if CONTENDED.
+ * START is what lockstat_start returned. Call with interrupts off
+ * (i.e., with some spinlock held).
+ */
+void lockstat_acquired(struct lockstat_lk *ls, uint64_t start,
+		       bool contended);
+
+/* Record that the lock is being released. Interrupts off, as above. */
+void lockstat_released(struct lockstat_lk *ls);
+
+/*
+ * Print the NUM locks with the most total wait time, or clear all
+ * the counters.
+ */
+void lockstat_report(unsigned num);
+void lockstat_reset(void);
+
+#endif /* OPT_LOCKSTAT */
+
+#endif /* _LOCKSTAT_H_ */
@@ -0,0 +1,36 @@
+#ifndef _PID_H_
+#define _PID_H_
+
+/*
+ * Process id table.
+ *
+ * Maps pids to processes. Pids are handed out round-robin from a
+ * bitmap, so a pid is reused only after all the others have been,
+ * and freed when the process is destroyed (that is, reaped), not
+ * when it exits. Lookups go through a hash table with a lock per
+ * bucket, so they cost O(1) and don't contend with each other.
+ */
+
+struct proc;
+
+/* Call once during system startup. */
+void pid_bootstrap(void);
+
+/*
+ * Give P a pid and enter it in the table. Returns ENPROC if every pid
+ * is in use.
+ */
+int pid_alloc(struct proc *p);
+
+/* Take P out of the table and make its pid available again. */
+void pid_free(struct proc *p);
+
+/*
+ * Return the process whose pid is PID, provided it is one of PARENT's
+ * children; otherwise NULL. The caller must hold PARENT's plock, and
+ * the result is only good until it lets go: after that another of
+ * PARENT's threads may wait for the child and reap it.
+ */
+struct proc *pid_lookupchild(pid_t pid, struct proc *parent);
+
+#endif /* _PID_H_ */
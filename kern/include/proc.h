@@ -43,13 +43,14 @@
 #if OPT_A2
 #include <synch.h>
 #include <array.h>
-struct lock * destroyLock;
-struct lock * PIDLock;
-volatile pid_t PIDCounter;
 #endif // OPT_A2
 
 struct addrspace;
 struct vnode;
+#if OPT_A2
+struct filetable;
+struct uthreads;
+#endif
 #ifdef UW
 struct semaphore;
 #endif // UW
@@ -80,13 +81,20 @@ struct proc {
 	/* add more material here as needed */
 		
 #if OPT_A2
+	struct filetable *p_filetable;	/* Open file descriptors */
 	pid_t PID;
+	struct proc *p_pidnext;	/* Hash chain in the pid table */
 	int exitCode;
 	bool exited;
 	struct proc * parent;
-	struct array * children;
+	struct array * children; /* Unordered; protected by plock */
+	unsigned p_childidx;	/* Our slot in parent->children */
 	struct cv * p_cv; // Parents will wait on this if they waitpid
 	struct lock * plock;
+	struct semaphore *p_vforkdone;	/* Non-NULL while borrowing the parent's
+					   address space after vfork */
+	struct uthreads *p_uthreads;	/* Thread table, once there's more
+					   than one thread; see uthread.h */
 #endif // OPT_A2
 };
 
@@ -113,6 +121,23 @@ int proc_addthread(struct proc *proc, struct thread *t);
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+#if OPT_A2
+/*
+ * Destroy a process nobody else can reach any more, later, from the
+ * workqueue (or now, if the workqueue can't take it).
+ */
+void proc_reap(struct proc *proc);
+
+/*
+ * Add CHILD to, or remove it from, PARENT's children, or check if
+ * it's there. The caller holds PARENT's plock. Removal and the check
+ * take constant time.
+ */
+int proc_addchild(struct proc *parent, struct proc *child);
+void proc_remchild(struct proc *parent, struct proc *child);
+bool proc_ischild(struct proc *parent, struct proc *child);
+#endif
+
 /* Fetch the address space of the current process. */
 struct addrspace *curproc_getas(void);
 
@@ -0,0 +1,57 @@
+#ifndef _SCHEDSTAT_H_
+#define _SCHEDSTAT_H_
+
+/*
+ * Scheduler statistics (options schedstat).
+ *
+ * Each cpu counts its context switches, split into voluntary ones
+ * (the thread slept, exited, or yielded) and involuntary ones (it was
+ * preempted from the timer interrupt), the threads it pushed to other
+ * cpus in thread_consider_migration, and the threads it stole. It
+ * also keeps log2 histograms, in nanoseconds, of how long threads sat
+ * on its run queue before running and how long they ran once they
+ * got the cpu.
+ *
+ * Counters are kept per cpu and only touched by their own cpu with
+ * interrupts off, so they need no locking; the report adds them up.
+ * Nothing is recorded until schedstat_bootstrap has run.
+ *
+ * With the option off, none of this exists.
+ */
+
+#include "opt-schedstat.h"
+
+#if OPT_SCHEDSTAT
+
+/* Bucket i counts times in [2^i, 2^(i+1)) ns; bucket 0 also gets 0. */
+#define SCHEDSTAT_BUCKETS  32
+
+/* Call once during startup, after thread_start_cpus. */
+void schedstat_bootstrap(void);
+
+/* Current time in ns, or 0 if not started yet. */
+uint64_t schedstat_now(void);
+
+/*
+ * Record events on the current cpu. All of these need interrupts
+ * off. schedstat_rqwait records that a thread that became runnable
+ * at READY started running at NOW; schedstat_slice, that one that
+ * started running at START stopped at NOW. Either does nothing if a
+ * time is 0.
+ */
+void schedstat_switch(bool involuntary);
+void schedstat_rqwait(uint64_t ready, uint64_t now);
+void schedstat_slice(uint64_t start, uint64_t now);
+void schedstat_migrated(void);
+void schedstat_stolen(void);
+
+/*
+ * Print the counters and histograms of one cpu, or of all of them
+ * added up if CPUNUM is -1; or clear everything.
+ */
+void schedstat_report(int cpunum);
+void schedstat_reset(void);
+
+#endif /* OPT_SCHEDSTAT */
+
+#endif /* _SCHEDSTAT_H_ */
@@ -36,6 +36,7 @@
  */
 
 #include <cdefs.h>
+#include <lockstat.h>
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -57,17 +58,64 @@
 struct spinlock {
 	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
 	struct cpu *lk_holder;		/* CPU holding this lock. */
+	bool lk_mcs;			/* MCS queue lock? (see below) */
+	struct spinlock_mcsnode *lk_mcsnode; /* Holder's queue node (MCS) */
+#if OPT_LOCKSTAT
+	struct lockstat_lk lk_stat;	/* Contention statistics */
+#endif
+};
+
+/*
+ * Queue node for MCS spinlocks.
+ *
+ * An ordinary spinlock has every waiting cpu spinning on the lock
+ * word, so every release sets off a stampede for the same cache line
+ * and the winner is whoever happens to get there first. An MCS lock
+ * (Mellor-Crummey and Scott) instead keeps waiters in a queue: the
+ * lock word points to the last node, each waiter spins on a flag in
+ * its own node, and the holder hands the lock to the next node in
+ * line when it releases. That's FIFO, and each waiter spins only on
+ * memory nobody else touches until it's its turn.
+ *
+ * Each cpu has a small pool of nodes (a cpu can hold several
+ * spinlocks at once, and doesn't always release them in the reverse
+ * order it took them).
+ */
+struct spinlock_mcsnode {
+	struct spinlock_mcsnode *volatile mn_next; /* Next waiter */
+	volatile spinlock_data_t mn_wait;	/* Nonzero until our turn */
+	bool mn_inuse;				/* Allocated from the pool */
 };
 
+/* Nodes per cpu; the most MCS spinlocks one cpu can hold at once. */
+#define SPINLOCK_MCSNODES	8
+
 /*
- * Initializer for cases where a spinlock needs to be static or global.
+ * Initializers for cases where a spinlock needs to be static or
+ * global, for ordinary and MCS spinlocks respectively. MCS locks are
+ * the contended ones, so they get a name for lockstat.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_LOCKSTAT
+#define SPINLOCK_STAT_INITIALIZER(name)	, { name, 0, true, 0 }
+#else
+#define SPINLOCK_STAT_INITIALIZER(name)
+#endif
+#define SPINLOCK_INITIALIZER \
+	{ SPINLOCK_DATA_INITIALIZER, NULL, false, NULL \
+	  SPINLOCK_STAT_INITIALIZER(NULL) }
+#define SPINLOCK_MCS_INITIALIZER(name) \
+	{ SPINLOCK_DATA_INITIALIZER, NULL, true, NULL \
+	  SPINLOCK_STAT_INITIALIZER(name) }
 
 /*
  * Spinlock functions.
  *
  * init		Initialize the contents of a spinlock.
+ * init_mcs	Same, but make it an MCS queue lock. Use this for locks
+ *		that many cpus fight over.
+ * setname	Name the lock for lockstat; unnamed spinlocks aren't
+ *		tracked. The name is not copied. Does nothing without
+ *		options lockstat.
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
@@ -77,6 +125,12 @@ struct spinlock {
  */
 
 void spinlock_init(struct spinlock *lk);
+void spinlock_init_mcs(struct spinlock *lk);
+#if OPT_LOCKSTAT
+void spinlock_setname(struct spinlock *lk, const char *name);
+#else
+#define spinlock_setname(lk, name) ((void)(lk))
+#endif
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
@@ -32,6 +32,10 @@
 
 /*
  * Header file for synchronization primitives.
+ *
+ * Threads blocked in these sleep on the global wait queues (see
+ * wchan.h), keyed by the object's address, so none of them needs a
+ * wait channel of its own.
  */
 
 
@@ -45,9 +49,9 @@
  */
 struct semaphore {
         char *sem_name;
-	struct wchan *sem_wchan;
 	struct spinlock sem_lock;
         volatile int sem_count;
+	bool sem_handoff;		/* hand counts straight to waiters */
 };
 
 struct semaphore *sem_create(const char *name, int initial_count);
@@ -58,8 +62,21 @@ void sem_destroy(struct semaphore *);
  *     P (proberen): decrement count. If the count is 0, block until
  *                   the count is 1 again before decrementing.
  *     V (verhogen): increment count.
+ *     P_timed:      like P, but give up after TICKS hardclocks. Returns
+ *                   0 if it got the count, ETIMEDOUT if not. A TICKS
+ *                   of 0 just tries.
+ *     P_killable:   like P, but give up with EINTR if the thread is
+ *                   killed (see thread_kill). Returns 0 if it got
+ *                   the count.
+ *
+ * If sem_handoff is set (it starts out clear), V gives its count
+ * directly to the thread that has waited longest in P, if any,
+ * rather than incrementing the count for anyone to take. Waiters
+ * then get through in FIFO order.
  */
 void P(struct semaphore *);
+int P_timed(struct semaphore *, unsigned ticks);
+int P_killable(struct semaphore *);
 void V(struct semaphore *);
 
 
@@ -78,8 +95,12 @@ struct lock {
         // (don't forget to mark things volatile as needed)
         bool volatile held;
         struct thread * owner;
-        struct wchan * wchan;
         struct spinlock spinlock;
+        bool adaptive;          /* spin while the owner is running */
+        bool handoff;           /* pass ownership straight to a waiter */
+#if OPT_LOCKSTAT
+        struct lockstat_lk lk_stat;     /* contention statistics */
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -91,12 +112,27 @@ void lock_acquire(struct lock *);
  *                   same time.
  *    lock_release - Free the lock. Only the thread holding the lock may do
  *                   this.
+ *    lock_tryacquire - Get the lock if nobody holds it and return true;
+ *                   otherwise return false right away.
  *    lock_do_i_hold - Return true if the current thread holds the lock; 
  *                   false otherwise.
  *
+ * Locks are adaptive: a thread that finds the lock held spins for a
+ * bounded time, instead of sleeping, if the holder is running on
+ * another cpu. This is a win for short critical sections. Clear
+ * "adaptive" after creating a lock to make waiters always sleep.
+ *
+ * Handoff mode: set "handoff" after creating a lock to have
+ * lock_release pass ownership directly to the thread that has waited
+ * longest, instead of freeing the lock and letting whoever gets there
+ * first take it. This makes the lock FIFO and bounds how long a
+ * waiter can be passed over, at some cost in throughput (the lock
+ * stays held, unused, until the new owner gets to run).
+ *
  * These operations must be atomic. You get to write them.
  */
 void lock_release(struct lock *);
+bool lock_tryacquire(struct lock *);
 bool lock_do_i_hold(struct lock *);
 void lock_destroy(struct lock *);
 
@@ -119,7 +155,7 @@ struct cv {
         char *cv_name;
         // add what you need here
         // (don't forget to mark things volatile as needed)
-        struct wchan * wchan;
+        volatile unsigned cv_seq;       /* bumped by signal/broadcast */
 };
 
 struct cv *cv_create(const char *name);
@@ -129,6 +165,13 @@ void cv_destroy(struct cv *);
  * Operations:
  *    cv_wait      - Release the supplied lock, go to sleep, and, after
  *                   waking up again, re-acquire the lock.
+ *    cv_timedwait - Same, but wake up anyway after TICKS hardclocks.
+ *                   Returns ETIMEDOUT if the time ran out, else 0.
+ *                   Either way the lock is held again on return.
+ *    cv_wait_killable - Same as cv_wait, but returns EINTR if the
+ *                   thread is killed (see thread_kill) before it's
+ *                   woken, else 0. A signal that lands on a killed
+ *                   thread is used up.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
  *
@@ -139,8 +182,59 @@ void cv_destroy(struct cv *);
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks);
+int cv_wait_killable(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers can hold the lock at once, or one writer.
+ * Writers have preference: once a writer is waiting, new readers
+ * wait behind it, so a steady stream of readers can't starve it.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct rwlock {
+        char *rwlock_name;
+	struct spinlock rw_lock;
+	volatile unsigned rw_readers;	/* readers holding the lock */
+	volatile unsigned rw_writewaiters; /* writers waiting for it */
+	struct thread *rw_writer;	/* writer holding it, if any */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read     - Get the lock for reading.
+ *    rwlock_release_read     - Give up a read hold.
+ *    rwlock_acquire_write    - Get the lock for writing.
+ *    rwlock_release_write    - Give up the write hold. Only the writer
+ *                              may do this.
+ *    rwlock_tryacquire_read  - Like rwlock_acquire_read, but return
+ *    rwlock_tryacquire_write   false instead of waiting (and true on
+ *                              success).
+ *    rwlock_downgrade        - Turn the current thread's write hold into
+ *                              a read hold, without letting any other
+ *                              writer in between.
+ *    rwlock_do_i_hold_write  - Return true if the current thread is the
+ *                              writer. (Readers aren't tracked.)
+ *
+ * A thread must not try to get a lock it already holds, in either mode.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_tryacquire_read(struct rwlock *);
+bool rwlock_tryacquire_write(struct rwlock *);
+void rwlock_downgrade(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
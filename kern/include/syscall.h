@@ -51,6 +51,11 @@ void enter_forked_process(void *tf, unsigned long);
 void enter_forked_process(struct trapframe *tf);
 #endif
 
+#if OPT_A2
+/* Enter user mode with a copy of TF, which is freed. Does not return. */
+void enter_new_thread(struct trapframe *tf);
+#endif
+
 /* Enter user mode. Does not return. */
 void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 		       vaddr_t entrypoint);
@@ -62,6 +67,9 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t user_req, userptr_t user_rem);
+int sys_sched_setaffinity(pid_t pid, uint32_t mask);
+int sys_sched_getaffinity(pid_t pid, userptr_t user_mask);
 
 #ifdef UW
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
@@ -69,12 +77,55 @@ void sys__exit(int exitcode);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 
+/*
+ * End the current process, leaving WAITSTATUS (made with one of the
+ * _MKWAIT macros in <kern/wait.h>) for waitpid. sys__exit(code) is
+ * proc_exit(_MKWAIT_EXIT(code)); a fatal fault uses _MKWAIT_SIG.
+ * Does not return.
+ */
+void proc_exit(int waitstatus);
+
 #endif // UW
 
 #if OPT_A2
 int sys_fork(struct trapframe *tf, pid_t *retval);
-int sys_execv(const char * progname, char * args[]);
-int copyoutargs(int , char ** , vaddr_t * );
+int sys_vfork(struct trapframe *tf, pid_t *retval);
+int sys_spawn(userptr_t path, userptr_t args, pid_t *retval);
+int sys_execv(userptr_t progname, userptr_t args);
+
+int sys_open(const_userptr_t path, int flags, mode_t mode, int *retval);
+int sys_read(int fd, userptr_t buf, size_t len, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t len, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t len, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+	       int *retval);
+int sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+		int *retval);
+int sys_close(int fd);
+int sys_lseek(int fd, off_t pos, int whence, off_t *retval);
+int sys_dup(int fd, int *retval);
+int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_fstat(int fd, userptr_t statbuf);
+int sys_getdirentry(int fd, userptr_t buf, size_t len, int *retval);
+int sys_fsync(int fd);
+int sys_ftruncate(int fd, off_t len);
+int sys_chdir(const_userptr_t path);
+int sys___getcwd(userptr_t buf, size_t len, int *retval);
+int sys_remove(const_userptr_t path);
+int sys_mkdir(const_userptr_t path, mode_t mode);
+int sys_rmdir(const_userptr_t path);
+int sys_rename(const_userptr_t oldpath, const_userptr_t newpath);
+int sys_sync(void);
+
+int sys_thread_create(struct trapframe *tf, userptr_t entry, userptr_t func,
+		      userptr_t arg, int *retval);
+int sys_thread_join(int tid, userptr_t retvalp);
+void sys_thread_exit(userptr_t retval);
+
+int sys_ring_setup(int32_t *retval);
+int sys_ring_enter(unsigned to_submit, int32_t *retval);
 #endif
 
 #endif /* _SYSCALL_H_ */
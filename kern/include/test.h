@@ -60,7 +60,14 @@ int threadtest2(int, char **);
 int threadtest3(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
+int lockbench(int, char **);
+int handoffbench(int, char **);
+int timedwaittest(int, char **);
 int cvtest(int, char **);
+int rwlocktest(int, char **);
+int rwlocktput(int, char **);
+int workqueuetest(int, char **);
+int copybench(int, char **);
 
 #ifdef UW
 /* Another thread and synchronization test */
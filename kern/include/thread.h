@@ -39,6 +39,7 @@
 #include <array.h>
 #include <spinlock.h>
 #include <threadlist.h>
+#include <schedstat.h>
 
 struct cpu;
 
@@ -83,6 +84,25 @@ struct thread {
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	const void *t_wchan;		/* Wait queue key we're asleep on,
+					   if any; protected by its lock */
+	bool t_killable;		/* thread_kill may end that sleep;
+					   protected like t_wchan */
+
+	/*
+	 * Scheduler fields. Changed only by the thread itself, or
+	 * while it is not running and its run queue is locked.
+	 */
+	unsigned t_priority;		/* Run queue level; 0 is highest */
+	unsigned t_ticks;		/* Hardclocks used at this level */
+	struct cpu *t_lastcpu;		/* Cpu last run on, or NULL if never */
+	unsigned t_lastrun;		/* t_lastcpu's c_hardclocks then */
+	uint32_t t_affinity;		/* Cpus allowed, by bit (c_number) */
+	struct thread *t_wakenext;	/* Link on t_cpu's c_wakeups */
+#if OPT_SCHEDSTAT
+	uint64_t t_readystamp;		/* When last made runnable */
+	uint64_t t_runstamp;		/* When last given the cpu */
+#endif
 
 	/*
 	 * Interrupt state fields.
@@ -105,6 +125,12 @@ struct thread {
 	 * Public fields
 	 */
 
+	/* Set by V() when it hands this thread a count directly */
+	bool t_handedoff;
+
+	/* Set by thread_kill; never cleared */
+	volatile bool t_killed;
+
 	/* add more here as needed */
 };
 
@@ -144,6 +170,48 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Cpu affinity masks have one bit per cpu, by c_number; a thread only
+ * ever runs on the cpus in its mask. New threads get their creator's
+ * mask. THREAD_ALLCPUS lets a thread run anywhere. There are at most
+ * THREAD_MAXCPUS cpus.
+ */
+#define THREAD_MAXCPUS  32
+#define THREAD_ALLCPUS  0xffffffffU
+
+/*
+ * Like thread_fork, but the new thread starts on cpu number CPUNUM
+ * and stays there: its affinity is just that cpu. This is for per-cpu
+ * kernel service threads.
+ */
+int thread_fork_bound(const char *name, struct proc *proc, unsigned cpunum,
+                      void (*func)(void *, unsigned long),
+                      void *data1, unsigned long data2);
+
+/*
+ * Restrict thread T to the cpus in MASK (bits for cpus that don't
+ * exist are ignored). Fails with EINVAL if that leaves none. If T is
+ * the current thread and it's on a cpu it may no longer use, it moves
+ * before this returns; other threads move the next time they are
+ * scheduled. Must not be used on bound kernel service threads.
+ */
+int thread_setaffinity(struct thread *t, uint32_t mask);
+
+/*
+ * Tell thread T to give up what it's doing and leave. If T is in a
+ * killable sleep (see waitq_sleep_killable) it wakes up now, and any
+ * killable sleep it tries later fails at once; it's up to T to check
+ * t_killed and go. T must not be able to exit while this runs.
+ */
+void thread_kill(struct thread *t);
+
+/*
+ * Free the exited threads (and their stacks) that are being kept for
+ * reuse by thread_fork. Called by kmalloc when memory runs short.
+ * Returns the number of threads freed.
+ */
+unsigned thread_cache_shrink(void);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -152,16 +220,32 @@ void thread_exit(void);
 
 /*
  * Cause the current thread to yield to the next runnable thread, but
- * itself stay runnable.
- * Interrupts need not be disabled.
+ * itself stay runnable. Every waiting thread gets to run first,
+ * whatever its priority level: the caller drops to the lowest level
+ * anyone is waiting at. Interrupts need not be disabled.
  */
 void thread_yield(void);
 
+/*
+ * Like thread_yield, but only give way to threads at the same or a
+ * higher priority level; if there are none, return immediately. For
+ * the timer interrupt, to preempt the current thread.
+ */
+void thread_preempt(void);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
 void schedule(void);
 
+/*
+ * Charge the current hardclock to the running thread. A thread that
+ * uses up its quantum (QUANTUM hardclocks, doubled for each level it
+ * has already dropped) moves down one priority level. Called from the
+ * timer interrupt.
+ */
+void thread_charge_tick(unsigned quantum);
+
 /*
  * Potentially migrate ready threads to other CPUs. Called from the
  * timer interrupt.
@@ -0,0 +1,68 @@
+#ifndef _TIMEOUT_H_
+#define _TIMEOUT_H_
+
+/*
+ * Timeouts: call a function after a given number of hardclocks.
+ *
+ * Each cpu keeps its pending timeouts in a hierarchical timer wheel
+ * that hardclock() advances. Adding and cancelling a timeout are
+ * constant-time, and each tick only looks at the timeouts that are
+ * actually due (plus, once every 64 ticks and less often further up
+ * the hierarchy, a cascade of far-off ones moving one level down).
+ *
+ * The caller owns the struct timeout; initialize it once with
+ * timeout_init, then it can be added and cancelled any number of
+ * times. It must not be freed while pending.
+ *
+ * The function is called on the cpu the timeout was added on, from
+ * the timer interrupt, so it must not sleep. Waking a thread up is
+ * the usual thing to do. By the time it is called, the timeout is no
+ * longer pending and the struct timeout may be reused or freed.
+ */
+
+struct timeoutwheel;
+
+struct timeout {
+	/* Wheel linkage; private to timeout.c */
+	struct timeout *to_next;
+	struct timeout **to_prevp;
+	struct timeoutwheel *to_wheel;	/* NULL if not pending */
+	unsigned to_expires;		/* Wheel tick it's due on */
+
+	void (*to_func)(void *, unsigned long);
+	void *to_data1;
+	unsigned long to_data2;
+};
+
+/*
+ * Longest delay timeout_add accepts, in hardclocks. Longer waits have
+ * to be done in pieces.
+ */
+#define TIMEOUT_MAXTICKS  0x7fffffffU
+
+/* Call once during startup, after thread_start_cpus. */
+void timeout_bootstrap(void);
+
+/* Called from hardclock on every cpu to run due timeouts. */
+void timeout_hardclock(void);
+
+/* Set the function and arguments. The timeout starts out not pending. */
+void timeout_init(struct timeout *to, void (*func)(void *, unsigned long),
+                  void *data1, unsigned long data2);
+
+/*
+ * Arrange for the function to be called on the TICKSth hardclock
+ * from now on the current cpu (a TICKS of 0 is treated as 1). The
+ * timeout must not already be pending.
+ */
+void timeout_add(struct timeout *to, unsigned ticks);
+
+/*
+ * Cancel a pending timeout. Returns true if it was pending, in which
+ * case the function will not be called. Returns false if it was not
+ * pending: it never was added, or the function has already been
+ * called or is about to be.
+ */
+bool timeout_cancel(struct timeout *to);
+
+#endif /* _TIMEOUT_H_ */
@@ -0,0 +1,69 @@
+#ifndef _UTHREAD_H_
+#define _UTHREAD_H_
+
+/*
+ * User threads: more than one thread in a user process.
+ *
+ * A process starts out with one thread and no thread table. The
+ * table is made the first time the process calls thread_create, and
+ * the thread that made it becomes thread 0. Thread ids are slots in
+ * the table and are reused once a thread has been joined.
+ *
+ * Each thread after the first runs on one of the address space's
+ * extra stacks (see as_define_tstack), picked when it's created.
+ *
+ * _exit, a fatal fault or execv in any thread ends all the others.
+ * That thread becomes the process's killer: it thread_kills them and
+ * waits while they notice, on their way back to user mode or in
+ * thread_join, and leave. Console reads, waitpid and nanosleep sleep
+ * killably, so those give up at once. A thread in some other
+ * system call leaves when that call returns; that includes the
+ * parent in vfork, which can't give up while its child is using its
+ * address space.
+ */
+
+#include <addrspace.h>
+
+struct thread;
+struct lock;
+struct cv;
+
+/* Threads per process, counting the first. */
+#define UTHREAD_MAX  (AS_TSTACKS + 1)
+
+struct uthread {
+	bool ut_used;			/* Created and not yet joined */
+	bool ut_exited;			/* Exited, waiting to be joined */
+	struct thread *ut_thread;	/* While running */
+	int ut_tstack;			/* Extra stack it runs on, or -1 */
+	userptr_t ut_retval;		/* Passed to thread_exit */
+};
+
+struct uthreads {
+	struct lock *ut_lock;		/* Protects everything here */
+	struct cv *ut_cv;		/* Signalled when a thread exits */
+	struct thread *ut_killer;	/* Thread ending the process, or NULL */
+	unsigned ut_live;		/* Threads that haven't exited */
+	unsigned ut_attached;		/* Threads still in the process */
+	struct uthread ut_slots[UTHREAD_MAX];
+};
+
+/* Free a process's thread table. Only its thread, if any, is left. */
+void uthreads_destroy(struct uthreads *ut);
+
+/*
+ * End every other thread in the current process and wait until they
+ * have all left it. Does not return if another thread got there
+ * first and is ending this one.
+ */
+void uthread_killothers(void);
+
+/*
+ * Checked on the way back to user mode: uthread_killed() says whether
+ * another thread is ending the current process, and uthread_die()
+ * leaves it. uthread_die() does not return.
+ */
+bool uthread_killed(void);
+void uthread_die(void);
+
+#endif /* _UTHREAD_H_ */
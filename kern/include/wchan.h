@@ -31,9 +31,100 @@
 #define _WCHAN_H_
 
 /*
- * Wait channel.
+ * Wait queues and wait channels.
  */
 
+#include <timeout.h>
+
+struct thread;
+
+/*
+ * Wait queues.
+ *
+ * A thread can sleep on any address (the "key"), normally that of
+ * the object it's waiting for, and be woken by anyone who wakes that
+ * address. Keys are hashed into a fixed table of queues, so there is
+ * nothing to create or destroy and a lock or semaphore needs no
+ * storage of its own for its sleepers.
+ *
+ * Different keys can share a queue and its lock, so never lock more
+ * than one key at a time.
+ *
+ *    waitq_lock     - Lock the queue for KEY, to bridge from some
+ *                     other lock to waitq_sleep without a race.
+ *    waitq_unlock   - Unlock it again without sleeping.
+ *    waitq_sleep    - Go to sleep on KEY, which must be locked; it
+ *                     is *unlocked* on return. NAME is shown as what
+ *                     the thread is waiting for.
+ *    waitq_sleep_killable - Same, but thread_kill can end the sleep.
+ *                     Returns EINTR, without sleeping if need be, once
+ *                     the thread has been killed, and 0 otherwise.
+ *    waitq_wakeone  - Wake up one thread sleeping on KEY. Like the
+ *                     other wake functions, KEY must not be locked.
+ *    waitq_wakehead - Wake up the thread that has been sleeping on
+ *                     KEY longest, and return it (or NULL if nobody
+ *                     was sleeping). This is FIFO by promise, for
+ *                     handing something over to the oldest waiter.
+ *                     The returned pointer is only good as an
+ *                     identity to compare against: the thread may
+ *                     already be running. The caller should hold the
+ *                     lock that the woken thread needs before it can
+ *                     look at what it was handed.
+ *    waitq_wakeall  - Wake up all threads sleeping on KEY.
+ *    waitq_isempty  - Return true if nobody is sleeping on KEY. This
+ *                     is meant to be used only for diagnostic purposes.
+ */
+void waitq_lock(const void *key);
+void waitq_unlock(const void *key);
+void waitq_sleep(const void *key, const char *name);
+int waitq_sleep_killable(const void *key, const char *name);
+void waitq_wakeone(const void *key);
+struct thread *waitq_wakehead(const void *key);
+void waitq_wakeall(const void *key);
+bool waitq_isempty(const void *key);
+
+/*
+ * Timed sleeps.
+ *
+ * A waitq_timer puts a time limit on a wait that may take several
+ * sleeps on one key (e.g. P going around its loop). When it runs
+ * out, it takes the waiting thread off the queue and makes it
+ * runnable; nobody else waiting is disturbed.
+ *
+ *    waitq_timer_start - Arm the timer for TICKS hardclocks (a TICKS
+ *                        of 0 means it has already run out) for the
+ *                        current thread, sleeping on KEY.
+ *    waitq_sleep_timed - Like waitq_sleep, on the timer's key, which
+ *                        must be locked. Returns ETIMEDOUT, without
+ *                        sleeping if need be, once the timer has run
+ *                        out, and 0 otherwise.
+ *    waitq_sleep_timed_killable - Same, but returns EINTR if the
+ *                        thread has been killed, as for
+ *                        waitq_sleep_killable.
+ *    waitq_timer_stop  - Disarm the timer. Must be called before the
+ *                        timer or the key's object go away, and
+ *                        before sleeping on any other key.
+ *
+ * The caller owns the structure; it normally lives on the stack.
+ */
+struct waitq_timer {
+	struct timeout wt_timeout;
+	const void *wt_key;
+	struct thread *wt_thread;
+	volatile bool wt_expired;	/* Time's up */
+	volatile bool wt_done;		/* Timeout function has finished */
+};
+
+void waitq_timer_start(struct waitq_timer *wt, const void *key,
+		       unsigned ticks);
+int waitq_sleep_timed(struct waitq_timer *wt, const char *name);
+int waitq_sleep_timed_killable(struct waitq_timer *wt, const char *name);
+void waitq_timer_stop(struct waitq_timer *wt);
+
+/*
+ * Wait channels: a named key to sleep on, for when there's no more
+ * natural object to use. The operations are as for wait queues.
+ */
 
 struct wchan; /* Opaque */
 
@@ -49,37 +140,13 @@ struct wchan *wchan_create(const char *name);
  */
 void wchan_destroy(struct wchan *wc);
 
-/*
- * Return nonzero if there are no threads sleeping on the channel.
- * This is meant to be used only for diagnostic purposes.
- */
 bool wchan_isempty(struct wchan *wc);
-
-/*
- * Lock and unlock the wait channel.
- */
 void wchan_lock(struct wchan *wc);
 void wchan_unlock(struct wchan *wc);
-
-/*
- * Go to sleep on a wait channel. The current thread is suspended
- * until awakened by someone else, at which point this function
- * returns.
- *
- * The channel must be locked, and will have been *unlocked* upon
- * return.
- */
 void wchan_sleep(struct wchan *wc);
-
-/*
- * Wake up one thread, or all threads, sleeping on a wait channel.
- * The queue should not already be locked.
- *
- * The current implementation is FIFO but this is not promised by the
- * interface.
- */
 void wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
+struct thread *wchan_wakehead(struct wchan *wc);
 
 
 #endif /* _WCHAN_H_ */
@@ -0,0 +1,43 @@
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Kernel workqueues.
+ *
+ * Each cpu has a worker thread that runs deferred work: a function
+ * and its two arguments, in the same form thread_fork takes. Callers
+ * with a slow but non-urgent chore (freeing a zombie process, say)
+ * hand it to a worker and carry on, instead of doing it inline.
+ *
+ * Work submitted to a cpu runs on that cpu, in submission order.
+ * A worker that wakes up takes everything queued so far and runs it
+ * as one batch, so a burst of submissions costs one wakeup.
+ *
+ * Work functions run in a kernel thread with no process context of
+ * their own and may sleep; but a work function that sleeps holds up
+ * everything behind it on the same cpu, so keep them short.
+ */
+
+/* Pass as CPUNUM to run the work wherever is convenient. */
+#define WQ_ANYCPU  (-1)
+
+/*
+ * Call once during system startup, after thread_start_cpus, to
+ * create the worker threads.
+ */
+void workqueue_bootstrap(void);
+
+/*
+ * Arrange for FUNC(DATA1, DATA2) to be called later by the worker on
+ * cpu number CPUNUM, or on the current cpu if CPUNUM is WQ_ANYCPU.
+ * Does not sleep. Returns ENOMEM if the work item can't be allocated,
+ * in which case nothing has been queued and the caller should do the
+ * work itself.
+ *
+ * Before workqueue_bootstrap there are no workers; FUNC is then
+ * called directly, before workqueue_submit returns.
+ */
+int workqueue_submit(int cpunum, void (*func)(void *, unsigned long),
+                     void *data1, unsigned long data2);
+
+#endif /* _WORKQUEUE_H_ */
@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <uio.h>
 #include <proc.h>
@@ -43,6 +44,7 @@ uiomove(void *ptr, size_t n, struct uio *uio)
 {
 	struct iovec *iov;
 	size_t size;
+	bool user;
 	int result;
 
 	if (uio->uio_rw != UIO_READ && uio->uio_rw != UIO_WRITE) {
@@ -55,6 +57,12 @@ uiomove(void *ptr, size_t n, struct uio *uio)
 		KASSERT(uio->uio_space == curproc_getas());
 	}
 
+	/* One user access window covers every iovec. */
+	user = uio->uio_segflg != UIO_SYSSPACE;
+	if (user) {
+		user_access_begin(fail);
+	}
+
 	while (n > 0 && uio->uio_resid > 0) {
 		/* get the first iovec */
 		iov = uio->uio_iov;
@@ -94,12 +102,15 @@ uiomove(void *ptr, size_t n, struct uio *uio)
 		    case UIO_USERSPACE:
 		    case UIO_USERISPACE:
 			    if (uio->uio_rw == UIO_READ) {
-				    result = copyout(ptr, iov->iov_ubase,size);
+				    result = user_copyout(ptr, iov->iov_ubase,
+							  size);
 			    }
 			    else {
-				    result = copyin(iov->iov_ubase, ptr, size);
+				    result = user_copyin(iov->iov_ubase, ptr,
+							 size);
 			    }
 			    if (result) {
+				    user_access_end();
 				    return result;
 			    }
 			    iov->iov_ubase += size;
@@ -116,7 +127,13 @@ uiomove(void *ptr, size_t n, struct uio *uio)
 		n -= size;
 	}
 
+	if (user) {
+		user_access_end();
+	}
 	return 0;
+
+ fail:
+	return EFAULT;
 }
 
 int
@@ -0,0 +1,143 @@
+/*
+ * Process id table. See pid.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <bitmap.h>
+#include <spinlock.h>
+#include <proc.h>
+#include <pid.h>
+
+/* Must be a power of two. */
+#define PID_BUCKETS  256
+
+struct pidbucket {
+	struct spinlock pb_lock;
+	struct proc *pb_procs;		/* Chained through p_pidnext */
+};
+
+static struct pidbucket pid_buckets[PID_BUCKETS];
+
+/*
+ * Which pids are taken, and where to start looking for the next free
+ * one. Protected by pid_lock.
+ */
+static struct spinlock pid_lock = SPINLOCK_INITIALIZER;
+static struct bitmap *pid_map;
+static pid_t pid_next;
+static unsigned pid_inuse;
+
+static
+struct pidbucket *
+pid_bucket(pid_t pid)
+{
+	return &pid_buckets[pid & (PID_BUCKETS - 1)];
+}
+
+void
+pid_bootstrap(void)
+{
+	unsigned i;
+
+	COMPILE_ASSERT((PID_BUCKETS & (PID_BUCKETS - 1)) == 0);
+
+	for (i=0; i<PID_BUCKETS; i++) {
+		spinlock_init(&pid_buckets[i].pb_lock);
+		spinlock_setname(&pid_buckets[i].pb_lock, "pidtable");
+		pid_buckets[i].pb_procs = NULL;
+	}
+
+	pid_map = bitmap_create(PID_MAX + 1);
+	if (pid_map == NULL) {
+		panic("pid_bootstrap: Out of memory\n");
+	}
+	/* Pids below PID_MIN are never handed out. */
+	for (i=0; i<PID_MIN; i++) {
+		bitmap_mark(pid_map, i);
+	}
+	pid_next = PID_MIN;
+	pid_inuse = 0;
+}
+
+int
+pid_alloc(struct proc *p)
+{
+	struct pidbucket *pb;
+	pid_t pid;
+
+	spinlock_acquire(&pid_lock);
+	if (pid_inuse == PID_MAX + 1 - PID_MIN) {
+		spinlock_release(&pid_lock);
+		return ENPROC;
+	}
+	/* There's a free one somewhere; this finds it within a lap. */
+	pid = pid_next;
+	while (bitmap_isset(pid_map, pid)) {
+		pid = (pid == PID_MAX) ? PID_MIN : pid + 1;
+	}
+	bitmap_mark(pid_map, pid);
+	pid_inuse++;
+	pid_next = (pid == PID_MAX) ? PID_MIN : pid + 1;
+	spinlock_release(&pid_lock);
+
+	p->PID = pid;
+
+	pb = pid_bucket(pid);
+	spinlock_acquire(&pb->pb_lock);
+	p->p_pidnext = pb->pb_procs;
+	pb->pb_procs = p;
+	spinlock_release(&pb->pb_lock);
+
+	return 0;
+}
+
+void
+pid_free(struct proc *p)
+{
+	struct pidbucket *pb;
+	struct proc **pp;
+
+	pb = pid_bucket(p->PID);
+	spinlock_acquire(&pb->pb_lock);
+	for (pp = &pb->pb_procs; *pp != p; pp = &(*pp)->p_pidnext) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = p->p_pidnext;
+	p->p_pidnext = NULL;
+	spinlock_release(&pb->pb_lock);
+
+	spinlock_acquire(&pid_lock);
+	KASSERT(bitmap_isset(pid_map, p->PID));
+	bitmap_unmark(pid_map, p->PID);
+	pid_inuse--;
+	spinlock_release(&pid_lock);
+}
+
+struct proc *
+pid_lookupchild(pid_t pid, struct proc *parent)
+{
+	struct pidbucket *pb;
+	struct proc *p;
+
+	if (pid < PID_MIN || pid > PID_MAX) {
+		return NULL;
+	}
+
+	pb = pid_bucket(pid);
+	spinlock_acquire(&pb->pb_lock);
+	for (p = pb->pb_procs; p != NULL; p = p->p_pidnext) {
+		if (p->PID == pid) {
+			break;
+		}
+	}
+	/* Still under the bucket lock, so P can't be freed meanwhile. */
+	if (p != NULL && !proc_ischild(parent, p)) {
+		p = NULL;
+	}
+	spinlock_release(&pb->pb_lock);
+
+	return p;
+}
@@ -51,6 +51,12 @@
 #include <synch.h>
 #include <kern/fcntl.h>  
 #include "opt-A2.h"
+#if OPT_A2
+#include <pid.h>
+#include <filetable.h>
+#include <uthread.h>
+#include <workqueue.h>
+#endif
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -105,6 +111,12 @@ proc_create(const char *name)
 #endif // UW
 
 #if OPT_A2
+	proc->p_filetable = NULL;
+	proc->p_vforkdone = NULL;
+	proc->p_uthreads = NULL;
+	proc->PID = 0;
+	proc->p_pidnext = NULL;
+	proc->p_childidx = 0;
 	proc->exited = false;
 	proc->parent = NULL;
 	proc->p_cv = cv_create("pcv");
@@ -191,10 +203,25 @@ proc_destroy(struct proc *proc)
 	}
 #endif // UW
 
+#if OPT_A2
+	/* normally closed in sys__exit; this is for processes that never ran */
+	if (proc->p_filetable) {
+		filetable_destroy(proc->p_filetable);
+		proc->p_filetable = NULL;
+	}
+	if (proc->p_uthreads) {
+		uthreads_destroy(proc->p_uthreads);
+		proc->p_uthreads = NULL;
+	}
+#endif
+
 	threadarray_cleanup(&proc->p_threads);
 	spinlock_cleanup(&proc->p_lock);
 
 #if OPT_A2
+  if (proc->PID != 0) {
+    pid_free(proc);
+  }
   KASSERT(proc->p_cv);
   KASSERT(proc->plock);
   KASSERT(proc->children);
@@ -247,15 +274,7 @@ proc_bootstrap(void)
   }
 #endif // UW 
 #if OPT_A2
-  PIDLock = lock_create("pidlk");
-  if (PIDLock == NULL){
-	  panic("could not create PIDLock\n");
-  }
-  PIDCounter = 1;
-  destroyLock = lock_create("dlk");
-  if (destroyLock == NULL){
-	  panic("could not create destroyLock\n");
-  }
+  pid_bootstrap();
   kproc->PID = 1;
 #endif
 }
@@ -270,15 +289,20 @@ struct proc *
 proc_create_runprogram(const char *name)
 {
 	struct proc *proc;
+#if defined(UW) && !OPT_A2
 	char *console_path;
+#endif
 
 	proc = proc_create(name);
 	if (proc == NULL) {
 		return NULL;
 	}
 
-#ifdef UW
-	/* open the console - this should always succeed */
+#if defined(UW) && !OPT_A2
+	/*
+	 * open the console - this should always succeed
+	 * (with OPT_A2, runprogram and fork set up p_filetable instead)
+	 */
 	console_path = kstrdup("con:");
 	if (console_path == NULL) {
 	  panic("unable to copy console path name during process creation\n");
@@ -287,7 +311,7 @@ proc_create_runprogram(const char *name)
 	  panic("unable to open the console during process creation\n");
 	}
 	kfree(console_path);
-#endif // UW
+#endif // UW && !OPT_A2
 	  
 	/* VM fields */
 
@@ -322,14 +346,77 @@ proc_create_runprogram(const char *name)
 #endif // UW
 
 #if OPT_A2
-  lock_acquire(PIDLock);
-  PIDCounter++;
-  proc->PID = PIDCounter;
-  lock_release(PIDLock);
+  if (pid_alloc(proc)) {
+    proc_destroy(proc);
+    return NULL;
+  }
 #endif
 	return proc;
 }
 
+#if OPT_A2
+/*
+ * Freeing a reaped process (closing its console, tearing down its
+ * synch objects, updating the process count) is not something the
+ * exiting or waiting process needs to wait for; hand it to the
+ * workqueue. If that fails, just do it here.
+ */
+static
+void
+proc_reap_work(void *p, unsigned long junk)
+{
+	(void)junk;
+	proc_destroy(p);
+}
+
+void
+proc_reap(struct proc *proc)
+{
+	if (workqueue_submit(WQ_ANYCPU, proc_reap_work, proc, 0)) {
+		proc_destroy(proc);
+	}
+}
+
+int
+proc_addchild(struct proc *parent, struct proc *child)
+{
+	KASSERT(lock_do_i_hold(parent->plock));
+	return array_add(parent->children, child, &child->p_childidx);
+}
+
+/*
+ * Move the last child into the departing one's slot.
+ */
+void
+proc_remchild(struct proc *parent, struct proc *child)
+{
+	struct proc *last;
+	unsigned num;
+
+	KASSERT(lock_do_i_hold(parent->plock));
+	num = array_num(parent->children);
+	KASSERT(child->p_childidx < num);
+	KASSERT(array_get(parent->children, child->p_childidx) == child);
+
+	last = array_get(parent->children, num - 1);
+	array_set(parent->children, child->p_childidx, last);
+	last->p_childidx = child->p_childidx;
+	array_setsize(parent->children, num - 1);
+}
+
+/*
+ * CHILD's slot says where it would be. CHILD need not be PARENT's,
+ * but it must not have been freed.
+ */
+bool
+proc_ischild(struct proc *parent, struct proc *child)
+{
+	KASSERT(lock_do_i_hold(parent->plock));
+	return child->p_childidx < array_num(parent->children) &&
+		array_get(parent->children, child->p_childidx) == child;
+}
+#endif
+
 /*
  * Add a thread to a process. Either the thread or the process might
  * or might not be current.
@@ -39,6 +39,10 @@
 #include <spl.h>
 #include <clock.h>
 #include <thread.h>
+#include <timeout.h>
+#include <workqueue.h>
+#include <lockstat.h>
+#include <schedstat.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
@@ -123,8 +127,17 @@ boot(void)
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
+	timepage_bootstrap();
 	kprintf_bootstrap();
 	thread_start_cpus();
+	timeout_bootstrap();
+	workqueue_bootstrap();
+#if OPT_LOCKSTAT
+	lockstat_bootstrap();
+#endif
+#if OPT_SCHEDSTAT
+	schedstat_bootstrap();
+#endif
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
@@ -42,6 +42,8 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockstat.h>
+#include <schedstat.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -419,6 +421,71 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_LOCKSTAT
+/*
+ * Command for the lock contention report: "lockstat [count]" prints
+ * the most-waited-for locks, "lockstat reset" starts counting afresh.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	int num = 20;
+
+	if (nargs > 2) {
+		kprintf("Usage: lockstat [count | reset]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		if (!strcmp(args[1], "reset")) {
+			lockstat_reset();
+			return 0;
+		}
+		num = atoi(args[1]);
+		if (num <= 0) {
+			kprintf("Usage: lockstat [count | reset]\n");
+			return EINVAL;
+		}
+	}
+
+	lockstat_report(num);
+	return 0;
+}
+#endif
+
+#if OPT_SCHEDSTAT
+/*
+ * Command for the scheduler statistics: "schedstat" prints totals for
+ * all cpus, "schedstat cpunum" just one cpu, and "schedstat reset"
+ * starts counting afresh, e.g. between benchmark runs.
+ */
+static
+int
+cmd_schedstat(int nargs, char **args)
+{
+	int cpunum = -1;
+
+	if (nargs > 2) {
+		kprintf("Usage: schedstat [cpunum | reset]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		if (!strcmp(args[1], "reset")) {
+			schedstat_reset();
+			return 0;
+		}
+		if (args[1][0] < '0' || args[1][0] > '9') {
+			kprintf("Usage: schedstat [cpunum | reset]\n");
+			return EINVAL;
+		}
+		cpunum = atoi(args[1]);
+	}
+
+	schedstat_report(cpunum);
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -487,8 +554,15 @@ static const char *testmenu[] = {
 	"[net] Network test                  ",
 #endif
 	"[sy1] Semaphore test                ",
+	"[wq]  Workqueue test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[sy4] Lock benchmark        (1)     ",
+	"[sy5] Handoff latency bench (1)     ",
+	"[sy6] Timed wait test       (1)     ",
+	"[rwt1] RW lock stress test          ",
+	"[rwt2] RW lock throughput           ",
+	"[cpb] copyin/copyout benchmark      ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -529,6 +603,12 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention stats    ",
+#endif
+#if OPT_SCHEDSTAT
+	"[schedstat] Scheduler stats         ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -586,6 +666,12 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+#if OPT_LOCKSTAT
+	{ "lockstat",	cmd_lockstat },
+#endif
+#if OPT_SCHEDSTAT
+	{ "schedstat",	cmd_schedstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -599,10 +685,17 @@ static struct {
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
 	{ "sy1",	semtest },
+	{ "wq",		workqueuetest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "sy4",	lockbench },
+	{ "sy5",	handoffbench },
+	{ "sy6",	timedwaittest },
+	{ "rwt1",	rwlocktest },
+	{ "rwt2",	rwlocktput },
+	{ "cpb",	copybench },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
@@ -0,0 +1,180 @@
+/*
+ * Argument vectors for execv and runprogram. See argbuf.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <limits.h>
+#include <vm.h>
+#include <copyinout.h>
+#include <argbuf.h>
+
+/* How many argv pointers to copy in at once. */
+#define ARGBUF_PTRCHUNK  32
+
+int
+argbuf_init(struct argbuf *ab)
+{
+	ab->ab_buf = kmalloc(ARG_MAX);
+	if (ab->ab_buf == NULL) {
+		return ENOMEM;
+	}
+	ab->ab_len = 0;
+	ab->ab_argc = 0;
+	return 0;
+}
+
+void
+argbuf_cleanup(struct argbuf *ab)
+{
+	kfree(ab->ab_buf);
+	ab->ab_buf = NULL;
+}
+
+/*
+ * Check that the stack image (pointer array, including the NULL at
+ * the end, plus padded strings) still fits in ARG_MAX.
+ */
+static
+bool
+argbuf_fits(struct argbuf *ab)
+{
+	return ROUNDUP(ab->ab_len, sizeof(userptr_t)) +
+		(ab->ab_argc + 1) * sizeof(userptr_t) <= ARG_MAX;
+}
+
+/*
+ * The body of argbuf_copyin, which runs it in a single user access
+ * window.
+ */
+static
+int
+argbuf_gather(struct argbuf *ab, vaddr_t addr)
+{
+	userptr_t ptrs[ARGBUF_PTRCHUNK];
+	size_t n, i, got;
+	int result;
+
+	while (1) {
+		/*
+		 * Take the pointers a chunk at a time, but don't read
+		 * past the end of the page: the NULL at the end may be
+		 * the last thing on it.
+		 */
+		n = (PAGE_SIZE - addr % PAGE_SIZE) / sizeof(userptr_t);
+		if (n > ARGBUF_PTRCHUNK) {
+			n = ARGBUF_PTRCHUNK;
+		}
+		result = user_copyin((const_userptr_t)addr, ptrs,
+				     n * sizeof(userptr_t));
+		if (result) {
+			return result;
+		}
+
+		for (i=0; i<n; i++) {
+			if (ptrs[i] == NULL) {
+				return 0;
+			}
+			result = user_copyinstr((const_userptr_t)ptrs[i],
+						ab->ab_buf + ab->ab_len,
+						ARG_MAX - ab->ab_len, &got);
+			if (result == ENAMETOOLONG) {
+				return E2BIG;
+			}
+			if (result) {
+				return result;
+			}
+			ab->ab_len += got;
+			ab->ab_argc++;
+			if (!argbuf_fits(ab)) {
+				return E2BIG;
+			}
+		}
+		addr += n * sizeof(userptr_t);
+	}
+}
+
+int
+argbuf_copyin(struct argbuf *ab, userptr_t uargv)
+{
+	vaddr_t addr;
+	int result;
+
+	addr = (vaddr_t)uargv;
+	if (addr % sizeof(userptr_t) != 0) {
+		return EFAULT;
+	}
+
+	user_access_begin(fail);
+	result = argbuf_gather(ab, addr);
+	user_access_end();
+	return result;
+
+ fail:
+	return EFAULT;
+}
+
+int
+argbuf_fromkernel(struct argbuf *ab, int argc, char **argv)
+{
+	size_t len;
+	int i;
+
+	for (i=0; i<argc; i++) {
+		len = strlen(argv[i]) + 1;
+		if (len > ARG_MAX - ab->ab_len) {
+			return E2BIG;
+		}
+		memcpy(ab->ab_buf + ab->ab_len, argv[i], len);
+		ab->ab_len += len;
+		ab->ab_argc++;
+		if (!argbuf_fits(ab)) {
+			return E2BIG;
+		}
+	}
+	return 0;
+}
+
+int
+argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr, userptr_t *uargv)
+{
+	vaddr_t *ptrs;
+	vaddr_t base, pos;
+	size_t ptrsize, strsize, len;
+	char *s;
+	int i, result;
+
+	KASSERT(argbuf_fits(ab));
+
+	/*
+	 * Slide the strings up to make room for the pointer array in
+	 * front of them, so the buffer matches the stack image.
+	 */
+	ptrsize = (ab->ab_argc + 1) * sizeof(userptr_t);
+	strsize = ROUNDUP(ab->ab_len, sizeof(userptr_t));
+	memmove(ab->ab_buf + ptrsize, ab->ab_buf, ab->ab_len);
+	bzero(ab->ab_buf + ptrsize + ab->ab_len, strsize - ab->ab_len);
+
+	base = (*stackptr & ~(vaddr_t)7) - ROUNDUP(ptrsize + strsize, 8);
+
+	/* Now fill in the pointers with where the strings will be. */
+	ptrs = (vaddr_t *)ab->ab_buf;
+	s = ab->ab_buf + ptrsize;
+	pos = base + ptrsize;
+	for (i=0; i<ab->ab_argc; i++) {
+		ptrs[i] = pos;
+		len = strlen(s) + 1;
+		s += len;
+		pos += len;
+	}
+	ptrs[ab->ab_argc] = 0;
+
+	result = copyout(ab->ab_buf, (userptr_t)base, ptrsize + strsize);
+	if (result) {
+		return result;
+	}
+	*stackptr = base;
+	*uargv = (userptr_t)base;
+	return 0;
+}
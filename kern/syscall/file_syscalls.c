@@ -1,13 +1,564 @@
+/*
+ * File-related system calls.
+ *
+ * Descriptors are looked up in the current process's filetable; see
+ * filetable.h for how open files are shared and locked.
+ */
+
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/seek.h>
 #include <kern/unistd.h>
 #include <lib.h>
 #include <uio.h>
+#include <stat.h>
+#include <synch.h>
 #include <syscall.h>
+#include <copyinout.h>
 #include <vnode.h>
 #include <vfs.h>
+#include <limits.h>
 #include <current.h>
 #include <proc.h>
+#include "opt-A2.h"
+
+#if OPT_A2
+#include <filetable.h>
+
+/*
+ * Copy a pathname in from userspace into a fresh PATH_MAX buffer,
+ * which the caller frees.
+ */
+static
+int
+copyin_path(const_userptr_t upath, char **ret)
+{
+	char *path;
+	int result;
+
+	path = kmalloc(PATH_MAX);
+	if (path == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(upath, path, PATH_MAX, NULL);
+	if (result) {
+		kfree(path);
+		return result;
+	}
+	*ret = path;
+	return 0;
+}
+
+int
+sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
+{
+	struct openfile *of;
+	char *path;
+	int result;
+
+	result = copyin_path(upath, &path);
+	if (result) {
+		return result;
+	}
+	result = openfile_open(path, flags, mode, &of);
+	kfree(path);
+	if (result) {
+		return result;
+	}
+	result = filetable_place(curproc->p_filetable, of, retval);
+	if (result) {
+		openfile_decref(of);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Common code for all the read and write calls. IOV/IOVCNT are the
+ * (kernel copy of the) user's buffers, LEN their total size.
+ *
+ * With POS NULL, I/O goes through the openfile's shared position
+ * under the offset lock; unseekable devices have neither and are
+ * always accessed at offset 0. With POS set (pread and friends) the
+ * shared position is neither used nor changed, so no lock is needed
+ * beyond whatever the file system does itself.
+ */
+static
+int
+file_io(int fd, struct iovec *iov, unsigned iovcnt, size_t len,
+	enum uio_rw rw, bool dirent, const off_t *pos, int *retval)
+{
+	struct openfile *of;
+	struct uio u;
+	struct stat st;
+	bool shared;
+	int accmode, result;
+
+	result = filetable_get(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+
+	accmode = of->of_flags & O_ACCMODE;
+	if ((rw == UIO_READ && accmode == O_WRONLY) ||
+	    (rw == UIO_WRITE && accmode == O_RDONLY)) {
+		openfile_decref(of);
+		return EBADF;
+	}
+	if (pos != NULL && !of->of_seekable) {
+		openfile_decref(of);
+		return ESPIPE;
+	}
+	if (pos != NULL && *pos < 0) {
+		openfile_decref(of);
+		return EINVAL;
+	}
+
+	shared = (pos == NULL && of->of_offsetlock != NULL);
+	if (shared) {
+		lock_acquire(of->of_offsetlock);
+		if (rw == UIO_WRITE && (of->of_flags & O_APPEND)) {
+			result = VOP_STAT(of->of_vnode, &st);
+			if (result) {
+				goto out;
+			}
+			of->of_offset = st.st_size;
+		}
+	}
+
+	u.uio_iov = iov;
+	u.uio_iovcnt = iovcnt;
+	u.uio_offset = pos != NULL ? *pos : shared ? of->of_offset : 0;
+	u.uio_resid = len;
+	u.uio_segflg = UIO_USERSPACE;
+	u.uio_rw = rw;
+	u.uio_space = curproc->p_addrspace;
+
+	if (dirent) {
+		result = VOP_GETDIRENTRY(of->of_vnode, &u);
+	}
+	else if (rw == UIO_READ) {
+		result = VOP_READ(of->of_vnode, &u);
+	}
+	else {
+		result = VOP_WRITE(of->of_vnode, &u);
+	}
+	if (result == 0) {
+		if (shared) {
+			of->of_offset = u.uio_offset;
+		}
+		*retval = len - u.uio_resid;
+	}
+
+ out:
+	if (shared) {
+		lock_release(of->of_offsetlock);
+	}
+	openfile_decref(of);
+	return result;
+}
+
+static
+int
+file_io1(int fd, userptr_t buf, size_t len, enum uio_rw rw, bool dirent,
+	 const off_t *pos, int *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = len;
+	return file_io(fd, &iov, 1, len, rw, dirent, pos, retval);
+}
+
+/*
+ * Vectors this short are copied onto the stack instead of kmalloc'd.
+ */
+#define FILE_SMALLIOV  8
+
+/*
+ * Common code for the vectored calls: copy in the user's iovec array
+ * and hand the whole thing to the file system as one uio.
+ */
+static
+int
+file_iov(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	 const off_t *pos, int *retval)
+{
+	struct iovec smalliov[FILE_SMALLIOV];
+	struct iovec *iov;
+	size_t len;
+	int i, result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+	if (iovcnt <= FILE_SMALLIOV) {
+		iov = smalliov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(*iov));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (result) {
+		goto out;
+	}
+
+	/* The total has to fit in the int we return. */
+	len = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > (size_t)0x7fffffff - len) {
+			result = EINVAL;
+			goto out;
+		}
+		len += iov[i].iov_len;
+	}
+
+	result = file_io(fd, iov, iovcnt, len, rw, false, pos, retval);
+
+ out:
+	if (iov != smalliov) {
+		kfree(iov);
+	}
+	return result;
+}
+
+int
+sys_read(int fd, userptr_t buf, size_t len, int *retval)
+{
+	return file_io1(fd, buf, len, UIO_READ, false, NULL, retval);
+}
+
+int
+sys_write(int fd, userptr_t buf, unsigned int len, int *retval)
+{
+	return file_io1(fd, buf, len, UIO_WRITE, false, NULL, retval);
+}
+
+int
+sys_pread(int fd, userptr_t buf, size_t len, off_t pos, int *retval)
+{
+	return file_io1(fd, buf, len, UIO_READ, false, &pos, retval);
+}
+
+int
+sys_pwrite(int fd, userptr_t buf, size_t len, off_t pos, int *retval)
+{
+	return file_io1(fd, buf, len, UIO_WRITE, false, &pos, retval);
+}
+
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return file_iov(fd, iov, iovcnt, UIO_READ, NULL, retval);
+}
+
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return file_iov(fd, iov, iovcnt, UIO_WRITE, NULL, retval);
+}
+
+int
+sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+	return file_iov(fd, iov, iovcnt, UIO_READ, &pos, retval);
+}
+
+int
+sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+	return file_iov(fd, iov, iovcnt, UIO_WRITE, &pos, retval);
+}
+
+int
+sys_getdirentry(int fd, userptr_t buf, size_t len, int *retval)
+{
+	return file_io1(fd, buf, len, UIO_READ, true, NULL, retval);
+}
+
+int
+sys_close(int fd)
+{
+	struct openfile *of;
+	int result;
+
+	result = filetable_remove(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+	openfile_decref(of);
+	return 0;
+}
+
+int
+sys_lseek(int fd, off_t pos, int whence, off_t *retval)
+{
+	struct openfile *of;
+	struct stat st;
+	off_t newpos;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+	if (!of->of_seekable) {
+		openfile_decref(of);
+		return ESPIPE;
+	}
+
+	lock_acquire(of->of_offsetlock);
+	switch (whence) {
+	    case SEEK_SET:
+		newpos = pos;
+		break;
+	    case SEEK_CUR:
+		newpos = of->of_offset + pos;
+		break;
+	    case SEEK_END:
+		result = VOP_STAT(of->of_vnode, &st);
+		if (result) {
+			goto out;
+		}
+		newpos = st.st_size + pos;
+		break;
+	    default:
+		result = EINVAL;
+		goto out;
+	}
+	if (newpos < 0) {
+		result = EINVAL;
+		goto out;
+	}
+	of->of_offset = newpos;
+	*retval = newpos;
+
+ out:
+	lock_release(of->of_offsetlock);
+	openfile_decref(of);
+	return result;
+}
+
+int
+sys_dup(int fd, int *retval)
+{
+	struct openfile *of;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+	/* the reference filetable_get gave us goes into the new slot */
+	result = filetable_place(curproc->p_filetable, of, retval);
+	if (result) {
+		openfile_decref(of);
+		return result;
+	}
+	return 0;
+}
+
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+	struct openfile *of, *old;
+	int result;
+
+	if (newfd < 0 || newfd >= OPEN_MAX) {
+		return EBADF;
+	}
+	result = filetable_get(curproc->p_filetable, oldfd, &of);
+	if (result) {
+		return result;
+	}
+	if (oldfd == newfd) {
+		openfile_decref(of);
+		*retval = newfd;
+		return 0;
+	}
+	result = filetable_placeat(curproc->p_filetable, of, newfd, &old);
+	KASSERT(result == 0);
+	if (old != NULL) {
+		openfile_decref(old);
+	}
+	*retval = newfd;
+	return 0;
+}
+
+int
+sys_fstat(int fd, userptr_t statbuf)
+{
+	struct openfile *of;
+	struct stat st;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+	result = VOP_STAT(of->of_vnode, &st);
+	openfile_decref(of);
+	if (result) {
+		return result;
+	}
+	return copyout(&st, statbuf, sizeof(st));
+}
+
+int
+sys_fsync(int fd)
+{
+	struct openfile *of;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+	result = VOP_FSYNC(of->of_vnode);
+	openfile_decref(of);
+	return result;
+}
+
+int
+sys_ftruncate(int fd, off_t len)
+{
+	struct openfile *of;
+	int result;
+
+	if (len < 0) {
+		return EINVAL;
+	}
+	result = filetable_get(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+	if ((of->of_flags & O_ACCMODE) == O_RDONLY) {
+		openfile_decref(of);
+		return EINVAL;
+	}
+	result = VOP_TRUNCATE(of->of_vnode, len);
+	openfile_decref(of);
+	return result;
+}
+
+int
+sys_chdir(const_userptr_t upath)
+{
+	char *path;
+	int result;
+
+	result = copyin_path(upath, &path);
+	if (result) {
+		return result;
+	}
+	result = vfs_chdir(path);
+	kfree(path);
+	return result;
+}
+
+int
+sys___getcwd(userptr_t buf, size_t len, int *retval)
+{
+	struct iovec iov;
+	struct uio u;
+	int result;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = len;
+	u.uio_iov = &iov;
+	u.uio_iovcnt = 1;
+	u.uio_offset = 0;
+	u.uio_resid = len;
+	u.uio_segflg = UIO_USERSPACE;
+	u.uio_rw = UIO_READ;
+	u.uio_space = curproc->p_addrspace;
+
+	result = vfs_getcwd(&u);
+	if (result) {
+		return result;
+	}
+	*retval = len - u.uio_resid;
+	return 0;
+}
+
+int
+sys_remove(const_userptr_t upath)
+{
+	char *path;
+	int result;
+
+	result = copyin_path(upath, &path);
+	if (result) {
+		return result;
+	}
+	result = vfs_remove(path);
+	kfree(path);
+	return result;
+}
+
+int
+sys_mkdir(const_userptr_t upath, mode_t mode)
+{
+	char *path;
+	int result;
+
+	result = copyin_path(upath, &path);
+	if (result) {
+		return result;
+	}
+	result = vfs_mkdir(path, mode);
+	kfree(path);
+	return result;
+}
+
+int
+sys_rmdir(const_userptr_t upath)
+{
+	char *path;
+	int result;
+
+	result = copyin_path(upath, &path);
+	if (result) {
+		return result;
+	}
+	result = vfs_rmdir(path);
+	kfree(path);
+	return result;
+}
+
+int
+sys_rename(const_userptr_t uoldpath, const_userptr_t unewpath)
+{
+	char *oldpath, *newpath;
+	int result;
+
+	result = copyin_path(uoldpath, &oldpath);
+	if (result) {
+		return result;
+	}
+	result = copyin_path(unewpath, &newpath);
+	if (result) {
+		kfree(oldpath);
+		return result;
+	}
+	result = vfs_rename(oldpath, newpath);
+	kfree(oldpath);
+	kfree(newpath);
+	return result;
+}
+
+int
+sys_sync(void)
+{
+	return vfs_sync();
+}
+
+#else /* OPT_A2 */
 
 /* handler for write() system call                  */
 /*
@@ -58,3 +609,5 @@ sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
   KASSERT(*retval >= 0);
   return 0;
 }
+
+#endif /* OPT_A2 */
@@ -0,0 +1,268 @@
+/*
+ * Open files and file descriptor tables. See filetable.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <synch.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <stat.h>
+#include <filetable.h>
+
+////////////////////////////////////////////////////////////
+// Open files
+
+int
+openfile_open(char *path, int flags, mode_t mode, struct openfile **ret)
+{
+	struct openfile *of;
+	struct vnode *vn;
+	mode_t type;
+	int accmode, result;
+
+	accmode = flags & O_ACCMODE;
+	if (accmode != O_RDONLY && accmode != O_WRONLY && accmode != O_RDWR) {
+		return EINVAL;
+	}
+
+	of = kmalloc(sizeof(*of));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+
+	result = vfs_open(path, flags, mode, &vn);
+	if (result) {
+		kfree(of);
+		return result;
+	}
+
+	of->of_vnode = vn;
+	of->of_flags = flags & (O_ACCMODE | O_APPEND);
+	of->of_seekable = VOP_TRYSEEK(vn, 0) == 0;
+	of->of_offsetlock = NULL;
+	of->of_offset = 0;
+	spinlock_init(&of->of_reflock);
+	of->of_refcount = 1;
+
+	/*
+	 * Directories don't seek, but getdirentry still walks them by
+	 * offset, so they need the lock too.
+	 */
+	result = VOP_GETTYPE(vn, &type);
+	if (result) {
+		vfs_close(vn);
+		spinlock_cleanup(&of->of_reflock);
+		kfree(of);
+		return result;
+	}
+	if (of->of_seekable || (type & S_IFMT) == S_IFDIR) {
+		of->of_offsetlock = lock_create("openfile");
+		if (of->of_offsetlock == NULL) {
+			vfs_close(vn);
+			spinlock_cleanup(&of->of_reflock);
+			kfree(of);
+			return ENOMEM;
+		}
+	}
+
+	*ret = of;
+	return 0;
+}
+
+void
+openfile_incref(struct openfile *of)
+{
+	spinlock_acquire(&of->of_reflock);
+	KASSERT(of->of_refcount > 0);
+	of->of_refcount++;
+	spinlock_release(&of->of_reflock);
+}
+
+void
+openfile_decref(struct openfile *of)
+{
+	bool last;
+
+	spinlock_acquire(&of->of_reflock);
+	KASSERT(of->of_refcount > 0);
+	of->of_refcount--;
+	last = (of->of_refcount == 0);
+	spinlock_release(&of->of_reflock);
+
+	if (!last) {
+		return;
+	}
+	vfs_close(of->of_vnode);
+	if (of->of_offsetlock != NULL) {
+		lock_destroy(of->of_offsetlock);
+	}
+	spinlock_cleanup(&of->of_reflock);
+	kfree(of);
+}
+
+////////////////////////////////////////////////////////////
+// Descriptor tables
+
+struct filetable *
+filetable_create(void)
+{
+	struct filetable *ft;
+	unsigned i;
+
+	ft = kmalloc(sizeof(*ft));
+	if (ft == NULL) {
+		return NULL;
+	}
+	spinlock_init(&ft->ft_lock);
+	for (i=0; i<OPEN_MAX; i++) {
+		ft->ft_files[i] = NULL;
+	}
+	return ft;
+}
+
+/*
+ * Nobody else can be using the table by now, so no locking.
+ */
+void
+filetable_destroy(struct filetable *ft)
+{
+	unsigned i;
+
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] != NULL) {
+			openfile_decref(ft->ft_files[i]);
+			ft->ft_files[i] = NULL;
+		}
+	}
+	spinlock_cleanup(&ft->ft_lock);
+	kfree(ft);
+}
+
+int
+filetable_copy(struct filetable *src, struct filetable **ret)
+{
+	struct filetable *ft;
+	unsigned i;
+
+	ft = filetable_create();
+	if (ft == NULL) {
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&src->ft_lock);
+	for (i=0; i<OPEN_MAX; i++) {
+		if (src->ft_files[i] != NULL) {
+			openfile_incref(src->ft_files[i]);
+			ft->ft_files[i] = src->ft_files[i];
+		}
+	}
+	spinlock_release(&src->ft_lock);
+
+	*ret = ft;
+	return 0;
+}
+
+int
+filetable_openstd(struct filetable *ft)
+{
+	static const int stdflags[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+	struct openfile *of;
+	struct openfile *old;
+	char path[5];
+	int fd, result;
+
+	for (fd=0; fd<3; fd++) {
+		/* vfs_open eats the path, so give it a fresh one each time */
+		strcpy(path, "con:");
+		result = openfile_open(path, stdflags[fd], 0664, &of);
+		if (result) {
+			return result;
+		}
+		result = filetable_placeat(ft, of, fd, &old);
+		KASSERT(result == 0);
+		if (old != NULL) {
+			openfile_decref(old);
+		}
+	}
+	return 0;
+}
+
+int
+filetable_get(struct filetable *ft, int fd, struct openfile **ret)
+{
+	struct openfile *of;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	of = ft->ft_files[fd];
+	if (of != NULL) {
+		openfile_incref(of);
+	}
+	spinlock_release(&ft->ft_lock);
+
+	if (of == NULL) {
+		return EBADF;
+	}
+	*ret = of;
+	return 0;
+}
+
+int
+filetable_place(struct filetable *ft, struct openfile *of, int *fd)
+{
+	int i;
+
+	spinlock_acquire(&ft->ft_lock);
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] == NULL) {
+			ft->ft_files[i] = of;
+			spinlock_release(&ft->ft_lock);
+			*fd = i;
+			return 0;
+		}
+	}
+	spinlock_release(&ft->ft_lock);
+	return EMFILE;
+}
+
+int
+filetable_placeat(struct filetable *ft, struct openfile *of, int fd,
+		  struct openfile **oldret)
+{
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	*oldret = ft->ft_files[fd];
+	ft->ft_files[fd] = of;
+	spinlock_release(&ft->ft_lock);
+	return 0;
+}
+
+int
+filetable_remove(struct filetable *ft, int fd, struct openfile **ret)
+{
+	struct openfile *of;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	of = ft->ft_files[fd];
+	ft->ft_files[fd] = NULL;
+	spinlock_release(&ft->ft_lock);
+
+	if (of == NULL) {
+		return EBADF;
+	}
+	*ret = of;
+	return 0;
+}
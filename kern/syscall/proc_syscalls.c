@@ -15,6 +15,66 @@
 #include <mips/trapframe.h>
 #include <kern/fcntl.h>
 #include <vfs.h>
+#include <limits.h>
+#include <pid.h>
+#include <filetable.h>
+#include <argbuf.h>
+#include <uthread.h>
+#endif
+
+#if OPT_A2
+/*
+ * Reaped processes are freed with proc_reap, in the workqueue. The
+ * workqueue is also the reaper for orphans. A process whose parent
+ * exits first gets a NULL parent; it's handed over when it exits, or
+ * right away if it's already a zombie.
+ *
+ * Exit and wait synchronize on the exiting process's plock and p_cv
+ * only. A process's exited, exitCode and parent fields are protected
+ * by its own plock. When both a parent's and a child's plock are
+ * needed, the parent's is taken first.
+ */
+
+/*
+ * A vforked child is finished with its parent's address space; let
+ * the parent go on.
+ */
+static
+void
+vfork_release(struct proc *p)
+{
+  struct semaphore *done = p->p_vforkdone;
+
+  KASSERT(done != NULL);
+  p->p_vforkdone = NULL;
+  V(done);
+}
+
+/*
+ * waitpid gave up on CHILD after taking it out of our children; put
+ * it back. If there's no memory for that, hand it to the reaper as if
+ * we had exited.
+ */
+static
+void
+waitpid_putback(struct proc *child)
+{
+  bool zombie;
+
+  lock_acquire(curproc->plock);
+  if (proc_addchild(curproc, child) == 0) {
+    lock_release(curproc->plock);
+    return;
+  }
+  lock_acquire(child->plock);
+  child->parent = NULL;
+  zombie = child->exited;
+  lock_release(child->plock);
+  lock_release(curproc->plock);
+  if (zombie) {
+    proc_reap(child);
+  }
+}
 #endif
 
   /* this implementation of sys__exit does not do anything with the exit code */
@@ -22,18 +82,27 @@
 
 void sys__exit(int exitcode) {
 
+  DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
+  proc_exit(_MKWAIT_EXIT(exitcode));
+}
+
+void proc_exit(int waitstatus) {
+
   struct addrspace *as;
   struct proc *p = curproc;
 #if OPT_A2
-  lock_acquire(destroyLock);
-  p->exitCode = exitcode;
+  struct proc *child;
+  bool zombie, orphan;
 #else
   /* for now, just include this to keep the compiler from complaining about
    an unused variable */
-  (void)exitcode;
+  (void)waitstatus;
 #endif
 
-  DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
+#if OPT_A2
+  /* the rest of our threads go first */
+  uthread_killothers();
+#endif
 
   KASSERT(curproc->p_addrspace != NULL);
   as_deactivate();
@@ -45,33 +114,65 @@ void sys__exit(int exitcode) {
    * messily fatal.
    */
   as = curproc_setas(NULL);
+#if OPT_A2
+  if (p->p_vforkdone != NULL) {
+    /* it was our parent's */
+    vfork_release(p);
+  }
+  else {
+    as_destroy(as);
+  }
+#else
   as_destroy(as);
+#endif
+
+#if OPT_A2
+  /* close our files now rather than whenever we get reaped */
+  if (p->p_filetable != NULL) {
+    filetable_destroy(p->p_filetable);
+    p->p_filetable = NULL;
+  }
+#endif
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
   proc_remthread(curthread);
 
 #if OPT_A2
-
-  for(unsigned i = 0; i < array_num(p->children); i++){
-   struct proc * currChild = array_get(p->children, i);
-   if (currChild != NULL){
-    currChild->parent = NULL;
-    if(currChild->exited == 1){
-      proc_destroy(currChild);
+  /*
+   * Give our children to the reaper. Each either sees its parent
+   * gone when it exits and reaps itself, or was already a zombie
+   * when we looked and we reap it here; the child's plock makes
+   * sure it's exactly one of the two.
+   */
+  lock_acquire(p->plock);
+  for (unsigned i = 0; i < array_num(p->children); i++) {
+    child = array_get(p->children, i);
+    lock_acquire(child->plock);
+    child->parent = NULL;
+    zombie = child->exited;
+    lock_release(child->plock);
+    if (zombie) {
+      proc_reap(child);
     }
-   }
   }
+  array_setsize(p->children, 0);
 
-  if (p->parent != NULL){
-    lock_acquire(p->plock);
+  /*
+   * Now tell our parent, or if there isn't one, reap ourselves.
+   * Once plock is released the parent may destroy p at any moment,
+   * so don't touch it after that.
+   */
+  p->exitCode = waitstatus;
+  p->exited = true;
+  orphan = (p->parent == NULL);
+  if (!orphan) {
     cv_signal(p->p_cv, p->plock);
-    lock_release(p->plock);
-  } else {
-    proc_destroy(p);
   }
-  p->exited = true;
-  lock_release(destroyLock);
+  lock_release(p->plock);
+  if (orphan) {
+    proc_reap(p);
+  }
 #else
   /* if this is the last user process in the system, proc_destroy()
      will wake up the kernel menu thread */
@@ -80,7 +181,7 @@ void sys__exit(int exitcode) {
 
   thread_exit();
   /* thread_exit() does not return, so we should never get here */
-  panic("return from thread_exit in sys_exit\n");
+  panic("return from thread_exit in proc_exit\n");
 }
 
 
@@ -126,36 +227,42 @@ sys_waitpid(pid_t pid,
     return(EINVAL);
   }
 #if OPT_A2
-  struct proc * targetChild = NULL;
-  for(unsigned i = 0; i < array_num(curproc->children); i++){
-   struct proc * currChild = array_get(curproc->children, i);
-   if (currChild->PID == pid) {
-     targetChild = currChild;
-     array_remove(curproc->children, i);
-     break;
-   }
-  }
-  
+  if(status == NULL){
+    DEBUG(DB_SYSCALL, "sys_waitpid status parameter is NULL");
+	  return EFAULT;
+  }
+
+  /*
+   * Look the child up and take it out of our children in one go, so
+   * no other thread of ours can wait for it too.
+   */
+  lock_acquire(curproc->plock);
+  struct proc * targetChild = pid_lookupchild(pid, curproc);
   if (targetChild == NULL){
+    lock_release(curproc->plock);
     DEBUG(DB_SYSCALL, "sys_waitpid failed to find child");
     return ECHILD;
   }
+  proc_remchild(curproc, targetChild);
+  lock_release(curproc->plock);
 
-  KASSERT(targetChild->parent == curproc);
-
+  /* The child is ours alone now; nobody else can reap it. */
   lock_acquire(targetChild->plock);
-  if (targetChild->exitCode == -1){
+  KASSERT(targetChild->parent == curproc);
+  result = 0;
+  while (!targetChild->exited && result == 0){
     DEBUG(DB_SYSCALL, "sys_waitpid sleeping for child");
-    cv_wait(targetChild->p_cv, targetChild->plock);
+    result = cv_wait_killable(targetChild->p_cv, targetChild->plock);
   }
-  lock_release(targetChild->plock);
-
-  if(status == NULL){
-    DEBUG(DB_SYSCALL, "sys_waitpid status parameter is NULL");
-	  return EFAULT;
+  if (!targetChild->exited) {
+    /* Another thread is ending this process. */
+    lock_release(targetChild->plock);
+    waitpid_putback(targetChild);
+    return result;
   }
-
-  exitstatus = _MKWAIT_EXIT(targetChild->exitCode);
+  exitstatus = targetChild->exitCode;
+  lock_release(targetChild->plock);
+  proc_reap(targetChild);
 
 #else
   /* for now, just pretend the exitstatus is 0 */
@@ -166,233 +273,429 @@ sys_waitpid(pid_t pid,
     return(result);
   }
   *retval = pid;
-#if OPT_A2
-  proc_destroy(targetChild);
-#endif
   return(0);
 }
 
 #if OPT_A2
+/*
+ * The common part of fork, vfork and spawn: make a child of curproc
+ * that shares our open files and has address space AS, and add it to
+ * our children. It has no thread yet. The caller keeps AS if this
+ * fails.
+ */
+static
+int
+fork_proc(const char *name, struct addrspace *as, struct proc **ret)
+{
+  struct proc *child;
+  int result;
+
+  child = proc_create_runprogram(name);
+  if (child == NULL) {
+    DEBUG(DB_SYSCALL, "fork_proc cannot create process structure, ENOMEM");
+    return ENOMEM;
+  }
+
+  /* The child shares our open files, seek positions and all. */
+  result = filetable_copy(curproc->p_filetable, &child->p_filetable);
+  if (result) {
+    proc_destroy(child);
+    return result;
+  }
+
+  lock_acquire(child->plock);
+  child->p_addrspace = as;
+  child->parent = curproc;
+  lock_release(child->plock);
+
+  lock_acquire(curproc->plock);
+  result = proc_addchild(curproc, child);
+  lock_release(curproc->plock);
+  if (result) {
+    proc_destroy(child);
+    return result;
+  }
+
+  *ret = child;
+  return 0;
+}
+
+/*
+ * Undo fork_proc for a child with no threads in it. Its address
+ * space, if it has one, is left for the caller.
+ *
+ * Pids are easy to guess, so another of our threads may already have
+ * taken the child to wait for it. Then the child is made to look as
+ * if it had exited, as a child whose exec failed would, and whoever
+ * ends up with it reaps it.
+ */
+static
+void
+fork_unproc(struct proc *child)
+{
+  bool ours, orphan;
+
+  lock_acquire(curproc->plock);
+  ours = proc_ischild(curproc, child);
+  if (ours) {
+    proc_remchild(curproc, child);
+  }
+  lock_release(curproc->plock);
+  if (ours) {
+    proc_destroy(child);
+    return;
+  }
+
+  lock_acquire(child->plock);
+  child->exitCode = _MKWAIT_EXIT(127);
+  child->exited = true;
+  orphan = (child->parent == NULL);
+  if (!orphan) {
+    cv_signal(child->p_cv, child->plock);
+  }
+  lock_release(child->plock);
+  if (orphan) {
+    proc_reap(child);
+  }
+}
+
 int
 sys_fork(struct trapframe *tf, 
           pid_t *retval)
 {
+  struct proc *forked;
+  struct addrspace *as_cpy;
+  struct trapframe *tf_copy;
+  pid_t pid;
+  int result;
+
   KASSERT(tf);
   KASSERT(retval);
-  struct proc * forked = proc_create_runprogram("forked");
-  if (forked == NULL) {
-    DEBUG(DB_SYSCALL, "sys_fork cannot create process structure, ENOMEM");
-    return ENOMEM;
-  }
 
-  struct addrspace * as_cpy;
-  as_copy(curproc_getas(), &as_cpy);
-  if (as_cpy == NULL){
-    proc_destroy(forked);
-    DEBUG(DB_SYSCALL, "sys_fork cannot create addrspace, ENOMEM");
-    return ENOMEM;
+  result = as_copy(curproc_getas(), &as_cpy);
+  if (result) {
+    DEBUG(DB_SYSCALL, "sys_fork cannot create addrspace");
+    return result;
   }
 
-  struct trapframe * tf_copy = kmalloc(sizeof(struct trapframe));
+  tf_copy = kmalloc(sizeof(struct trapframe));
   if (tf_copy == NULL){
-    proc_destroy(forked);
     as_destroy(as_cpy);
     DEBUG(DB_SYSCALL, "sys_fork cannot create trapframe, ENOMEM");
     return ENOMEM;
   }
-
   *tf_copy = *tf;
 
-  // curproc_setas
-  lock_acquire(forked->plock);
-  forked->p_addrspace = as_cpy;
-  forked->parent = curproc;
-	lock_release(forked->plock);
-
-  lock_acquire(curproc->plock);
-  array_add(curproc->children, forked, NULL);
-  lock_release(curproc->plock);
+  result = fork_proc("forked", as_cpy, &forked);
+  if (result) {
+    kfree(tf_copy);
+    as_destroy(as_cpy);
+    return result;
+  }
+  /*
+   * Once the child runs, another of our threads can wait for it and
+   * reap it, so it mustn't be touched after thread_fork.
+   */
+  pid = forked->PID;
+  KASSERT(pid > 0);
 
   if(thread_fork("forkedt", forked, enter_forked_process, tf_copy, 65536) != 0){
+    fork_unproc(forked);
     kfree(tf_copy);
-    as_destroy(forked->p_addrspace);
-    proc_destroy(forked);
+    as_destroy(as_cpy);
     DEBUG(DB_SYSCALL, "sys_fork cannot thread_fork, ENOMEM");
     return ENOMEM;
   }
 
-  KASSERT(forked->PID > 0);
-  *retval = forked->PID;
+  *retval = pid;
 
   return 0;
 }
 
-int copyoutargs(int argc, char * argv[], vaddr_t * stackptr){
-  *stackptr = ROUNDUP(*stackptr,8);
-  vaddr_t argvptrs[argc+1];
-  for(int i = argc; i >= 0; i--){
-    if (i == argc) {
-      argvptrs[i] = 0; continue;
-    }
-    int arglen = strlen(argv[i]) + 1;
-    *stackptr -= arglen;
-    int result = copyoutstr(argv[i], (userptr_t)*stackptr, arglen, NULL);
-    if (result) return result;
-    argvptrs[i] = *stackptr;
-  }
-  for(;(*stackptr) % 4; (*stackptr)--);
-  for(int i = argc ; i >= 0; i--){
-    int padding = ROUNDUP(sizeof(*stackptr), 4);
-    *stackptr -= padding;
-    int result = copyout(&argvptrs[i], (userptr_t) *stackptr, sizeof(vaddr_t));
-    if (result) return result;
+/*
+ * vfork: like fork, except that the child runs in our address space
+ * instead of a copy of it, and we sleep until it's done with it, that
+ * is, until it execs or exits. It's on the child not to disturb
+ * anything of ours in the meantime.
+ */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+  struct proc *child;
+  struct trapframe *tf_copy;
+  struct semaphore *done;
+  pid_t pid;
+  int result;
+
+  KASSERT(tf);
+  KASSERT(retval);
+
+  done = sem_create("vfork", 0);
+  if (done == NULL) {
+    return ENOMEM;
+  }
+  tf_copy = kmalloc(sizeof(struct trapframe));
+  if (tf_copy == NULL) {
+    sem_destroy(done);
+    return ENOMEM;
+  }
+  *tf_copy = *tf;
+
+  result = fork_proc("vforked", curproc_getas(), &child);
+  if (result) {
+    kfree(tf_copy);
+    sem_destroy(done);
+    return result;
   }
+  child->p_vforkdone = done;
+  /* As in fork, the child is off limits once it runs. */
+  pid = child->PID;
+
+  result = thread_fork("vforkedt", child, enter_forked_process, tf_copy, 0);
+  if (result) {
+    fork_unproc(child);
+    kfree(tf_copy);
+    sem_destroy(done);
+    return result;
+  }
+
+  *retval = pid;
+  /*
+   * Not killable: until the child is done with our address space,
+   * it mustn't be freed under it.
+   */
+  P(done);
+  sem_destroy(done);
   return 0;
 }
 
+/*
+ * spawn: make a child running a new program, without ever copying
+ * our address space. We gather the arguments and open the program
+ * here, where errors can still be returned to the caller; the child
+ * builds its own address space and tells us how that went before
+ * going to user mode.
+ */
+struct spawn_args {
+  struct argbuf sa_args;
+  struct vnode *sa_vnode;
+  struct semaphore *sa_done;
+  int sa_result;
+};
+
+static
+void
+spawn_enter(void *data, unsigned long junk)
+{
+  struct spawn_args *sa = data;
+  struct addrspace *as;
+  vaddr_t entrypoint, stackptr;
+  userptr_t uargv;
+  int argc, result;
+
+  (void)junk;
+
+  as = as_create();
+  if (as == NULL) {
+    result = ENOMEM;
+    goto fail;
+  }
+  curproc_setas(as);
+  as_activate();
+
+  result = load_elf(sa->sa_vnode, &entrypoint);
+  if (result) goto fail;
+  result = as_define_stack(as, &stackptr);
+  if (result) goto fail;
+  result = argbuf_copyout(&sa->sa_args, &stackptr, &uargv);
+  if (result) goto fail;
+
+  /* sa is on the parent's stack, and may be gone once we signal. */
+  argc = sa->sa_args.ab_argc;
+  sa->sa_result = 0;
+  V(sa->sa_done);
+
+  enter_new_process(argc, uargv, stackptr, entrypoint);
+  panic("enter_new_process returned\n");
+
+ fail:
+  /* Leave the process for the parent to clean up. */
+  as_deactivate();
+  proc_remthread(curthread);
+  sa->sa_result = result;
+  V(sa->sa_done);
+  thread_exit();
+}
+
 int
-sys_execv(const char * progname, char * args[])
+sys_spawn(userptr_t path, userptr_t args, pid_t *retval)
 {
-  // Copied from runprogram
-	struct addrspace *as;
-	struct vnode *v;
-	vaddr_t entrypoint, stackptr;
-	int result;
-  // end copy
+  struct spawn_args sa;
+  struct proc *child;
+  struct addrspace *as;
+  char *kpath;
+  pid_t pid;
+  int result;
 
-  if (progname == NULL || args == NULL) return EFAULT;
+  if (path == NULL || args == NULL) return EFAULT;
 
-  /* Count arguments */
-  int argc;
-  for(argc = 0; args[argc] != NULL; argc++);
-  // kprintf("I counted argc = %d\n", argc);
+  kpath = kmalloc(PATH_MAX);
+  if (kpath == NULL) return ENOMEM;
+  result = copyinstr(path, kpath, PATH_MAX, NULL);
+  if (result) goto fail_path;
 
-  /* Copy arguments to kernel */
-  char ** kargv = kmalloc((argc+1)*(sizeof(char*)));
-  for (int i = 0; i < argc; i++){
-    kargv[i] = kmalloc((strlen(args[i])+1)*sizeof(char));
-    if (kargv[i] == NULL) {
-      kfree(kargv);
-      return ENOMEM;
-    }
-    int err = copyinstr((const_userptr_t) args[i], kargv[i], (strlen(args[i])+1)*sizeof(char), NULL);
-    if (err) {
-      for(;i >= 0; i--) kfree(kargv[i]);
-      kfree(kargv);
-      return err;
+  result = argbuf_init(&sa.sa_args);
+  if (result) goto fail_path;
+  result = argbuf_copyin(&sa.sa_args, args);
+  if (result) goto fail_args;
+
+  result = vfs_open(kpath, O_RDONLY, 0, &sa.sa_vnode);
+  if (result) goto fail_args;
+
+  sa.sa_done = sem_create("spawn", 0);
+  if (sa.sa_done == NULL) {
+    result = ENOMEM;
+    goto fail_open;
+  }
+
+  result = fork_proc("spawned", NULL, &child);
+  if (result) goto fail_sem;
+  /*
+   * As in fork, a child that gets going is off limits. One that
+   * fails never exits by itself, so it stays ours to take apart.
+   */
+  pid = child->PID;
+
+  result = thread_fork("spawnedt", child, spawn_enter, &sa, 0);
+  if (result) {
+    fork_unproc(child);
+    goto fail_sem;
+  }
+
+  P(sa.sa_done);
+  result = sa.sa_result;
+  if (result) {
+    /* The child's thread has left; take the rest of it apart. */
+    as = child->p_addrspace;
+    fork_unproc(child);
+    if (as != NULL) {
+      as_destroy(as);
     }
   }
-  kargv[argc] = NULL;
+  else {
+    *retval = pid;
+  }
 
-  // for (int i = 0; i < argc; i++){
-  //   kprintf("I copied arg: %s\n", kargv[i]);
-  // }
+ fail_sem:
+  sem_destroy(sa.sa_done);
+ fail_open:
+  vfs_close(sa.sa_vnode);
+ fail_args:
+  argbuf_cleanup(&sa.sa_args);
+ fail_path:
+  kfree(kpath);
+  return result;
+}
+
+/*
+ * The arguments are collected into an argbuf before the old address
+ * space is given up, and copied out onto the new stack in one go; see
+ * argbuf.h.
+ */
+int
+sys_execv(userptr_t progname, userptr_t args)
+{
+  struct addrspace *as, *old_as;
+  struct vnode *v;
+  struct argbuf ab;
+  vaddr_t entrypoint, stackptr;
+  userptr_t uargv;
+  char *kprogname;
+  int argc, result;
+
+  if (progname == NULL || args == NULL) return EFAULT;
 
   /* Copy program path to kernel */
-  char * kprogname = kmalloc((strlen(progname)+1) * sizeof(char));
-  if (kprogname == NULL){
-    for(int i = 0; i < argc; i++) kfree(kargv[i]);
-    kfree(kargv);
-    return ENOMEM;
-  }
-  int err = copyinstr((const_userptr_t) progname, kprogname, strlen(progname)+1, NULL);
-  if (err) {
-    for(int i = 0; i < argc; i++) kfree(kargv[i]);
-    kfree(kargv);
+  kprogname = kmalloc(PATH_MAX);
+  if (kprogname == NULL) return ENOMEM;
+  result = copyinstr(progname, kprogname, PATH_MAX, NULL);
+  if (result) {
     kfree(kprogname);
-    return err;
+    return result;
   }
-  // kprintf("I copied progname to kernel: %s\n", kprogname);
 
-  // Copied from runprogram
-	/* Open the file. */
-	result = vfs_open(kprogname, O_RDONLY, 0, &v);
-	if (result) {
-    for(int i = 0; i < argc; i++) kfree(kargv[i]);
-    kfree(kargv);
+  /* Copy arguments to kernel */
+  result = argbuf_init(&ab);
+  if (result) {
     kfree(kprogname);
-		return result;
-	}
+    return result;
+  }
+  result = argbuf_copyin(&ab, args);
+  if (result) goto fail_args;
 
-	/* We should NOT be a new process. */
-	// KASSERT(curproc_getas() == NULL);
+  /* Open the file. */
+  result = vfs_open(kprogname, O_RDONLY, 0, &v);
+  if (result) goto fail_args;
 
-  // Swap a new addrspace
-  struct addrspace * old_as = curproc_getas();
+  /*
+   * End our other threads before they see the address space change.
+   * There's no bringing them back, so if the rest fails we return to
+   * a process with just us in it.
+   */
+  uthread_killothers();
+  if (curproc->p_uthreads != NULL) {
+    uthreads_destroy(curproc->p_uthreads);
+    curproc->p_uthreads = NULL;
+  }
+
+  /* Swap in a new address space, keeping the old one in case we fail */
   as = as_create();
-  if (as == NULL){
-    for(int i = 0; i < argc; i++) kfree(kargv[i]);
-    kfree(kargv);
-    kfree(kprogname);
-		vfs_close(v);
-		return ENOMEM;
+  if (as == NULL) {
+    vfs_close(v);
+    result = ENOMEM;
+    goto fail_args;
   }
-  curproc_setas(as);
+  old_as = curproc_setas(as);
   as_activate();
 
-	/* Create a new address space. */
-	as = as_create();
-	if (as == NULL) {
-    for(int i = 0; i < argc; i++) kfree(kargv[i]);
-    kfree(kargv);
-    kfree(kprogname);
-		vfs_close(v);
-		return ENOMEM;
-	}
-
-	/* Switch to it and activate it. */
-	curproc_setas(as);
-	as_activate();
-
-	/* Load the executable. */
-	result = load_elf(v, &entrypoint);
-	if (result) {
-    for(int i = 0; i < argc; i++) kfree(kargv[i]);
-    kfree(kargv);
-    kfree(kprogname);
-		/* p_addrspace will go away when curproc is destroyed */
-		vfs_close(v);
-    curproc_setas(old_as);
-    as_destroy(as);
-		return result;
-	}
+  /* Load the executable. */
+  result = load_elf(v, &entrypoint);
+  vfs_close(v);
+  if (result) goto fail_as;
 
-	/* Done with the file now. */
-	vfs_close(v);
+  /* Define the user stack in the address space */
+  result = as_define_stack(as, &stackptr);
+  if (result) goto fail_as;
 
-	/* Define the user stack in the address space */
-	result = as_define_stack(as, &stackptr);
-	if (result) {
-    for(int i = 0; i < argc; i++) kfree(kargv[i]);
-    kfree(kargv);
-    kfree(kprogname);
-		/* p_addrspace will go away when curproc is destroyed */
-    curproc_setas(old_as);
-    as_destroy(as);
-		return result;
-	}
+  result = argbuf_copyout(&ab, &stackptr, &uargv);
+  if (result) goto fail_as;
 
-  result = copyoutargs(argc, kargv, &stackptr);
-  if (result) {
-    for(int i = 0; i < argc; i++) kfree(kargv[i]);
-    kfree(kargv);
-    kfree(kprogname);
-    curproc_setas(old_as);
-    as_destroy(as);
-    return result;
+  argc = ab.ab_argc;
+  argbuf_cleanup(&ab);
+  kfree(kprogname);
+  if (curproc->p_vforkdone != NULL) {
+    /* it was our parent's */
+    vfork_release(curproc);
+  }
+  else {
+    as_destroy(old_as);
   }
 
-  for(int i = 0; i < argc; i++) kfree(kargv[i]);
-  kfree(kargv);
+  /* Warp to user mode. */
+  enter_new_process(argc, uargv, stackptr, entrypoint);
+
+  /* enter_new_process does not return. */
+  panic("enter_new_process returned\n");
+  return EINVAL;
+
+ fail_as:
+  curproc_setas(old_as);
+  as_activate();
+  as_destroy(as);
+ fail_args:
+  argbuf_cleanup(&ab);
   kfree(kprogname);
-  as_destroy(old_as);
-
-	/* Warp to user mode. */
-	enter_new_process(argc, (userptr_t) stackptr, stackptr, entrypoint);
-	
-	/* enter_new_process does not return. */
-	panic("enter_new_process returned\n");
-	return EINVAL;
+  return result;
 }
 
 #endif // OPT_A2
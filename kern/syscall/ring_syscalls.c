@@ -0,0 +1,148 @@
+/*
+ * System call submission ring. See <kern/ring.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/ring.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vm.h>
+#include <addrspace.h>
+#include <current.h>
+#include <proc.h>
+#include <syscall.h>
+
+int
+sys_ring_setup(int32_t *retval)
+{
+	struct addrspace *as;
+	vaddr_t page;
+
+	COMPILE_ASSERT(sizeof(struct ring) <= PAGE_SIZE);
+	COMPILE_ASSERT((RING_ENTRIES & (RING_ENTRIES - 1)) == 0);
+
+	as = curproc_getas();
+	KASSERT(as != NULL);
+
+	/*
+	 * Calling it again just hands back the same ring. Threads
+	 * racing to make the first one each allocate a page, but only
+	 * one gets installed; the others are given back.
+	 */
+	if (as->as_ring == 0) {
+		page = alloc_kpages(1);
+		if (page == 0) {
+			return ENOMEM;
+		}
+		bzero((void *)page, PAGE_SIZE);
+
+		spinlock_acquire(&as->as_ringlock);
+		if (as->as_ring == 0) {
+			as->as_ring = page;
+			page = 0;
+		}
+		spinlock_release(&as->as_ringlock);
+		if (page != 0) {
+			free_kpages(page);
+		}
+	}
+	*retval = RING_VADDR;
+	return 0;
+}
+
+/*
+ * Run one entry. SQE is our own copy, so the process can't change it
+ * under us.
+ */
+static
+int32_t
+ring_do(const struct ring_sqe *sqe)
+{
+	int32_t ret;
+	int err;
+
+	ret = 0;
+	switch (sqe->sqe_op) {
+	    case RING_OP_NOP:
+		err = 0;
+		break;
+	    case RING_OP_READ:
+		err = sys_read(sqe->sqe_fd, sqe->sqe_buf, sqe->sqe_len, &ret);
+		break;
+	    case RING_OP_WRITE:
+		err = sys_write(sqe->sqe_fd, sqe->sqe_buf, sqe->sqe_len, &ret);
+		break;
+	    case RING_OP_GETPID:
+		err = sys_getpid(&ret);
+		break;
+	    case RING_OP_WAITPID:
+		err = sys_waitpid(sqe->sqe_fd, sqe->sqe_buf, sqe->sqe_len,
+				  &ret);
+		break;
+	    default:
+		err = EINVAL;
+		break;
+	}
+	return err ? -err : ret;
+}
+
+/*
+ * The ring is ordinary memory the process can scribble on at any
+ * time, so every index is read once and reduced before use, and each
+ * entry is copied before it's looked at.
+ *
+ * Only one thread drains the ring at a time; the indexes are kept in
+ * locals while we run, so a second thread would hand out the same
+ * entries again. It gets EBUSY instead.
+ */
+int
+sys_ring_enter(unsigned to_submit, int32_t *retval)
+{
+	struct addrspace *as;
+	struct ring *r;
+	struct ring_sqe sqe;
+	struct ring_cqe *cqe;
+	uint32_t sqhead, sqtail, cqtail;
+	unsigned done;
+
+	as = curproc_getas();
+	KASSERT(as != NULL);
+
+	spinlock_acquire(&as->as_ringlock);
+	if (as->as_ring == 0) {
+		spinlock_release(&as->as_ringlock);
+		return EINVAL;
+	}
+	if (as->as_ringbusy) {
+		spinlock_release(&as->as_ringlock);
+		return EBUSY;
+	}
+	as->as_ringbusy = true;
+	spinlock_release(&as->as_ringlock);
+	r = (struct ring *)as->as_ring;
+
+	sqhead = r->r_sqhead;
+	sqtail = r->r_sqtail;
+	cqtail = r->r_cqtail;
+	for (done = 0; done < to_submit && sqhead != sqtail; done++) {
+		if (cqtail - r->r_cqhead >= RING_ENTRIES) {
+			/* no room for the completion */
+			break;
+		}
+		sqe = r->r_sq[sqhead % RING_ENTRIES];
+		r->r_sqhead = ++sqhead;
+
+		cqe = &r->r_cq[cqtail % RING_ENTRIES];
+		cqe->cqe_res = ring_do(&sqe);
+		cqe->cqe_data = sqe.sqe_data;
+		r->r_cqtail = ++cqtail;
+	}
+
+	spinlock_acquire(&as->as_ringlock);
+	as->as_ringbusy = false;
+	spinlock_release(&as->as_ringlock);
+
+	*retval = done;
+	return 0;
+}
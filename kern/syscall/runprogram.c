@@ -46,6 +46,10 @@
 #include <test.h>
 #include "opt-A2.h"
 #include <copyinout.h>
+#if OPT_A2
+#include <filetable.h>
+#include <argbuf.h>
+#endif
 
 /*
  * Load program "progname" and start running it in usermode.
@@ -64,6 +68,24 @@ runprogram(char *progname)
 	struct vnode *v;
 	vaddr_t entrypoint, stackptr;
 	int result;
+#if OPT_A2
+	struct argbuf ab;
+	userptr_t uargv;
+#endif
+
+#if OPT_A2
+	/* Give the new process stdin, stdout and stderr on the console. */
+	if (curproc->p_filetable == NULL) {
+		curproc->p_filetable = filetable_create();
+		if (curproc->p_filetable == NULL) {
+			return ENOMEM;
+		}
+		result = filetable_openstd(curproc->p_filetable);
+		if (result) {
+			return result;
+		}
+	}
+#endif
 
 	/* Open the file. */
 	result = vfs_open(progname, O_RDONLY, 0, &v);
@@ -105,10 +127,23 @@ runprogram(char *progname)
 	}
 
 #if OPT_A2
-	// Copy Args
-	result = copyoutargs(argc, argv, &stackptr);
+	/* Put the arguments on the stack. */
+	result = argbuf_init(&ab);
+	if (result) {
+		return result;
+	}
+	result = argbuf_fromkernel(&ab, argc, argv);
+	if (result == 0) {
+		result = argbuf_copyout(&ab, &stackptr, &uargv);
+	}
+	argbuf_cleanup(&ab);
+	if (result) {
+		/* p_addrspace will go away when curproc is destroyed */
+		return result;
+	}
+
 	/* Warp to user mode. */
-	enter_new_process(argc /*argc*/, (userptr_t) stackptr /*userspace addr of argv*/,
+	enter_new_process(argc /*argc*/, uargv /*userspace addr of argv*/,
 			  stackptr, entrypoint);
 #else
 	/* Warp to user mode. */
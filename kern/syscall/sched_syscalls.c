@@ -0,0 +1,119 @@
+/*
+ * Scheduling-related system calls: cpu affinity.
+ *
+ * A process's affinity is that of its threads; setting it sets all of
+ * them, getting it reports the first one's. A pid of 0 means the
+ * calling process. Besides itself, a process may only change its own
+ * children.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <array.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include "opt-A2.h"
+#if OPT_A2
+#include <pid.h>
+#endif
+
+/*
+ * Find the process PID refers to. With OPT_A2 this holds our plock,
+ * which keeps a child from being waited for and reaped while we use
+ * it; sched_putproc lets go. (Not needed for curproc, but it's
+ * simpler to always take it.)
+ */
+static
+struct proc *
+sched_findproc(pid_t pid)
+{
+#if OPT_A2
+	struct proc *p;
+
+	lock_acquire(curproc->plock);
+	if (pid == 0 || pid == curproc->PID) {
+		return curproc;
+	}
+	p = pid_lookupchild(pid, curproc);
+	if (p == NULL) {
+		lock_release(curproc->plock);
+	}
+	return p;
+#else
+	return pid == 0 ? curproc : NULL;
+#endif
+}
+
+static
+void
+sched_putproc(void)
+{
+#if OPT_A2
+	lock_release(curproc->plock);
+#endif
+}
+
+int
+sys_sched_setaffinity(pid_t pid, uint32_t mask)
+{
+	struct proc *p;
+	struct thread *t;
+	unsigned i;
+	int result;
+
+	p = sched_findproc(pid);
+	if (p == NULL) {
+		return ESRCH;
+	}
+
+	/*
+	 * Other threads just get the new mask. Do the caller last and
+	 * outside the lock, since it may have to move to another cpu.
+	 */
+	result = 0;
+	spinlock_acquire(&p->p_lock);
+	for (i=0; i<threadarray_num(&p->p_threads) && result == 0; i++) {
+		t = threadarray_get(&p->p_threads, i);
+		if (t != curthread) {
+			result = thread_setaffinity(t, mask);
+		}
+	}
+	spinlock_release(&p->p_lock);
+	sched_putproc();
+
+	if (result == 0 && p == curproc) {
+		result = thread_setaffinity(curthread, mask);
+	}
+	return result;
+}
+
+int
+sys_sched_getaffinity(pid_t pid, userptr_t user_mask)
+{
+	struct proc *p;
+	uint32_t mask;
+
+	p = sched_findproc(pid);
+	if (p == NULL) {
+		return ESRCH;
+	}
+
+	spinlock_acquire(&p->p_lock);
+	if (threadarray_num(&p->p_threads) == 0) {
+		/* Exited, not yet waited for */
+		spinlock_release(&p->p_lock);
+		sched_putproc();
+		return ESRCH;
+	}
+	mask = threadarray_get(&p->p_threads, 0)->t_affinity;
+	spinlock_release(&p->p_lock);
+	sched_putproc();
+
+	return copyout(&mask, user_mask, sizeof(mask));
+}
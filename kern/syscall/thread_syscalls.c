@@ -0,0 +1,394 @@
+/*
+ * User thread system calls. See uthread.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <mips/trapframe.h>
+#include <current.h>
+#include <proc.h>
+#include <thread.h>
+#include <synch.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <uthread.h>
+
+/*
+ * Make the thread table for the current process, whose only thread
+ * is us, running with stack pointer SP.
+ */
+static
+struct uthreads *
+uthreads_create(struct addrspace *as, vaddr_t sp)
+{
+	struct uthreads *ut;
+	unsigned i;
+
+	ut = kmalloc(sizeof(*ut));
+	if (ut == NULL) {
+		return NULL;
+	}
+	ut->ut_lock = lock_create("uthreads");
+	if (ut->ut_lock == NULL) {
+		kfree(ut);
+		return NULL;
+	}
+	ut->ut_cv = cv_create("uthreads");
+	if (ut->ut_cv == NULL) {
+		lock_destroy(ut->ut_lock);
+		kfree(ut);
+		return NULL;
+	}
+	ut->ut_killer = NULL;
+	ut->ut_live = 1;
+	ut->ut_attached = 1;
+	for (i=0; i<UTHREAD_MAX; i++) {
+		ut->ut_slots[i].ut_used = false;
+		ut->ut_slots[i].ut_exited = false;
+		ut->ut_slots[i].ut_thread = NULL;
+		ut->ut_slots[i].ut_tstack = -1;
+		ut->ut_slots[i].ut_retval = NULL;
+	}
+
+	/*
+	 * We're thread 0. We're usually on the main stack, but after
+	 * a fork from another thread we're on that thread's stack.
+	 */
+	ut->ut_slots[0].ut_used = true;
+	ut->ut_slots[0].ut_thread = curthread;
+	ut->ut_slots[0].ut_tstack = as_tstack_of(as, sp);
+	return ut;
+}
+
+void
+uthreads_destroy(struct uthreads *ut)
+{
+	cv_destroy(ut->ut_cv);
+	lock_destroy(ut->ut_lock);
+	kfree(ut);
+}
+
+/* Find the current thread's slot. Call with ut_lock held. */
+static
+unsigned
+uthread_self(struct uthreads *ut)
+{
+	unsigned i;
+
+	for (i=0; i<UTHREAD_MAX; i++) {
+		if (ut->ut_slots[i].ut_thread == curthread) {
+			return i;
+		}
+	}
+	panic("uthread_self: thread %p not in its table\n", curthread);
+}
+
+/*
+ * Find an extra stack that no running thread is on, or return -1.
+ * Call with ut_lock held.
+ */
+static
+int
+uthread_pickstack(struct uthreads *ut)
+{
+	unsigned i;
+	int n;
+
+	for (n=0; n<AS_TSTACKS; n++) {
+		for (i=0; i<UTHREAD_MAX; i++) {
+			if (ut->ut_slots[i].ut_used &&
+			    !ut->ut_slots[i].ut_exited &&
+			    ut->ut_slots[i].ut_tstack == n) {
+				break;
+			}
+		}
+		if (i == UTHREAD_MAX) {
+			return n;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Take the current thread out of its process and exit. It has
+ * already given up its slot, or the process is being ended.
+ *
+ * Once ut_attached drops, a killer may free the process and the
+ * table, so touch neither after that.
+ */
+static
+void
+uthread_leave(struct uthreads *ut)
+{
+	proc_remthread(curthread);
+
+	lock_acquire(ut->ut_lock);
+	KASSERT(ut->ut_attached > 1);
+	ut->ut_attached--;
+	cv_broadcast(ut->ut_cv, ut->ut_lock);
+	lock_release(ut->ut_lock);
+
+	thread_exit();
+}
+
+bool
+uthread_killed(void)
+{
+	struct proc *p = curproc;
+	struct thread *killer;
+
+	if (p == NULL || p->p_uthreads == NULL) {
+		return false;
+	}
+	/* No lock: if we miss it now, we'll see it on the next trap. */
+	killer = p->p_uthreads->ut_killer;
+	return killer != NULL && killer != curthread;
+}
+
+void
+uthread_die(void)
+{
+	uthread_leave(curproc->p_uthreads);
+}
+
+void
+uthread_killothers(void)
+{
+	struct uthreads *ut = curproc->p_uthreads;
+	struct thread *t;
+	unsigned i;
+
+	if (ut == NULL) {
+		return;
+	}
+
+	lock_acquire(ut->ut_lock);
+	if (ut->ut_killer != NULL && ut->ut_killer != curthread) {
+		/* Someone else is ending the process; let them. */
+		lock_release(ut->ut_lock);
+		uthread_die();
+	}
+	ut->ut_killer = curthread;
+
+	/*
+	 * Wake anyone in a killable sleep, and get anyone in
+	 * thread_join moving. No thread has left through uthread_die
+	 * yet, since we're the first killer, and one that leaves
+	 * through thread_exit clears its slot under the lock first;
+	 * so every thread we find here is still around.
+	 */
+	for (i=0; i<UTHREAD_MAX; i++) {
+		t = ut->ut_slots[i].ut_thread;
+		if (t != NULL && t != curthread) {
+			thread_kill(t);
+		}
+	}
+	cv_broadcast(ut->ut_cv, ut->ut_lock);
+	while (ut->ut_attached > 1) {
+		cv_wait(ut->ut_cv, ut->ut_lock);
+	}
+	lock_release(ut->ut_lock);
+}
+
+/*
+ * New thread: claim our slot, and go to user mode.
+ */
+static
+void
+uthread_enter(void *tf, unsigned long slot)
+{
+	struct uthreads *ut = curproc->p_uthreads;
+
+	lock_acquire(ut->ut_lock);
+	KASSERT(ut->ut_slots[slot].ut_used);
+	ut->ut_slots[slot].ut_thread = curthread;
+	if (ut->ut_killer != NULL) {
+		/* Too late to have been found; don't start at all. */
+		lock_release(ut->ut_lock);
+		kfree(tf);
+		uthread_die();
+	}
+	lock_release(ut->ut_lock);
+
+	enter_new_thread(tf);
+}
+
+/*
+ * thread_create: start a thread at ENTRY in user mode, with FUNC and
+ * ARG as its first two arguments, on a stack of its own. libc's ENTRY
+ * calls FUNC(ARG) and passes what it returns to thread_exit.
+ */
+int
+sys_thread_create(struct trapframe *tf, userptr_t entry, userptr_t func,
+		  userptr_t arg, int *retval)
+{
+	struct proc *p = curproc;
+	struct addrspace *as;
+	struct uthreads *ut;
+	struct uthread *s;
+	struct trapframe *ntf;
+	vaddr_t stackptr;
+	int slot, tstack, result;
+
+	as = curproc_getas();
+	KASSERT(as != NULL);
+
+	if (p->p_uthreads == NULL) {
+		/* We're the only thread, so nobody else can be here. */
+		p->p_uthreads = uthreads_create(as, tf->tf_sp);
+		if (p->p_uthreads == NULL) {
+			return ENOMEM;
+		}
+	}
+	ut = p->p_uthreads;
+
+	ntf = kmalloc(sizeof(*ntf));
+	if (ntf == NULL) {
+		return ENOMEM;
+	}
+
+	lock_acquire(ut->ut_lock);
+	if (ut->ut_killer != NULL) {
+		lock_release(ut->ut_lock);
+		kfree(ntf);
+		uthread_die();
+	}
+
+	for (slot=0; slot<UTHREAD_MAX; slot++) {
+		if (!ut->ut_slots[slot].ut_used) {
+			break;
+		}
+	}
+	tstack = uthread_pickstack(ut);
+	if (slot == UTHREAD_MAX || tstack < 0) {
+		result = EAGAIN;
+		goto fail;
+	}
+	result = as_define_tstack(as, tstack, &stackptr);
+	if (result) {
+		goto fail;
+	}
+
+	/* Start from our own registers, which gets gp and the status. */
+	*ntf = *tf;
+	ntf->tf_epc = (vaddr_t)entry;
+	ntf->tf_a0 = (vaddr_t)func;
+	ntf->tf_a1 = (vaddr_t)arg;
+	ntf->tf_ra = 0;
+	/* ENTRY is an ordinary function; leave it room to spill a0-a3. */
+	ntf->tf_sp = stackptr - 16;
+
+	s = &ut->ut_slots[slot];
+	s->ut_used = true;
+	s->ut_exited = false;
+	s->ut_thread = NULL;
+	s->ut_tstack = tstack;
+	s->ut_retval = NULL;
+	ut->ut_live++;
+	ut->ut_attached++;
+
+	/* It waits in uthread_enter for us to let go of the lock. */
+	result = thread_fork("uthread", p, uthread_enter, ntf, slot);
+	if (result) {
+		s->ut_used = false;
+		s->ut_tstack = -1;
+		ut->ut_live--;
+		ut->ut_attached--;
+		goto fail;
+	}
+	lock_release(ut->ut_lock);
+
+	*retval = slot;
+	return 0;
+
+ fail:
+	lock_release(ut->ut_lock);
+	kfree(ntf);
+	return result;
+}
+
+/*
+ * thread_join: wait for thread TID to exit, collect what it passed
+ * to thread_exit, and free its slot.
+ */
+int
+sys_thread_join(int tid, userptr_t retvalp)
+{
+	struct uthreads *ut = curproc->p_uthreads;
+	struct uthread *s;
+	userptr_t rv;
+
+	if (ut == NULL || tid < 0 || tid >= UTHREAD_MAX) {
+		return ESRCH;
+	}
+
+	lock_acquire(ut->ut_lock);
+	s = &ut->ut_slots[tid];
+	if (s->ut_used && s->ut_thread == curthread) {
+		lock_release(ut->ut_lock);
+		return EINVAL;
+	}
+	while (s->ut_used && !s->ut_exited && ut->ut_killer == NULL) {
+		cv_wait(ut->ut_cv, ut->ut_lock);
+	}
+	if (ut->ut_killer != NULL) {
+		lock_release(ut->ut_lock);
+		uthread_die();
+	}
+	if (!s->ut_used) {
+		/* Never created, or someone else joined it first */
+		lock_release(ut->ut_lock);
+		return ESRCH;
+	}
+	rv = s->ut_retval;
+	s->ut_used = false;
+	s->ut_exited = false;
+	s->ut_tstack = -1;
+	s->ut_retval = NULL;
+	/* Anyone else waiting for it will find it gone. */
+	cv_broadcast(ut->ut_cv, ut->ut_lock);
+	lock_release(ut->ut_lock);
+
+	if (retvalp == NULL) {
+		return 0;
+	}
+	return copyout(&rv, retvalp, sizeof(rv));
+}
+
+/*
+ * thread_exit: end the calling thread, leaving RETVAL for
+ * thread_join. The last thread to go ends the process, as if by
+ * _exit(0).
+ */
+void
+sys_thread_exit(userptr_t retval)
+{
+	struct uthreads *ut = curproc->p_uthreads;
+	struct uthread *s;
+
+	if (ut == NULL) {
+		/* We're the only thread there's ever been. */
+		sys__exit(0);
+	}
+
+	lock_acquire(ut->ut_lock);
+	if (ut->ut_killer != NULL) {
+		lock_release(ut->ut_lock);
+		uthread_die();
+	}
+	if (ut->ut_live == 1) {
+		lock_release(ut->ut_lock);
+		sys__exit(0);
+	}
+	s = &ut->ut_slots[uthread_self(ut)];
+	s->ut_exited = true;
+	s->ut_thread = NULL;
+	s->ut_retval = retval;
+	ut->ut_live--;
+	cv_broadcast(ut->ut_cv, ut->ut_lock);
+	lock_release(ut->ut_lock);
+
+	uthread_leave(ut);
+}
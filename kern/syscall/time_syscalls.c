@@ -28,6 +28,8 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
 #include <clock.h>
 #include <copyinout.h>
 #include <syscall.h>
@@ -44,15 +46,51 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	gettime(&seconds, &nanoseconds);
 
-	result = copyout(&seconds, user_seconds_ptr, sizeof(time_t));
+	user_access_begin(fail);
+	result = user_copyout(&seconds, user_seconds_ptr, sizeof(time_t));
+	if (result == 0) {
+		result = user_copyout(&nanoseconds, user_nanoseconds_ptr,
+				      sizeof(uint32_t));
+	}
+	user_access_end();
+	return result;
+
+ fail:
+	return EFAULT;
+}
+
+/*
+ * Sleep for the time given in *USER_REQ. There are no signals, so the
+ * sleep is only cut short when another thread is ending the process,
+ * and then nobody is left to see the result. The remaining time, if
+ * asked for, is always zero.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec ts;
+	int result;
+
+	result = copyin(user_req, &ts, sizeof(ts));
 	if (result) {
 		return result;
 	}
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
 
-	result = copyout(&nanoseconds, user_nanoseconds_ptr, sizeof(uint32_t));
+	result = clocknap_ns_killable(ts.tv_sec, ts.tv_nsec);
 	if (result) {
 		return result;
 	}
 
+	if (user_rem != NULL) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 0;
+		result = copyout(&ts, user_rem, sizeof(ts));
+		if (result) {
+			return result;
+		}
+	}
 	return 0;
 }
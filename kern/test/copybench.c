@@ -0,0 +1,208 @@
+/*
+ * copyin/copyout benchmark.
+ *
+ * Times copies between the kernel and a scratch user address space at
+ * 4, 64 and 4096 bytes, both with copyin and copyout, which set up
+ * fault recovery on every call, and with user_copyin and
+ * user_copyout inside one user access window. Also times copyinstr
+ * of a 64-byte string, and checks the data on the way.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <test.h>
+
+#define CB_TEXT    0x00400000	/* Where the scratch regions go */
+#define CB_DATA    0x10000000
+#define CB_BUFSIZE 4096
+#define CB_ITERS   1000
+
+/* Words, so both buffers are aligned alike. */
+static uint32_t cb_src[CB_BUFSIZE / sizeof(uint32_t)];
+static uint32_t cb_dst[CB_BUFSIZE / sizeof(uint32_t)];
+
+static const size_t cb_sizes[] = { 4, 64, 4096 };
+
+/* Panic unless the first LEN bytes of cb_dst match cb_src. */
+static
+void
+cb_check(size_t len)
+{
+	const char *a = (const char *)cb_src, *b = (const char *)cb_dst;
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (a[i] != b[i]) {
+			panic("copybench: %u bytes came back wrong at %u\n",
+			      (unsigned)len, (unsigned)i);
+		}
+	}
+}
+
+/*
+ * Make an address space with a writable page at CB_DATA. dumbvm
+ * wants two regions and a stack, so those come along too.
+ */
+static
+struct addrspace *
+cb_mkas(void)
+{
+	struct addrspace *as;
+	vaddr_t stackptr;
+
+	as = as_create();
+	if (as == NULL) {
+		return NULL;
+	}
+	if (as_define_region(as, CB_TEXT, PAGE_SIZE, 1, 0, 1) ||
+	    as_define_region(as, CB_DATA, CB_BUFSIZE, 1, 1, 0) ||
+	    as_prepare_load(as) ||
+	    as_complete_load(as) ||
+	    as_define_stack(as, &stackptr)) {
+		as_destroy(as);
+		return NULL;
+	}
+	return as;
+}
+
+/* Time copyin or copyout of LEN bytes, one window per copy. */
+static
+uint32_t
+cb_single(bool in, size_t len)
+{
+	userptr_t ubuf = (userptr_t)CB_DATA;
+	uint64_t start;
+	int i, result;
+
+	start = gettime_ns();
+	for (i=0; i<CB_ITERS; i++) {
+		result = in ? copyin(ubuf, cb_dst, len) :
+			copyout(cb_src, ubuf, len);
+		if (result) {
+			panic("copybench: %s: %s\n", in ? "copyin" : "copyout",
+			      strerror(result));
+		}
+	}
+	return (gettime_ns() - start) / CB_ITERS;
+}
+
+/* The same, but with every copy in one window. */
+static
+uint32_t
+cb_window(bool in, size_t len)
+{
+	userptr_t ubuf = (userptr_t)CB_DATA;
+	uint64_t start;
+	int i, result;
+
+	result = 0;
+	start = gettime_ns();
+	user_access_begin(fault);
+	for (i=0; i<CB_ITERS; i++) {
+		result = in ? user_copyin(ubuf, cb_dst, len) :
+			user_copyout(cb_src, ubuf, len);
+		if (result) {
+			break;
+		}
+	}
+	user_access_end();
+	if (result) {
+		panic("copybench: window: %s\n", strerror(result));
+	}
+	return (gettime_ns() - start) / CB_ITERS;
+
+ fault:
+	panic("copybench: fault in the user access window\n");
+	return 0;
+}
+
+static
+uint32_t
+cb_string(void)
+{
+	char *s = (char *)cb_src;
+	uint64_t start;
+	size_t got;
+	int i, result;
+
+	for (i=0; i<63; i++) {
+		s[i] = 'x';
+	}
+	s[63] = 0;
+	result = copyout(s, (userptr_t)CB_DATA, 64);
+	if (result) {
+		panic("copybench: copyout: %s\n", strerror(result));
+	}
+
+	start = gettime_ns();
+	for (i=0; i<CB_ITERS; i++) {
+		result = copyinstr((userptr_t)CB_DATA, (char *)cb_dst,
+				   CB_BUFSIZE, &got);
+		if (result || got != 64) {
+			panic("copybench: copyinstr: %s, got %u\n",
+			      strerror(result), (unsigned)got);
+		}
+	}
+	return (gettime_ns() - start) / CB_ITERS;
+}
+
+int
+copybench(int nargs, char **args)
+{
+	struct addrspace *as, *old;
+	uint32_t in, out, win_in, win_out;
+	unsigned i, j;
+	size_t len;
+
+	(void)nargs;
+	(void)args;
+
+	as = cb_mkas();
+	if (as == NULL) {
+		kprintf("copybench: Out of memory\n");
+		return ENOMEM;
+	}
+
+	/*
+	 * We're a kernel thread; lend our process the address space
+	 * while we run. Nothing else in it goes near user addresses.
+	 */
+	old = curproc_setas(as);
+	KASSERT(old == NULL);
+	as_activate();
+
+	for (j=0; j<CB_BUFSIZE / sizeof(uint32_t); j++) {
+		cb_src[j] = j * 0x9e3779b9;
+	}
+
+	kprintf("copybench: ns per copy, %u copies each\n", CB_ITERS);
+	kprintf("%8s %8s %8s %8s %8s\n", "bytes", "copyin", "copyout",
+		"win in", "win out");
+	for (i=0; i<sizeof(cb_sizes) / sizeof(cb_sizes[0]); i++) {
+		len = cb_sizes[i];
+
+		out = cb_single(false, len);
+		in = cb_single(true, len);
+		cb_check(len);
+		bzero(cb_dst, len);
+		win_out = cb_window(false, len);
+		win_in = cb_window(true, len);
+		cb_check(len);
+		kprintf("%8u %8u %8u %8u %8u\n", (unsigned)len, in, out, win_in,
+			win_out);
+	}
+	kprintf("copyinstr of 64 bytes: %u ns\n", cb_string());
+
+	as_deactivate();
+	curproc_setas(NULL);
+	as_destroy(as);
+
+	kprintf("copybench done\n");
+	return 0;
+}
@@ -0,0 +1,362 @@
+/*
+ * Reader-writer lock tests.
+ *
+ * rwt1 is a stress test: readers and writers hammer one rwlock and
+ * check that writers are always alone, readers never see a half-done
+ * write, and the try and downgrade operations behave.
+ *
+ * rwt2 compares throughput on a read-mostly workload protected by an
+ * rwlock against the same workload under a plain lock.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NREADERS      12
+#define NWRITERS      4
+#define NSTRESSLOOPS  200
+#define NDATA         16
+
+#define NTPUTTHREADS  8
+#define NTPUTLOOPS    1000
+#define TPUTWRITEFREQ 10	/* one op in this many is a write */
+#define TPUTWORK      50	/* delay loop inside the lock */
+
+static struct rwlock *testrw;
+static struct lock *testlk;
+static struct semaphore *donesem;
+
+static volatile unsigned long rwdata[NDATA];
+
+/* Who's inside, for checking exclusion; protected by checklock. */
+static struct spinlock checklock = SPINLOCK_INITIALIZER;
+static unsigned inreaders, inwriters;
+static unsigned errors;
+
+static
+void
+rwt_error(const char *msg)
+{
+	spinlock_acquire(&checklock);
+	errors++;
+	spinlock_release(&checklock);
+	kprintf("rwlocktest: %s\n", msg);
+}
+
+static
+void
+rwt_enter(bool writer)
+{
+	spinlock_acquire(&checklock);
+	if (inwriters > 0 || (writer && inreaders > 0)) {
+		errors++;
+		spinlock_release(&checklock);
+		kprintf("rwlocktest: %s got in with %u readers, %u writers\n",
+			writer ? "writer" : "reader", inreaders, inwriters);
+		spinlock_acquire(&checklock);
+	}
+	if (writer) {
+		inwriters++;
+	}
+	else {
+		inreaders++;
+	}
+	spinlock_release(&checklock);
+}
+
+static
+void
+rwt_leave(bool writer)
+{
+	spinlock_acquire(&checklock);
+	if (writer) {
+		inwriters--;
+	}
+	else {
+		inreaders--;
+	}
+	spinlock_release(&checklock);
+}
+
+/* Readers must see every entry equal. */
+static
+void
+rwt_check(void)
+{
+	unsigned i;
+
+	for (i=1; i<NDATA; i++) {
+		if (rwdata[i] != rwdata[0]) {
+			rwt_error("reader saw a partial write");
+			return;
+		}
+	}
+}
+
+static
+void
+rwt_write(unsigned long val)
+{
+	unsigned i;
+
+	for (i=0; i<NDATA; i++) {
+		rwdata[i] = val;
+		thread_yield();
+	}
+}
+
+static
+void
+rwt_reader(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NSTRESSLOOPS; i++) {
+		if (i % 4 == 0) {
+			if (!rwlock_tryacquire_read(testrw)) {
+				rwlock_acquire_read(testrw);
+			}
+		}
+		else {
+			rwlock_acquire_read(testrw);
+		}
+		rwt_enter(false);
+		rwt_check();
+		if ((i + num) % 8 == 0) {
+			thread_yield();
+			rwt_check();
+		}
+		rwt_leave(false);
+		rwlock_release_read(testrw);
+	}
+	V(donesem);
+	thread_exit();
+}
+
+static
+void
+rwt_writer(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NSTRESSLOOPS; i++) {
+		if (i % 4 == 0) {
+			if (!rwlock_tryacquire_write(testrw)) {
+				rwlock_acquire_write(testrw);
+			}
+		}
+		else {
+			rwlock_acquire_write(testrw);
+		}
+		if (!rwlock_do_i_hold_write(testrw)) {
+			rwt_error("writer doesn't hold the lock");
+		}
+		rwt_enter(true);
+		rwt_write(num * NSTRESSLOOPS + i);
+		rwt_leave(true);
+
+		if (i % 3 == 0) {
+			/* Nobody may write between us and our read. */
+			rwlock_downgrade(testrw);
+			rwt_enter(false);
+			if (rwdata[0] != num * NSTRESSLOOPS + i) {
+				rwt_error("write lost across downgrade");
+			}
+			rwt_check();
+			rwt_leave(false);
+			rwlock_release_read(testrw);
+		}
+		else {
+			rwlock_release_write(testrw);
+		}
+	}
+	V(donesem);
+	thread_exit();
+}
+
+static
+void
+rwt_setup(void)
+{
+	testrw = rwlock_create("rwlocktest");
+	testlk = lock_create("rwlocktest");
+	donesem = sem_create("rwlocktest", 0);
+	if (testrw == NULL || testlk == NULL || donesem == NULL) {
+		panic("rwlocktest: out of memory\n");
+	}
+}
+
+static
+void
+rwt_cleanup(void)
+{
+	rwlock_destroy(testrw);
+	lock_destroy(testlk);
+	sem_destroy(donesem);
+	testrw = NULL;
+	testlk = NULL;
+	donesem = NULL;
+}
+
+int
+rwlocktest(int nargs, char **args)
+{
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	rwt_setup();
+	errors = 0;
+	inreaders = inwriters = 0;
+	for (i=0; i<NDATA; i++) {
+		rwdata[i] = 0;
+	}
+
+	kprintf("Starting rwlock stress test: %d readers, %d writers...\n",
+		NREADERS, NWRITERS);
+
+	/* Quick single-threaded checks of the try operations. */
+	if (!rwlock_tryacquire_write(testrw)) {
+		rwt_error("free lock refused a writer");
+	}
+	else {
+		rwlock_release_write(testrw);
+	}
+	rwlock_acquire_read(testrw);
+	if (rwlock_tryacquire_write(testrw)) {
+		rwt_error("got a write hold while a reader was in");
+		rwlock_release_write(testrw);
+	}
+	if (!rwlock_tryacquire_read(testrw)) {
+		rwt_error("second reader was refused");
+	}
+	else {
+		rwlock_release_read(testrw);
+	}
+	rwlock_release_read(testrw);
+
+	for (i=0; i<NREADERS + NWRITERS; i++) {
+		result = thread_fork("rwlocktest", NULL,
+				     i < NREADERS ? rwt_reader : rwt_writer,
+				     NULL, i);
+		if (result) {
+			panic("rwlocktest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NREADERS + NWRITERS; i++) {
+		P(donesem);
+	}
+
+	rwt_cleanup();
+	kprintf("rwlock stress test done: %u errors\n", errors);
+	return 0;
+}
+
+static volatile bool tput_userw;
+
+static
+void
+rwt_tputthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+	bool write;
+
+	(void)junk;
+
+	for (i=0; i<NTPUTLOOPS; i++) {
+		write = ((i + num) % TPUTWRITEFREQ) == 0;
+		if (!tput_userw) {
+			lock_acquire(testlk);
+		}
+		else if (write) {
+			rwlock_acquire_write(testrw);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+		}
+
+		for (j=0; j<TPUTWORK; j++);
+		if (write) {
+			rwdata[0]++;
+		}
+
+		if (!tput_userw) {
+			lock_release(testlk);
+		}
+		else if (write) {
+			rwlock_release_write(testrw);
+		}
+		else {
+			rwlock_release_read(testrw);
+		}
+	}
+	V(donesem);
+	thread_exit();
+}
+
+static
+void
+rwt_tputrun(bool userw)
+{
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs;
+	unsigned i;
+	int result;
+
+	tput_userw = userw;
+	rwdata[0] = 0;
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<NTPUTTHREADS; i++) {
+		result = thread_fork("rwlocktput", NULL, rwt_tputthread,
+				     NULL, i);
+		if (result) {
+			panic("rwlocktest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTPUTTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+
+	if (rwdata[0] != NTPUTTHREADS * NTPUTLOOPS / TPUTWRITEFREQ) {
+		kprintf("rwlocktest: %lu writes, expected %d\n",
+			rwdata[0], NTPUTTHREADS * NTPUTLOOPS / TPUTWRITEFREQ);
+	}
+	kprintf("%s: %lu.%09lu seconds, %lu ops/sec\n",
+		userw ? "rwlock" : "lock  ",
+		(unsigned long) secs, (unsigned long) nsecs,
+		(NTPUTTHREADS * NTPUTLOOPS * 1000UL) /
+		((unsigned long) secs * 1000 + nsecs / 1000000 + 1));
+}
+
+int
+rwlocktput(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	rwt_setup();
+	kprintf("Starting rwlock throughput test: %d threads, "
+		"1 write in %d...\n", NTPUTTHREADS, TPUTWRITEFREQ);
+	rwt_tputrun(true);
+	rwt_tputrun(false);
+	rwt_cleanup();
+	kprintf("rwlock throughput test done.\n");
+	return 0;
+}
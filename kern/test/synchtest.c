@@ -32,6 +32,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
@@ -42,6 +43,12 @@
 #define NLOCKLOOPS    120
 #define NCVLOOPS      5
 #define NTHREADS      32
+#define NBENCHTHREADS 4
+#define NBENCHLOOPS   2000
+#define NBENCHINSIDE  20
+#define NBENCHOUTSIDE 100
+#define NHOTHREADS    6
+#define NHOLOOPS      200
 
 static volatile unsigned long testval1;
 static volatile unsigned long testval2;
@@ -256,6 +263,234 @@ locktest(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Lock microbenchmark: a few threads hammer one lock with a short
+ * critical section, first with adaptive spinning and then with
+ * waiters always sleeping.
+ */
+
+static struct lock *benchlock;
+static volatile unsigned long benchcount;
+
+static
+void
+lockbenchthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NBENCHLOOPS; i++) {
+		lock_acquire(benchlock);
+		benchcount++;
+		for (j=0; j<NBENCHINSIDE; j++);
+		lock_release(benchlock);
+		for (j=0; j<NBENCHOUTSIDE; j++);
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+static
+void
+lockbenchrun(bool adaptive)
+{
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs;
+	int i, result;
+
+	benchlock = lock_create("lockbench");
+	if (benchlock == NULL) {
+		panic("lockbench: lock_create failed\n");
+	}
+	benchlock->adaptive = adaptive;
+	benchcount = 0;
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<NBENCHTHREADS; i++) {
+		result = thread_fork("lockbench", NULL, lockbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("lockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NBENCHTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+
+	if (benchcount != NBENCHTHREADS * NBENCHLOOPS) {
+		kprintf("lockbench: count is %lu, should be %d\n",
+			benchcount, NBENCHTHREADS * NBENCHLOOPS);
+	}
+	kprintf("%s: %lu.%09lu seconds, %lu ns per acquire\n",
+		adaptive ? "adaptive" : "sleeping",
+		(unsigned long) secs, (unsigned long) nsecs,
+		((unsigned long) secs * 1000000000 + nsecs) /
+		(NBENCHTHREADS * NBENCHLOOPS));
+
+	lock_destroy(benchlock);
+	benchlock = NULL;
+}
+
+int
+lockbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting lock benchmark: %d threads, %d acquires each...\n",
+		NBENCHTHREADS, NBENCHLOOPS);
+	lockbenchrun(true);
+	lockbenchrun(false);
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Lock benchmark done.\n");
+
+	return 0;
+}
+
+/*
+ * Handoff benchmark: acquire latency percentiles for a contended lock
+ * and a contended binary semaphore, with and without handoff.
+ */
+
+static struct semaphore *benchsem;
+static uint32_t *benchlat;	/* ns, NHOTHREADS * NHOLOOPS of them */
+static volatile bool bench_usesem;
+
+static
+void
+handoffbenchthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+	uint64_t start;
+
+	(void)junk;
+
+	for (i=0; i<NHOLOOPS; i++) {
+		start = gettime_ns();
+		if (bench_usesem) {
+			P(benchsem);
+		}
+		else {
+			lock_acquire(benchlock);
+		}
+		benchlat[num * NHOLOOPS + i] = gettime_ns() - start;
+
+		for (j=0; j<NBENCHINSIDE; j++);
+		if (bench_usesem) {
+			V(benchsem);
+		}
+		else {
+			lock_release(benchlock);
+		}
+		for (j=0; j<NBENCHOUTSIDE; j++);
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+/* Shell sort; there's no qsort in the kernel. */
+static
+void
+sortlat(uint32_t *a, unsigned n)
+{
+	unsigned gap, i, j;
+	uint32_t t;
+
+	for (gap = n/2; gap > 0; gap /= 2) {
+		for (i=gap; i<n; i++) {
+			t = a[i];
+			for (j=i; j >= gap && a[j-gap] > t; j -= gap) {
+				a[j] = a[j-gap];
+			}
+			a[j] = t;
+		}
+	}
+}
+
+static
+void
+handoffbenchrun(bool usesem, bool handoff)
+{
+	unsigned n = NHOTHREADS * NHOLOOPS;
+	int i, result;
+
+	benchlock = lock_create("handoffbench");
+	benchsem = sem_create("handoffbench", 1);
+	if (benchlock == NULL || benchsem == NULL) {
+		panic("handoffbench: out of memory\n");
+	}
+	benchlock->handoff = handoff;
+	benchsem->sem_handoff = handoff;
+	bench_usesem = usesem;
+
+	for (i=0; i<NHOTHREADS; i++) {
+		result = thread_fork("handoffbench", NULL, handoffbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("handoffbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NHOTHREADS; i++) {
+		P(donesem);
+	}
+
+	sortlat(benchlat, n);
+	kprintf("%-9s %-8s p50 %8lu ns  p99 %8lu ns  max %8lu ns\n",
+		usesem ? "semaphore" : "lock",
+		handoff ? "handoff" : "barging",
+		(unsigned long) benchlat[n / 2],
+		(unsigned long) benchlat[n * 99 / 100],
+		(unsigned long) benchlat[n - 1]);
+
+	lock_destroy(benchlock);
+	sem_destroy(benchsem);
+	benchlock = NULL;
+	benchsem = NULL;
+}
+
+int
+handoffbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	benchlat = kmalloc(NHOTHREADS * NHOLOOPS * sizeof(benchlat[0]));
+	if (benchlat == NULL) {
+		panic("handoffbench: out of memory\n");
+	}
+
+	inititems();
+	kprintf("Starting handoff benchmark: %d threads, %d acquires each...\n",
+		NHOTHREADS, NHOLOOPS);
+	handoffbenchrun(false, false);
+	handoffbenchrun(false, true);
+	handoffbenchrun(true, false);
+	handoffbenchrun(true, true);
+#ifdef UW
+  cleanitems();
+#endif
+	kfree(benchlat);
+	benchlat = NULL;
+	kprintf("Handoff benchmark done.\n");
+
+	return 0;
+}
+
 static
 void
 cvtestthread(void *junk, unsigned long num)
@@ -347,3 +582,187 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Timed waits. Each timeout has to come back with ETIMEDOUT after
+ * about the right time, each wakeup that beats its timeout has to
+ * come back with 0, and a timeout must not wake anyone else waiting
+ * on the same object.
+ */
+
+#define NTWBYSTANDERS 4
+#define TWTICKS       (HZ / 10)
+
+static struct semaphore *twsem;
+static struct lock *twlock;
+static struct cv *twcv;
+static struct semaphore *twdonesem;
+static volatile unsigned twwoken;
+static unsigned twerrors;
+
+static
+void
+twfail(const char *msg)
+{
+	kprintf("timedwaittest: %s\n", msg);
+	twerrors++;
+}
+
+/* Waits on twsem with no timeout; shouldn't get out early. */
+static
+void
+twbystander(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	P(twsem);
+	twwoken++;
+	V(twdonesem);
+	thread_exit();
+}
+
+/* Naps a bit, then does whatever NUM says. */
+static
+void
+twhelper(void *junk, unsigned long num)
+{
+	(void)junk;
+
+	clocknap(1);
+	switch (num) {
+	    case 0:
+		V(twsem);
+		break;
+	    case 1:
+		lock_acquire(twlock);
+		cv_signal(twcv, twlock);
+		lock_release(twlock);
+		break;
+	    case 2:
+		lock_acquire(twlock);
+		V(twdonesem);
+		P(twsem);
+		lock_release(twlock);
+		break;
+	}
+	V(twdonesem);
+	thread_exit();
+}
+
+static
+void
+twfork(void (*func)(void *, unsigned long), unsigned long num)
+{
+	int result;
+
+	result = thread_fork("timedwaittest", NULL, func, NULL, num);
+	if (result) {
+		panic("timedwaittest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+}
+
+int
+timedwaittest(int nargs, char **args)
+{
+	uint64_t start;
+	unsigned ms, i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	twsem = sem_create("twsem", 0);
+	twlock = lock_create("twlock");
+	twcv = cv_create("twcv");
+	twdonesem = sem_create("twdonesem", 0);
+	if (twsem == NULL || twlock == NULL || twcv == NULL ||
+	    twdonesem == NULL) {
+		panic("timedwaittest: out of memory\n");
+	}
+	twerrors = 0;
+	twwoken = 0;
+
+	kprintf("Starting timed wait test...\n");
+
+	/* P_timed runs out while others wait on the same semaphore. */
+	for (i=0; i<NTWBYSTANDERS; i++) {
+		twfork(twbystander, i);
+	}
+	clocknap(1);
+	start = gettime_ns();
+	result = P_timed(twsem, TWTICKS);
+	ms = (gettime_ns() - start) / 1000000;
+	if (result != ETIMEDOUT) {
+		twfail("P_timed on an empty semaphore didn't time out");
+	}
+	/* The first hardclock can come right away, so allow one less */
+	if (ms < 1000 * (TWTICKS - 1) / HZ) {
+		twfail("P_timed timed out early");
+	}
+	kprintf("P_timed timed out after %u ms (asked for %u)\n",
+		ms, 1000 * TWTICKS / HZ);
+	if (twwoken != 0) {
+		twfail("timeout woke a bystander");
+	}
+	for (i=0; i<NTWBYSTANDERS; i++) {
+		V(twsem);
+	}
+	for (i=0; i<NTWBYSTANDERS; i++) {
+		P(twdonesem);
+	}
+	if (P_timed(twsem, 0) != ETIMEDOUT) {
+		twfail("P_timed with no time got a count from nowhere");
+	}
+
+	/* P_timed woken before its time. */
+	twfork(twhelper, 0);
+	if (P_timed(twsem, 10 * HZ) != 0) {
+		twfail("P_timed timed out though V was called");
+	}
+	P(twdonesem);
+
+	/* cv_timedwait, both ways. */
+	lock_acquire(twlock);
+	if (cv_timedwait(twcv, twlock, TWTICKS) != ETIMEDOUT) {
+		twfail("cv_timedwait with no signal didn't time out");
+	}
+	if (!lock_do_i_hold(twlock)) {
+		twfail("cv_timedwait came back without the lock");
+	}
+	twfork(twhelper, 1);
+	if (cv_timedwait(twcv, twlock, 10 * HZ) != 0) {
+		twfail("cv_timedwait timed out though signalled");
+	}
+	lock_release(twlock);
+	P(twdonesem);
+
+	/* lock_tryacquire, free and held. */
+	if (!lock_tryacquire(twlock)) {
+		twfail("lock_tryacquire failed on a free lock");
+	}
+	else {
+		lock_release(twlock);
+	}
+	twfork(twhelper, 2);
+	P(twdonesem);		/* helper now holds twlock */
+	if (lock_tryacquire(twlock)) {
+		twfail("lock_tryacquire got a held lock");
+		lock_release(twlock);
+	}
+	V(twsem);
+	P(twdonesem);
+
+	sem_destroy(twsem);
+	lock_destroy(twlock);
+	cv_destroy(twcv);
+	sem_destroy(twdonesem);
+	twsem = NULL;
+	twlock = NULL;
+	twcv = NULL;
+	twdonesem = NULL;
+
+	kprintf("Timed wait test %s\n", twerrors ? "FAILED" : "done");
+	return 0;
+}
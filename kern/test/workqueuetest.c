@@ -0,0 +1,191 @@
+/*
+ * Workqueue test.
+ *
+ * Checks that submitted work all runs, on the requested cpu and in
+ * submission order, then compares what reaping a process costs the
+ * reaper (waitpid or _exit) when it calls proc_destroy inline against
+ * proc_reap, which hands it to the workqueue.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <workqueue.h>
+#include <test.h>
+#include "opt-A2.h"
+#if OPT_A2
+#include <proc.h>
+#endif
+
+#define NWORK      200
+#define NREAPS     100
+#define MAXCPUS    32
+
+static struct semaphore *wq_donesem;
+static struct spinlock wq_testlock = SPINLOCK_INITIALIZER;
+static unsigned wq_lastseq[MAXCPUS];
+static unsigned wq_errors;
+
+static
+void
+wqtest_work(void *junk, unsigned long arg)
+{
+	unsigned cpunum, seq;
+
+	(void)junk;
+
+	cpunum = arg % MAXCPUS;
+	seq = arg / MAXCPUS;
+
+	spinlock_acquire(&wq_testlock);
+	if (curcpu->c_number != cpunum) {
+		kprintf("wqtest: work for cpu %u ran on cpu %u\n",
+			cpunum, curcpu->c_number);
+		wq_errors++;
+	}
+	if (seq != wq_lastseq[cpunum] + 1) {
+		kprintf("wqtest: cpu %u ran item %u after item %u\n",
+			cpunum, seq, wq_lastseq[cpunum]);
+		wq_errors++;
+	}
+	wq_lastseq[cpunum] = seq;
+	spinlock_release(&wq_testlock);
+
+	V(wq_donesem);
+}
+
+#if OPT_A2
+static
+void
+wqtest_marker(void *junk1, unsigned long junk2)
+{
+	(void)junk1;
+	(void)junk2;
+	V(wq_donesem);
+}
+
+/*
+ * Wait for everything queued so far to run. Each cpu's queue is run
+ * in order, so once a marker queued behind it all has run, so has
+ * the rest.
+ */
+static
+void
+wqtest_drain(unsigned numcpus)
+{
+	unsigned i;
+	int result;
+
+	for (i=0; i<numcpus; i++) {
+		result = workqueue_submit(i, wqtest_marker, NULL, 0);
+		if (result) {
+			panic("wqtest: workqueue_submit: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<numcpus; i++) {
+		P(wq_donesem);
+	}
+}
+
+/*
+ * Time reaping NREAPS processes with proc_destroy or, if DEFERRED,
+ * proc_reap, and return the reaper's cost per process. They have no
+ * threads or address space, so what's timed is the teardown that
+ * waitpid and _exit hand to proc_reap.
+ */
+static
+uint32_t
+wqtest_reap(bool deferred, unsigned numcpus)
+{
+	struct proc *procs[NREAPS];
+	uint64_t start;
+	uint32_t ns;
+	unsigned i;
+
+	for (i=0; i<NREAPS; i++) {
+		procs[i] = proc_create_runprogram("wqtest");
+		if (procs[i] == NULL) {
+			panic("wqtest: proc_create_runprogram failed\n");
+		}
+	}
+	start = gettime_ns();
+	for (i=0; i<NREAPS; i++) {
+		if (deferred) {
+			proc_reap(procs[i]);
+		}
+		else {
+			proc_destroy(procs[i]);
+		}
+	}
+	ns = gettime_ns() - start;
+	if (deferred) {
+		wqtest_drain(numcpus);
+	}
+#ifdef UW
+	/*
+	 * The menu only runs tests once every process has exited, so
+	 * destroying the last of ours signalled no_proc_sem as if a
+	 * program had finished. Take that back.
+	 */
+	P(no_proc_sem);
+#endif
+	return ns / NREAPS;
+}
+#endif
+
+int
+workqueuetest(int nargs, char **args)
+{
+	unsigned i, cpunum, numcpus, seq[MAXCPUS];
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	numcpus = cpu_count();
+	if (numcpus > MAXCPUS) {
+		numcpus = MAXCPUS;
+	}
+	wq_donesem = sem_create("wqtest", 0);
+	if (wq_donesem == NULL) {
+		panic("wqtest: sem_create failed\n");
+	}
+
+	kprintf("Starting workqueue test (%u cpus)...\n", numcpus);
+	wq_errors = 0;
+	for (i=0; i<MAXCPUS; i++) {
+		wq_lastseq[i] = 0;
+		seq[i] = 0;
+	}
+	for (i=0; i<NWORK; i++) {
+		cpunum = i % numcpus;
+		seq[cpunum]++;
+		result = workqueue_submit(cpunum, wqtest_work, NULL,
+					  seq[cpunum] * MAXCPUS + cpunum);
+		if (result) {
+			panic("wqtest: workqueue_submit: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NWORK; i++) {
+		P(wq_donesem);
+	}
+	kprintf("%u work items, %u errors\n", NWORK, wq_errors);
+
+#if OPT_A2
+	kprintf("Reaper cost per process: proc_destroy %u ns, ",
+		wqtest_reap(false, numcpus));
+	kprintf("proc_reap %u ns\n", wqtest_reap(true, numcpus));
+#endif
+
+	sem_destroy(wq_donesem);
+	wq_donesem = NULL;
+
+	kprintf("Workqueue test %s\n", wq_errors ? "FAILED" : "done");
+	return 0;
+}
@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <cpu.h>
 #include <wchan.h>
@@ -35,6 +36,9 @@
 #include <thread.h>
 #include <lamebus/ltimer.h>
 #include <current.h>
+#include <timeout.h>
+#include <vm.h>
+#include <kern/timepage.h>
 
 /*
  * Time handling.
@@ -52,26 +56,44 @@
  * the scheduler.
  */
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
+					/* (Also the top-level quantum.) */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Length of a hardclock, and hardclocks per timerclock tick, for
+ * converting sleep times.
  */
-static struct wchan *lbolt;
-/*
- * Once every LT_GRANULARITY usec, everything on minibolt is awakenened by CPU 0
- */
-static struct wchan *minibolt;
+#define NSEC_PER_HARDCLOCK	(1000000000 / HZ)
+#define HARDCLOCKS_PER_TICK	DIVROUNDUP(LT_GRANULARITY * 1000, \
+					   NSEC_PER_HARDCLOCK)
 
-/* 
- * number of minibolts per second
+/*
+ * The time page (see <kern/timepage.h>). Only timerclock() writes it,
+ * and that only ever runs on one cpu, so updates need no lock.
  */
-#define MINI_PER_SECOND (1000000/LT_GRANULARITY);
+static struct timepage *timepage;
 
 /*
- * minibolt countdown
+ * Refresh the time page. The fields are volatile, so the compiler
+ * keeps the stores in order, and the processors see each other's
+ * stores in program order.
  */
-static int minicount;
+static
+void
+timepage_update(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	if (timepage == NULL) {
+		return;
+	}
+	gettime(&secs, &nsecs);
+	timepage->tp_seq++;
+	timepage->tp_sec = secs;
+	timepage->tp_nsec = nsecs;
+	timepage->tp_seq++;
+}
 
 /*
  * Setup.
@@ -79,33 +101,64 @@ static int minicount;
 void
 hardclock_bootstrap(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
-	}
-	minibolt = wchan_create("minibolt");
-	if (minibolt == NULL) {
-		panic("Couldn't create minibolt\n");
+	/* Nothing to do; timed sleeps use the timeout wheel. */
+}
+
+void
+timepage_bootstrap(void)
+{
+	struct timepage *tp;
+	vaddr_t kva;
+	time_t secs;
+	uint32_t nsecs;
+
+	kva = alloc_kpages(1);
+	if (kva == 0) {
+		panic("timepage_bootstrap: Out of memory\n");
 	}
-	minicount = MINI_PER_SECOND;
-	/* we assume MINI_PER_SECOND > 0 */
-	KASSERT(minicount > 0);
+	bzero((void *)kva, PAGE_SIZE);
+
+	/* Fill it in before timerclock() can see it. */
+	tp = (struct timepage *)kva;
+	gettime(&secs, &nsecs);
+	tp->tp_sec = secs;
+	tp->tp_nsec = nsecs;
+	timepage = tp;
+}
+
+vaddr_t
+timepage_kvaddr(void)
+{
+	return (vaddr_t)timepage;
+}
+
+/*
+ * The time of day in nanoseconds, for timing things. 64 bits of
+ * nanoseconds last well past any uptime we'll see.
+ */
+uint64_t
+gettime_ns(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
 }
 
 /*
  * This is called once every every LT_GRANULARITY usec, on one processor,
  * by the timer code.
+ *
+ * It used to wake every thread in clocksleep or clocknap so each
+ * could check whether its time was up. Sleeping threads are now
+ * woken individually from the per-cpu timeout wheel instead, so all
+ * that's left is keeping the time page current.
  */
 void
 timerclock(void)
 {
-	/* Broadcast on minibolt */
-	wchan_wakeall(minibolt);
-	/* Broadcast on lbolt if a second has elapsed */
-	if (--minicount <= 0) {
-	  minicount = MINI_PER_SECOND;
-	  wchan_wakeall(lbolt);
-	}
+	timepage_update();
 }
 
 /*
@@ -120,13 +173,104 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+	timeout_hardclock();
+	thread_charge_tick(SCHEDULE_HARDCLOCKS);
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
-	thread_yield();
+	thread_preempt();
+}
+
+/*
+ * Timeout function for clock_napticks: wake the sleeper.
+ */
+static
+void
+clock_napwake(void *thread, unsigned long junk)
+{
+	(void)junk;
+	waitq_wakeone(thread);
+}
+
+/*
+ * Sleep for TICKS hardclocks, with a timeout to wake us. We sleep on
+ * our own thread structure as the wait key; nobody else sleeps on
+ * that, so the only wakeup is ours.
+ *
+ * The queue is locked before the timeout is added; that keeps
+ * interrupts off on this cpu, whose wheel the timeout goes on, until
+ * we are safely asleep.
+ */
+static
+void
+clock_napticks(unsigned ticks)
+{
+	struct timeout to;
+
+	if (ticks == 0) {
+		return;
+	}
+	timeout_init(&to, clock_napwake, curthread, 0);
+	waitq_lock(curthread);
+	timeout_add(&to, ticks);
+	waitq_sleep(curthread, "nap");
+}
+
+/*
+ * Like clock_napticks, but thread_kill can end the nap; returns EINTR
+ * if it does. A bare timeout can't be taken back safely once we might
+ * be woken before it goes off, so this uses a waitq_timer, on a key of
+ * its own.
+ */
+static
+int
+clock_napticks_killable(unsigned ticks)
+{
+	struct waitq_timer wt;
+	int result;
+
+	waitq_timer_start(&wt, &wt, ticks);
+	waitq_lock(&wt);
+	result = waitq_sleep_timed_killable(&wt, "nap");
+	waitq_timer_stop(&wt);
+	return result == EINTR ? EINTR : 0;
+}
+
+static
+int
+clock_nap(unsigned ticks, bool killable)
+{
+	if (killable) {
+		return clock_napticks_killable(ticks);
+	}
+	clock_napticks(ticks);
+	return 0;
+}
+
+/*
+ * Sleep for COUNT units of PERUNIT hardclocks each, in as few pieces
+ * as the timeout code allows.
+ */
+static
+int
+clock_napunits(unsigned count, unsigned perunit, bool killable)
+{
+	unsigned maxcount, n;
+	int result;
+
+	maxcount = TIMEOUT_MAXTICKS / perunit;
+	while (count > 0) {
+		n = count > maxcount ? maxcount : count;
+		result = clock_nap(n * perunit, killable);
+		if (result) {
+			return result;
+		}
+		count -= n;
+	}
+	return 0;
 }
 
 /*
@@ -135,11 +279,9 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-  while (num_secs > 0) {
-    wchan_lock(lbolt);
-    wchan_sleep(lbolt);
-    num_secs--;
-  }
+	if (num_secs > 0) {
+		(void)clock_napunits(num_secs, HZ, false);
+	}
 }
 
 /*
@@ -149,9 +291,48 @@ clocksleep(int num_secs)
 void
 clocknap(int num_ticks)
 {
-  while (num_ticks > 0) {
-    wchan_lock(minibolt);
-    wchan_sleep(minibolt);
-    num_ticks--;
-  }
+	if (num_ticks > 0) {
+		(void)clock_napunits(num_ticks, HARDCLOCKS_PER_TICK, false);
+	}
+}
+
+/*
+ * Suspend execution for at least SECS seconds plus NSECS nanoseconds.
+ * The time is rounded up to whole hardclocks, plus one more: the
+ * first hardclock may come at any point, so it doesn't count.
+ */
+static
+int
+clock_napns(time_t secs, uint32_t nsecs, bool killable)
+{
+	int result;
+
+	KASSERT(secs >= 0);
+	KASSERT(nsecs < 1000000000);
+
+	/* time_t is 64 bits; feed it to clock_napunits in pieces. */
+	while (secs > 0x7fffffff) {
+		result = clock_napunits(0x7fffffff, HZ, killable);
+		if (result) {
+			return result;
+		}
+		secs -= 0x7fffffff;
+	}
+	result = clock_napunits(secs, HZ, killable);
+	if (result) {
+		return result;
+	}
+	return clock_nap(DIVROUNDUP(nsecs, NSEC_PER_HARDCLOCK) + 1, killable);
+}
+
+void
+clocknap_ns(time_t secs, uint32_t nsecs)
+{
+	(void)clock_napns(secs, nsecs, false);
+}
+
+int
+clocknap_ns_killable(time_t secs, uint32_t nsecs)
+{
+	return clock_napns(secs, nsecs, true);
 }
@@ -0,0 +1,245 @@
+/*
+ * Lock contention statistics. See lockstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <current.h>
+#include <lockstat.h>
+
+/*
+ * Counters for one name on one cpu.
+ */
+struct lockstat_counts {
+	uint32_t lc_acquires;
+	uint32_t lc_contended;
+	uint64_t lc_waittime;
+	uint64_t lc_waitmax;
+	uint64_t lc_holdtime;
+};
+
+struct lockstat_name {
+	char ln_name[LOCKSTAT_NAMELEN];
+	bool ln_spin;
+};
+
+/* Slot 0 collects whatever doesn't fit in the table. */
+#define LOCKSTAT_OVERFLOW  0
+
+/*
+ * Protects the name table. It has no name itself, so taking it never
+ * records anything, and it can be taken with any other lock held.
+ */
+static struct spinlock lockstat_lock = SPINLOCK_INITIALIZER;
+static struct lockstat_name lockstat_names[LOCKSTAT_MAXNAMES];
+static unsigned lockstat_numnames;
+
+/*
+ * LOCKSTAT_MAXNAMES counters per cpu, cpu-major; NULL until bootstrap
+ * is done, which is what keeps everything off until then.
+ */
+static struct lockstat_counts *lockstat_counts;
+static unsigned lockstat_numcpus;
+
+void
+lockstat_bootstrap(void)
+{
+	struct lockstat_counts *lc;
+	unsigned num;
+
+	num = cpu_count();
+	lc = kmalloc(num * LOCKSTAT_MAXNAMES * sizeof(*lc));
+	if (lc == NULL) {
+		panic("lockstat_bootstrap: Out of memory\n");
+	}
+	bzero(lc, num * LOCKSTAT_MAXNAMES * sizeof(*lc));
+
+	strcpy(lockstat_names[LOCKSTAT_OVERFLOW].ln_name, "(other)");
+	lockstat_names[LOCKSTAT_OVERFLOW].ln_spin = false;
+	lockstat_numnames = 1;
+
+	lockstat_numcpus = num;
+	lockstat_counts = lc;
+}
+
+void
+lockstat_init(struct lockstat_lk *ls, const char *name, bool spin)
+{
+	ls->ls_name = name;
+	ls->ls_id = 0;
+	ls->ls_spin = spin;
+	ls->ls_stamp = 0;
+}
+
+/*
+ * Find (or make) the table slot for a lock's name.
+ */
+static
+unsigned
+lockstat_lookup(struct lockstat_lk *ls)
+{
+	char name[LOCKSTAT_NAMELEN];
+	unsigned i;
+
+	snprintf(name, sizeof(name), "%s", ls->ls_name);
+
+	spinlock_acquire(&lockstat_lock);
+	for (i=1; i<lockstat_numnames; i++) {
+		if (lockstat_names[i].ln_spin == ls->ls_spin &&
+		    !strcmp(lockstat_names[i].ln_name, name)) {
+			break;
+		}
+	}
+	if (i == lockstat_numnames) {
+		if (i < LOCKSTAT_MAXNAMES) {
+			strcpy(lockstat_names[i].ln_name, name);
+			lockstat_names[i].ln_spin = ls->ls_spin;
+			lockstat_numnames++;
+		}
+		else {
+			i = LOCKSTAT_OVERFLOW;
+		}
+	}
+	spinlock_release(&lockstat_lock);
+
+	return i;
+}
+
+uint64_t
+lockstat_start(struct lockstat_lk *ls)
+{
+	if (ls->ls_name == NULL || lockstat_counts == NULL) {
+		return 0;
+	}
+	return gettime_ns();
+}
+
+void
+lockstat_acquired(struct lockstat_lk *ls, uint64_t start, bool contended)
+{
+	struct lockstat_counts *lc;
+	uint64_t now, wait;
+
+	if (start == 0) {
+		return;
+	}
+	if (ls->ls_id == 0) {
+		ls->ls_id = lockstat_lookup(ls) + 1;
+	}
+
+	now = gettime_ns();
+	lc = &lockstat_counts[curcpu->c_number * LOCKSTAT_MAXNAMES +
+			      ls->ls_id - 1];
+	lc->lc_acquires++;
+	if (contended) {
+		wait = now - start;
+		lc->lc_contended++;
+		lc->lc_waittime += wait;
+		if (wait > lc->lc_waitmax) {
+			lc->lc_waitmax = wait;
+		}
+	}
+	ls->ls_stamp = now;
+}
+
+void
+lockstat_released(struct lockstat_lk *ls)
+{
+	struct lockstat_counts *lc;
+
+	if (ls->ls_stamp == 0) {
+		return;
+	}
+	lc = &lockstat_counts[curcpu->c_number * LOCKSTAT_MAXNAMES +
+			      ls->ls_id - 1];
+	lc->lc_holdtime += gettime_ns() - ls->ls_stamp;
+	ls->ls_stamp = 0;
+}
+
+/*
+ * The counters are read and cleared without stopping anyone, so a
+ * report taken while locks are busy can be slightly inconsistent.
+ */
+
+void
+lockstat_report(unsigned num)
+{
+	struct lockstat_counts *tot, *lc;
+	unsigned *order;
+	unsigned numnames, i, j, k, cpu;
+
+	if (lockstat_counts == NULL) {
+		kprintf("lockstat: not started yet\n");
+		return;
+	}
+
+	numnames = lockstat_numnames;
+	tot = kmalloc(numnames * sizeof(*tot));
+	order = kmalloc(numnames * sizeof(*order));
+	if (tot == NULL || order == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		kfree(tot);
+		kfree(order);
+		return;
+	}
+	bzero(tot, numnames * sizeof(*tot));
+
+	for (cpu=0; cpu<lockstat_numcpus; cpu++) {
+		for (i=0; i<numnames; i++) {
+			lc = &lockstat_counts[cpu * LOCKSTAT_MAXNAMES + i];
+			tot[i].lc_acquires += lc->lc_acquires;
+			tot[i].lc_contended += lc->lc_contended;
+			tot[i].lc_waittime += lc->lc_waittime;
+			tot[i].lc_holdtime += lc->lc_holdtime;
+			if (lc->lc_waitmax > tot[i].lc_waitmax) {
+				tot[i].lc_waitmax = lc->lc_waitmax;
+			}
+		}
+	}
+
+	/* Insertion sort by total wait, then by acquisitions. */
+	for (i=0; i<numnames; i++) {
+		k = i;
+		for (j=i; j>0; j--) {
+			lc = &tot[order[j-1]];
+			if (lc->lc_waittime > tot[k].lc_waittime ||
+			    (lc->lc_waittime == tot[k].lc_waittime &&
+			     lc->lc_acquires >= tot[k].lc_acquires)) {
+				break;
+			}
+			order[j] = order[j-1];
+		}
+		order[j] = k;
+	}
+
+	kprintf("%-23s %-5s %10s %10s %12s %10s %12s\n", "lock", "type",
+		"acquires", "contended", "wait(us)", "max(us)", "held(us)");
+	for (i=0; i<numnames && i<num; i++) {
+		k = order[i];
+		if (tot[k].lc_acquires == 0) {
+			break;
+		}
+		kprintf("%-23s %-5s %10u %10u %12llu %10llu %12llu\n",
+			lockstat_names[k].ln_name,
+			lockstat_names[k].ln_spin ? "spin" : "sleep",
+			tot[k].lc_acquires, tot[k].lc_contended,
+			tot[k].lc_waittime / 1000, tot[k].lc_waitmax / 1000,
+			tot[k].lc_holdtime / 1000);
+	}
+
+	kfree(tot);
+	kfree(order);
+}
+
+void
+lockstat_reset(void)
+{
+	if (lockstat_counts == NULL) {
+		return;
+	}
+	bzero(lockstat_counts,
+	      lockstat_numcpus * LOCKSTAT_MAXNAMES * sizeof(*lockstat_counts));
+}
@@ -0,0 +1,235 @@
+/*
+ * Scheduler statistics. See schedstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
+#include <schedstat.h>
+
+struct schedstat {
+	uint32_t ss_voluntary;
+	uint32_t ss_involuntary;
+	uint32_t ss_migrated;
+	uint32_t ss_stolen;
+	uint32_t ss_runs;		/* Samples in ss_rqwait */
+	uint32_t ss_slices;		/* Samples in ss_slice */
+	uint64_t ss_rqwaittime;
+	uint64_t ss_slicetime;
+	uint32_t ss_rqwait[SCHEDSTAT_BUCKETS];
+	uint32_t ss_slice[SCHEDSTAT_BUCKETS];
+};
+
+/* One per cpu; NULL until bootstrap, which keeps everything off. */
+static struct schedstat *schedstats;
+static unsigned schedstat_numcpus;
+
+void
+schedstat_bootstrap(void)
+{
+	struct schedstat *ss;
+	unsigned num;
+
+	num = cpu_count();
+	ss = kmalloc(num * sizeof(*ss));
+	if (ss == NULL) {
+		panic("schedstat_bootstrap: Out of memory\n");
+	}
+	bzero(ss, num * sizeof(*ss));
+
+	schedstat_numcpus = num;
+	schedstats = ss;
+}
+
+uint64_t
+schedstat_now(void)
+{
+	if (schedstats == NULL) {
+		return 0;
+	}
+	return gettime_ns();
+}
+
+static
+unsigned
+schedstat_bucket(uint64_t ns)
+{
+	unsigned b;
+
+	for (b=0; b < SCHEDSTAT_BUCKETS-1 && ns >= 2; b++) {
+		ns >>= 1;
+	}
+	return b;
+}
+
+void
+schedstat_switch(bool involuntary)
+{
+	struct schedstat *ss;
+
+	if (schedstats == NULL) {
+		return;
+	}
+	ss = &schedstats[curcpu->c_number];
+	if (involuntary) {
+		ss->ss_involuntary++;
+	}
+	else {
+		ss->ss_voluntary++;
+	}
+}
+
+void
+schedstat_rqwait(uint64_t ready, uint64_t now)
+{
+	struct schedstat *ss;
+
+	if (schedstats == NULL || ready == 0 || now < ready) {
+		return;
+	}
+	ss = &schedstats[curcpu->c_number];
+	ss->ss_runs++;
+	ss->ss_rqwaittime += now - ready;
+	ss->ss_rqwait[schedstat_bucket(now - ready)]++;
+}
+
+void
+schedstat_slice(uint64_t start, uint64_t now)
+{
+	struct schedstat *ss;
+
+	if (schedstats == NULL || start == 0 || now < start) {
+		return;
+	}
+	ss = &schedstats[curcpu->c_number];
+	ss->ss_slices++;
+	ss->ss_slicetime += now - start;
+	ss->ss_slice[schedstat_bucket(now - start)]++;
+}
+
+void
+schedstat_migrated(void)
+{
+	if (schedstats != NULL) {
+		schedstats[curcpu->c_number].ss_migrated++;
+	}
+}
+
+void
+schedstat_stolen(void)
+{
+	if (schedstats != NULL) {
+		schedstats[curcpu->c_number].ss_stolen++;
+	}
+}
+
+static
+uint64_t
+schedstat_avgus(uint64_t total, uint32_t count)
+{
+	return count == 0 ? 0 : total / count / 1000;
+}
+
+/*
+ * Print a bucket's lower bound in a readable unit.
+ */
+static
+void
+schedstat_printbound(unsigned b)
+{
+	uint32_t ns = (uint32_t)1 << b;
+
+	if (b == 0) {
+		kprintf("%7s", "0");
+	}
+	else if (ns < 1000) {
+		kprintf("%5uns", ns);
+	}
+	else if (ns < 1000000) {
+		kprintf("%5uus", ns / 1000);
+	}
+	else if (ns < 1000000000) {
+		kprintf("%5ums", ns / 1000000);
+	}
+	else {
+		kprintf("%5us ", ns / 1000000000);
+	}
+}
+
+/*
+ * As with lockstat, the counters are read and cleared without
+ * stopping anyone, so a report taken under load can be slightly
+ * inconsistent.
+ */
+
+void
+schedstat_report(int cpunum)
+{
+	struct schedstat tot, *ss;
+	unsigned cpu, b, first, last;
+
+	if (schedstats == NULL) {
+		kprintf("schedstat: not started yet\n");
+		return;
+	}
+	if (cpunum >= (int)schedstat_numcpus) {
+		kprintf("schedstat: no cpu %d\n", cpunum);
+		return;
+	}
+
+	kprintf("%-4s %10s %10s %10s %10s %12s %12s\n", "cpu",
+		"voluntary", "preempted", "migrated", "stolen",
+		"avgwait(us)", "avgslice(us)");
+	bzero(&tot, sizeof(tot));
+	for (cpu=0; cpu<schedstat_numcpus; cpu++) {
+		if (cpunum >= 0 && cpu != (unsigned)cpunum) {
+			continue;
+		}
+		ss = &schedstats[cpu];
+		kprintf("%-4u %10u %10u %10u %10u %12llu %12llu\n", cpu,
+			ss->ss_voluntary, ss->ss_involuntary,
+			ss->ss_migrated, ss->ss_stolen,
+			schedstat_avgus(ss->ss_rqwaittime, ss->ss_runs),
+			schedstat_avgus(ss->ss_slicetime, ss->ss_slices));
+
+		tot.ss_runs += ss->ss_runs;
+		tot.ss_slices += ss->ss_slices;
+		for (b=0; b<SCHEDSTAT_BUCKETS; b++) {
+			tot.ss_rqwait[b] += ss->ss_rqwait[b];
+			tot.ss_slice[b] += ss->ss_slice[b];
+		}
+	}
+
+	/* Only print the range of buckets that have anything in them. */
+	first = SCHEDSTAT_BUCKETS;
+	last = 0;
+	for (b=0; b<SCHEDSTAT_BUCKETS; b++) {
+		if (tot.ss_rqwait[b] != 0 || tot.ss_slice[b] != 0) {
+			if (first == SCHEDSTAT_BUCKETS) {
+				first = b;
+			}
+			last = b;
+		}
+	}
+	if (first == SCHEDSTAT_BUCKETS) {
+		return;
+	}
+
+	kprintf("\n%7s %10s %10s\n", ">=", "rq wait", "timeslice");
+	for (b=first; b<=last; b++) {
+		schedstat_printbound(b);
+		kprintf(" %10u %10u\n", tot.ss_rqwait[b], tot.ss_slice[b]);
+	}
+	kprintf("%7s %10u %10u\n", "total", tot.ss_runs, tot.ss_slices);
+}
+
+void
+schedstat_reset(void)
+{
+	if (schedstats == NULL) {
+		return;
+	}
+	bzero(schedstats, schedstat_numcpus * sizeof(*schedstats));
+}
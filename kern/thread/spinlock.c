@@ -50,42 +50,132 @@ spinlock_init(struct spinlock *lk)
 {
 	spinlock_data_set(&lk->lk_lock, 0);
 	lk->lk_holder = NULL;
+	lk->lk_mcs = false;
+	lk->lk_mcsnode = NULL;
+#if OPT_LOCKSTAT
+	lockstat_init(&lk->lk_stat, NULL, true);
+#endif
 }
 
 /*
- * Clean up spinlock.
+ * Initialize an MCS spinlock.
  */
 void
-spinlock_cleanup(struct spinlock *lk)
+spinlock_init_mcs(struct spinlock *lk)
 {
-	KASSERT(lk->lk_holder == NULL);
-	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
+	/* lk_lock has to be able to hold a node pointer */
+	COMPILE_ASSERT(sizeof(spinlock_data_t) ==
+		       sizeof(struct spinlock_mcsnode *));
+
+	spinlock_init(lk);
+	lk->lk_mcs = true;
 }
 
+#if OPT_LOCKSTAT
 /*
- * Get the lock.
- *
- * First disable interrupts (otherwise, if we get a timer interrupt we
- * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * Name a spinlock so lockstat tracks it.
  */
 void
-spinlock_acquire(struct spinlock *lk)
+spinlock_setname(struct spinlock *lk, const char *name)
 {
-	struct cpu *mycpu;
+	lk->lk_stat.ls_name = name;
+}
+#endif
 
-	splraise(IPL_NONE, IPL_HIGH);
+////////////////////////////////////////////////////////////
+//
+// MCS queue locks. For these, lk_lock holds a pointer to the last
+// node in the queue (the holder's, if nobody is waiting), or 0 if
+// the lock is free.
 
-	/* this must work before curcpu initialization */
-	if (CURCPU_EXISTS()) {
-		mycpu = curcpu->c_self;
-		if (lk->lk_holder == mycpu) {
-			panic("Deadlock on spinlock %p\n", lk);
+/*
+ * Nodes for use before curcpu exists. Only the boot cpu runs then.
+ */
+static struct spinlock_mcsnode spinlock_bootnodes[SPINLOCK_MCSNODES];
+
+/*
+ * Take a free node from the current cpu's pool. Interrupts are off,
+ * so nothing else on this cpu can be in here.
+ */
+static
+struct spinlock_mcsnode *
+spinlock_mcsnode_get(void)
+{
+	struct spinlock_mcsnode *pool;
+	unsigned i;
+
+	pool = CURCPU_EXISTS() ? curcpu->c_mcsnodes : spinlock_bootnodes;
+	for (i=0; i<SPINLOCK_MCSNODES; i++) {
+		if (!pool[i].mn_inuse) {
+			pool[i].mn_inuse = true;
+			return &pool[i];
 		}
 	}
-	else {
-		mycpu = NULL;
+	panic("spinlock: cpu is holding too many MCS spinlocks\n");
+	return NULL;
+}
+
+/*
+ * Returns true if we had to wait.
+ */
+static
+bool
+spinlock_mcs_acquire(struct spinlock *lk)
+{
+	struct spinlock_mcsnode *node, *pred;
+
+	node = spinlock_mcsnode_get();
+	node->mn_next = NULL;
+	spinlock_data_set(&node->mn_wait, 1);
+
+	/* Get in line. */
+	pred = (struct spinlock_mcsnode *)
+		spinlock_data_swap(&lk->lk_lock, (spinlock_data_t)node);
+	if (pred != NULL) {
+		/* Someone's ahead of us; wait for them to hand over. */
+		pred->mn_next = node;
+		while (spinlock_data_get(&node->mn_wait) != 0) {
+			/* spin on our own node */
+		}
 	}
+	lk->lk_mcsnode = node;
+	return pred != NULL;
+}
+
+static
+void
+spinlock_mcs_release(struct spinlock *lk)
+{
+	struct spinlock_mcsnode *node, *next;
+
+	node = lk->lk_mcsnode;
+	lk->lk_mcsnode = NULL;
+
+	next = node->mn_next;
+	if (next == NULL) {
+		/* Nobody visibly waiting: try to mark the lock free. */
+		if (spinlock_data_cas(&lk->lk_lock, (spinlock_data_t)node, 0)
+		    == (spinlock_data_t)node) {
+			node->mn_inuse = false;
+			return;
+		}
+		/* Someone just got in line; wait until they link up. */
+		while ((next = node->mn_next) == NULL) {
+			/* spin */
+		}
+	}
+	spinlock_data_set(&next->mn_wait, 0);
+	node->mn_inuse = false;
+}
+
+/*
+ * Ordinary spinlocks. Returns true if we had to wait.
+ */
+static
+bool
+spinlock_tas_acquire(struct spinlock *lk)
+{
+	bool contended = false;
 
 	while (1) {
 		/*
@@ -99,15 +189,74 @@ spinlock_acquire(struct spinlock *lk)
 		 * we don't.
 		 */
 		if (spinlock_data_get(&lk->lk_lock) != 0) {
+			contended = true;
 			continue;
 		}
 		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
+			contended = true;
 			continue;
 		}
 		break;
 	}
+	return contended;
+}
+
+/*
+ * Clean up spinlock.
+ */
+void
+spinlock_cleanup(struct spinlock *lk)
+{
+	KASSERT(lk->lk_holder == NULL);
+	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
+}
+
+/*
+ * Get the lock.
+ *
+ * First disable interrupts (otherwise, if we get a timer interrupt we
+ * might come back to this lock and deadlock), then use a machine-level
+ * atomic operation to wait for the lock to be free.
+ */
+void
+spinlock_acquire(struct spinlock *lk)
+{
+	struct cpu *mycpu;
+	bool contended;
+#if OPT_LOCKSTAT
+	uint64_t start;
+#endif
+
+	splraise(IPL_NONE, IPL_HIGH);
+
+	/* this must work before curcpu initialization */
+	if (CURCPU_EXISTS()) {
+		mycpu = curcpu->c_self;
+		if (lk->lk_holder == mycpu) {
+			panic("Deadlock on spinlock %p\n", lk);
+		}
+	}
+	else {
+		mycpu = NULL;
+	}
 
+#if OPT_LOCKSTAT
+	start = lockstat_start(&lk->lk_stat);
+#endif
+
+	if (lk->lk_mcs) {
+		contended = spinlock_mcs_acquire(lk);
+	}
+	else {
+		contended = spinlock_tas_acquire(lk);
+	}
 	lk->lk_holder = mycpu;
+
+#if OPT_LOCKSTAT
+	lockstat_acquired(&lk->lk_stat, start, contended);
+#else
+	(void)contended;
+#endif
 }
 
 /*
@@ -121,8 +270,16 @@ spinlock_release(struct spinlock *lk)
 		KASSERT(lk->lk_holder == curcpu->c_self);
 	}
 
+#if OPT_LOCKSTAT
+	lockstat_released(&lk->lk_stat);
+#endif
 	lk->lk_holder = NULL;
-	spinlock_data_set(&lk->lk_lock, 0);
+	if (lk->lk_mcs) {
+		spinlock_mcs_release(lk);
+	}
+	else {
+		spinlock_data_set(&lk->lk_lock, 0);
+	}
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -34,6 +34,7 @@
 
 #include <types.h>
 #include <lib.h>
+#include <cpu.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
@@ -62,15 +63,10 @@ sem_create(const char *name, int initial_count)
                 return NULL;
         }
 
-	sem->sem_wchan = wchan_create(sem->sem_name);
-	if (sem->sem_wchan == NULL) {
-		kfree(sem->sem_name);
-		kfree(sem);
-		return NULL;
-	}
-
 	spinlock_init(&sem->sem_lock);
+	spinlock_setname(&sem->sem_lock, sem->sem_name);
         sem->sem_count = initial_count;
+	sem->sem_handoff = false;
 
         return sem;
 }
@@ -80,9 +76,8 @@ sem_destroy(struct semaphore *sem)
 {
         KASSERT(sem != NULL);
 
-	/* wchan_cleanup will assert if anyone's waiting on it */
+	KASSERT(waitq_isempty(sem));
 	spinlock_cleanup(&sem->sem_lock);
-	wchan_destroy(sem->sem_wchan);
         kfree(sem->sem_name);
         kfree(sem);
 }
@@ -101,12 +96,13 @@ P(struct semaphore *sem)
         KASSERT(curthread->t_in_interrupt == false);
 
 	spinlock_acquire(&sem->sem_lock);
+	curthread->t_handedoff = false;
         while (sem->sem_count == 0) {
 		/*
-		 * Bridge to the wchan lock, so if someone else comes
-		 * along in V right this instant the wakeup can't go
-		 * through on the wchan until we've finished going to
-		 * sleep. Note that wchan_sleep unlocks the wchan.
+		 * Bridge to the wait queue lock, so if someone else
+		 * comes along in V right this instant the wakeup can't
+		 * go through until we've finished going to sleep. Note
+		 * that waitq_sleep unlocks the queue.
 		 *
 		 * Note that we don't maintain strict FIFO ordering of
 		 * threads going through the semaphore; that is, we
@@ -118,27 +114,121 @@ P(struct semaphore *sem)
 		 * Exercise: how would you implement strict FIFO
 		 * ordering?
 		 */
-		wchan_lock(sem->sem_wchan);
+		waitq_lock(sem);
 		spinlock_release(&sem->sem_lock);
-                wchan_sleep(sem->sem_wchan);
+                waitq_sleep(sem, sem->sem_name);
 
 		spinlock_acquire(&sem->sem_lock);
+		if (curthread->t_handedoff) {
+			/* V gave us its count; there's nothing to take */
+			spinlock_release(&sem->sem_lock);
+			return;
+		}
         }
         KASSERT(sem->sem_count > 0);
         sem->sem_count--;
 	spinlock_release(&sem->sem_lock);
 }
 
+int
+P_timed(struct semaphore *sem, unsigned ticks)
+{
+	struct waitq_timer wt;
+	int result;
+
+        KASSERT(sem != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&sem->sem_lock);
+	curthread->t_handedoff = false;
+	if (sem->sem_count > 0) {
+		sem->sem_count--;
+		spinlock_release(&sem->sem_lock);
+		return 0;
+	}
+
+	/*
+	 * As in P, but the timer covers the whole wait however many
+	 * times we go around.
+	 */
+	waitq_timer_start(&wt, sem, ticks);
+	result = 0;
+	while (sem->sem_count == 0 && !curthread->t_handedoff &&
+	       result == 0) {
+		waitq_lock(sem);
+		spinlock_release(&sem->sem_lock);
+		result = waitq_sleep_timed(&wt, sem->sem_name);
+		spinlock_acquire(&sem->sem_lock);
+	}
+
+	/* A count that showed up just as time ran out still counts. */
+	if (curthread->t_handedoff) {
+		result = 0;
+	}
+	else if (sem->sem_count > 0) {
+		sem->sem_count--;
+		result = 0;
+	}
+	spinlock_release(&sem->sem_lock);
+
+	waitq_timer_stop(&wt);
+	return result;
+}
+
+int
+P_killable(struct semaphore *sem)
+{
+	int result;
+
+        KASSERT(sem != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+	/* As in P_timed, with thread_kill in place of the timer. */
+	spinlock_acquire(&sem->sem_lock);
+	curthread->t_handedoff = false;
+	result = 0;
+	while (sem->sem_count == 0 && !curthread->t_handedoff &&
+	       result == 0) {
+		waitq_lock(sem);
+		spinlock_release(&sem->sem_lock);
+		result = waitq_sleep_killable(sem, sem->sem_name);
+		spinlock_acquire(&sem->sem_lock);
+	}
+
+	/* The wakeup may have been V's; then we must take the count. */
+	if (curthread->t_handedoff) {
+		result = 0;
+	}
+	else if (sem->sem_count > 0) {
+		sem->sem_count--;
+		result = 0;
+	}
+	spinlock_release(&sem->sem_lock);
+	return result;
+}
+
 void
 V(struct semaphore *sem)
 {
+	struct thread *target;
+
         KASSERT(sem != NULL);
 
 	spinlock_acquire(&sem->sem_lock);
 
+	if (sem->sem_handoff) {
+		target = waitq_wakehead(sem);
+		if (target != NULL) {
+			/* P checks this once it has sem_lock back */
+			target->t_handedoff = true;
+			spinlock_release(&sem->sem_lock);
+			return;
+		}
+	}
+
         sem->sem_count++;
         KASSERT(sem->sem_count > 0);
-	wchan_wakeone(sem->sem_wchan);
+	waitq_wakeone(sem);
 
 	spinlock_release(&sem->sem_lock);
 }
@@ -147,6 +237,42 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * Adaptive spinning. A waiter spins only while the holder is running
+ * on another cpu, since then it is likely to let go soon; and only
+ * for LOCK_SPIN_ROUNDS rounds, with the delay between looks doubling
+ * from LOCK_BACKOFF_MIN to LOCK_BACKOFF_MAX loop iterations, so a
+ * long critical section still ends up with the waiter asleep.
+ */
+#define LOCK_SPIN_ROUNDS	16
+#define LOCK_BACKOFF_MIN	8
+#define LOCK_BACKOFF_MAX	512
+
+/*
+ * Is the lock holder running on some other cpu? Call with the lock's
+ * spinlock held; that keeps the holder from releasing the lock, and
+ * so from exiting, while we look at it.
+ */
+static
+bool
+lock_owner_running(struct lock *lock)
+{
+	struct thread *owner = lock->owner;
+
+	KASSERT(spinlock_do_i_hold(&lock->spinlock));
+	return owner != NULL && owner->t_state == S_RUN &&
+		owner->t_cpu != curcpu->c_self;
+}
+
+static
+void
+lock_backoff(unsigned loops)
+{
+	volatile unsigned i;
+
+	for (i=0; i<loops; i++);
+}
+
 struct lock *
 lock_create(const char *name)
 {
@@ -167,15 +293,14 @@ lock_create(const char *name)
         
         lock->owner = NULL;
         lock->held = false;
-
-	lock->wchan = wchan_create(lock->lk_name);
-	if (lock->wchan == NULL) {
-		kfree(lock->lk_name);
-		kfree(lock);
-		return NULL;
-	}
+        lock->adaptive = true;
+        lock->handoff = false;
 
 	spinlock_init(&lock->spinlock);
+	spinlock_setname(&lock->spinlock, lock->lk_name);
+#if OPT_LOCKSTAT
+	lockstat_init(&lock->lk_stat, lock->lk_name, false);
+#endif
         
         return lock;
 }
@@ -184,9 +309,8 @@ void
 lock_destroy(struct lock *lock)
 {
         KASSERT(lock != NULL);
-	/* wchan_cleanup will assert if anyone's waiting on it */
+	KASSERT(waitq_isempty(lock));
 	spinlock_cleanup(&lock->spinlock);
-	wchan_destroy(lock->wchan);
         kfree(lock->lk_name);
         kfree(lock);
 }
@@ -194,30 +318,98 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
+        unsigned rounds, backoff;
+#if OPT_LOCKSTAT
+        uint64_t start;
+        bool contended;
+#endif
+
         KASSERT(lock != NULL);
         KASSERT(!lock_do_i_hold(lock));
+        rounds = 0;
+        backoff = LOCK_BACKOFF_MIN;
+#if OPT_LOCKSTAT
+        start = lockstat_start(&lock->lk_stat);
+#endif
         spinlock_acquire(&lock->spinlock);
+#if OPT_LOCKSTAT
+        contended = lock->held;
+#endif
         while (lock->held){
-                wchan_lock(lock->wchan);
+                if (lock->owner == curthread) {
+                        /* Handed to us by lock_release */
+                        KASSERT(lock->handoff);
+                        break;
+                }
+                if (lock->adaptive && rounds < LOCK_SPIN_ROUNDS &&
+                    lock_owner_running(lock)) {
+                        spinlock_release(&lock->spinlock);
+                        lock_backoff(backoff);
+                        if (backoff < LOCK_BACKOFF_MAX) {
+                                backoff *= 2;
+                        }
+                        rounds++;
+                        spinlock_acquire(&lock->spinlock);
+                        continue;
+                }
+                waitq_lock(lock);
                 spinlock_release(&lock->spinlock);
-                wchan_sleep(lock->wchan);
+                waitq_sleep(lock, lock->lk_name);
                 spinlock_acquire(&lock->spinlock);
         }
         lock->held = true;
         lock->owner = curthread;
+#if OPT_LOCKSTAT
+        lockstat_acquired(&lock->lk_stat, start, contended);
+#endif
         spinlock_release(&lock->spinlock);
 }
 
 void
 lock_release(struct lock *lock)
 {
+        struct thread *target;
+
         KASSERT(lock != NULL);
         KASSERT(lock_do_i_hold(lock));
         spinlock_acquire(&lock->spinlock);
+#if OPT_LOCKSTAT
+        lockstat_released(&lock->lk_stat);
+#endif
+        if (lock->handoff) {
+                target = waitq_wakehead(lock);
+                if (target != NULL) {
+                        /* Still held; it's just someone else's now */
+                        lock->owner = target;
+                        spinlock_release(&lock->spinlock);
+                        return;
+                }
+        }
         lock->held = false;
         lock->owner = NULL;
-        wchan_wakeone(lock->wchan);
+        waitq_wakeone(lock);
+        spinlock_release(&lock->spinlock);
+}
+
+bool
+lock_tryacquire(struct lock *lock)
+{
+        KASSERT(lock != NULL);
+        KASSERT(!lock_do_i_hold(lock));
+
+        spinlock_acquire(&lock->spinlock);
+        if (lock->held) {
+                spinlock_release(&lock->spinlock);
+                return false;
+        }
+        lock->held = true;
+        lock->owner = curthread;
+#if OPT_LOCKSTAT
+        lockstat_acquired(&lock->lk_stat, lockstat_start(&lock->lk_stat),
+                          false);
+#endif
         spinlock_release(&lock->spinlock);
+        return true;
 }
 
 bool
@@ -248,13 +440,7 @@ cv_create(const char *name)
                 kfree(cv);
                 return NULL;
         }
-        
-        cv->wchan = wchan_create(cv->cv_name);
-	if (cv->wchan == NULL) {
-		kfree(cv->cv_name);
-		kfree(cv);
-		return NULL;
-	}
+        cv->cv_seq = 0;
         
         return cv;
 }
@@ -263,34 +449,104 @@ void
 cv_destroy(struct cv *cv)
 {
         KASSERT(cv != NULL);
+        KASSERT(waitq_isempty(cv));
 
-        wchan_destroy(cv->wchan);        
         kfree(cv->cv_name);
         kfree(cv);
 }
 
+/*
+ * Waiting can't bridge from the cv's wait queue lock across
+ * lock_release, as that may need the lock's wait queue and two wait
+ * queue locks must never be held at once. Instead every signal or
+ * broadcast bumps cv_seq before waking anyone. A waiter notes cv_seq
+ * while it still holds the lock and checks it again with the queue
+ * locked: if it changed, the wakeup it would have waited for has
+ * already happened, so it doesn't sleep.
+ */
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
+        unsigned seq;
+
         KASSERT(cv != NULL);
         KASSERT(lock != NULL);
         KASSERT(lock_do_i_hold(lock));
         
-        wchan_lock(cv->wchan);
+        seq = cv->cv_seq;
         lock_release(lock);
-        wchan_sleep(cv->wchan);
+        waitq_lock(cv);
+        if (cv->cv_seq == seq) {
+                waitq_sleep(cv, cv->cv_name);
+        }
+        else {
+                waitq_unlock(cv);
+        }
         // Caller sleeps and will be waken up here
         lock_acquire(lock);
 }
 
+int
+cv_wait_killable(struct cv *cv, struct lock *lock)
+{
+        unsigned seq;
+        int result;
+
+        KASSERT(cv != NULL);
+        KASSERT(lock != NULL);
+        KASSERT(lock_do_i_hold(lock));
+
+        seq = cv->cv_seq;
+        lock_release(lock);
+        waitq_lock(cv);
+        if (cv->cv_seq == seq) {
+                result = waitq_sleep_killable(cv, cv->cv_name);
+        }
+        else {
+                waitq_unlock(cv);
+                result = 0;
+        }
+        lock_acquire(lock);
+        return result;
+}
+
+int
+cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks)
+{
+        struct waitq_timer wt;
+        unsigned seq;
+        int result;
+
+        KASSERT(cv != NULL);
+        KASSERT(lock != NULL);
+        KASSERT(lock_do_i_hold(lock));
+
+        waitq_timer_start(&wt, cv, ticks);
+        seq = cv->cv_seq;
+        lock_release(lock);
+        waitq_lock(cv);
+        if (cv->cv_seq == seq) {
+                result = waitq_sleep_timed(&wt, cv->cv_name);
+        }
+        else {
+                waitq_unlock(cv);
+                result = 0;
+        }
+        /* Before lock_acquire, which may sleep on another key */
+        waitq_timer_stop(&wt);
+        lock_acquire(lock);
+        return result;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
         KASSERT(cv != NULL);
         KASSERT(lock != NULL);
-        // KASSERT(lock_do_i_hold(lock));
+        KASSERT(lock_do_i_hold(lock));
 
-        wchan_wakeone(cv->wchan);
+        cv->cv_seq++;
+        waitq_wakeone(cv);
 }
 
 void
@@ -298,7 +554,218 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 {
         KASSERT(cv != NULL);
         KASSERT(lock != NULL);
-        // KASSERT(lock_do_i_hold(lock));
+        KASSERT(lock_do_i_hold(lock));
+
+        cv->cv_seq++;
+        waitq_wakeall(cv);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+/*
+ * Readers and writers wait separately, so they need two keys: the
+ * rwlock itself for writers and its spinlock for readers.
+ */
+#define RW_READKEY(rw)	(&(rw)->rw_lock)
+#define RW_WRITEKEY(rw)	(rw)
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(struct rwlock));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rwlock_name = kstrdup(name);
+	if (rw->rwlock_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	spinlock_setname(&rw->rw_lock, rw->rwlock_name);
+	rw->rw_readers = 0;
+	rw->rw_writewaiters = 0;
+	rw->rw_writer = NULL;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+
+	KASSERT(waitq_isempty(RW_READKEY(rw)));
+	KASSERT(waitq_isempty(RW_WRITEKEY(rw)));
+	spinlock_cleanup(&rw->rw_lock);
+	kfree(rw->rwlock_name);
+	kfree(rw);
+}
+
+/*
+ * The conditions for getting in, with rw_lock held. Readers also
+ * stay out while a writer is waiting; that's the writer preference.
+ */
+static
+bool
+rwlock_can_read(struct rwlock *rw)
+{
+	return rw->rw_writer == NULL && rw->rw_writewaiters == 0;
+}
+
+static
+bool
+rwlock_can_write(struct rwlock *rw)
+{
+	return rw->rw_writer == NULL && rw->rw_readers == 0;
+}
+
+/*
+ * Wake whoever should go next after the lock becomes free: a writer
+ * if one is waiting, otherwise all the readers. Call with rw_lock
+ * held.
+ */
+static
+void
+rwlock_wakeup(struct rwlock *rw)
+{
+	if (rw->rw_writewaiters > 0) {
+		waitq_wakeone(RW_WRITEKEY(rw));
+	}
+	else {
+		waitq_wakeall(RW_READKEY(rw));
+	}
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(!rwlock_do_i_hold_write(rw));
+
+	spinlock_acquire(&rw->rw_lock);
+	while (!rwlock_can_read(rw)) {
+		/* Bridge to the wait queue lock, as in P(). */
+		waitq_lock(RW_READKEY(rw));
+		spinlock_release(&rw->rw_lock);
+		waitq_sleep(RW_READKEY(rw), rw->rwlock_name);
+		spinlock_acquire(&rw->rw_lock);
+	}
+	rw->rw_readers++;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	rw->rw_readers--;
+	if (rw->rw_readers == 0 && rw->rw_writewaiters > 0) {
+		waitq_wakeone(RW_WRITEKEY(rw));
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(!rwlock_do_i_hold_write(rw));
+
+	spinlock_acquire(&rw->rw_lock);
+	while (!rwlock_can_write(rw)) {
+		rw->rw_writewaiters++;
+		waitq_lock(RW_WRITEKEY(rw));
+		spinlock_release(&rw->rw_lock);
+		waitq_sleep(RW_WRITEKEY(rw), rw->rwlock_name);
+		spinlock_acquire(&rw->rw_lock);
+		rw->rw_writewaiters--;
+	}
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rwlock_do_i_hold_write(rw));
+
+	spinlock_acquire(&rw->rw_lock);
+	rw->rw_writer = NULL;
+	rwlock_wakeup(rw);
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_tryacquire_read(struct rwlock *rw)
+{
+	bool ret;
+
+	KASSERT(rw != NULL);
+	KASSERT(!rwlock_do_i_hold_write(rw));
+
+	spinlock_acquire(&rw->rw_lock);
+	ret = rwlock_can_read(rw);
+	if (ret) {
+		rw->rw_readers++;
+	}
+	spinlock_release(&rw->rw_lock);
+
+	return ret;
+}
+
+bool
+rwlock_tryacquire_write(struct rwlock *rw)
+{
+	bool ret;
 
-        wchan_wakeall(cv->wchan);
+	KASSERT(rw != NULL);
+	KASSERT(!rwlock_do_i_hold_write(rw));
+
+	spinlock_acquire(&rw->rw_lock);
+	ret = rwlock_can_write(rw);
+	if (ret) {
+		rw->rw_writer = curthread;
+	}
+	spinlock_release(&rw->rw_lock);
+
+	return ret;
+}
+
+void
+rwlock_downgrade(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rwlock_do_i_hold_write(rw));
+
+	spinlock_acquire(&rw->rw_lock);
+	rw->rw_writer = NULL;
+	rw->rw_readers = 1;
+	/* Let other readers in too, unless a writer is waiting. */
+	if (rw->rw_writewaiters == 0) {
+		waitq_wakeall(RW_READKEY(rw));
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	return rw->rw_writer == curthread;
 }
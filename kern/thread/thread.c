@@ -50,6 +50,7 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <workqueue.h>
 
 #include "opt-synchprobs.h"
 
@@ -57,11 +58,38 @@
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
-/* Wait channel. */
+/*
+ * How often schedule() moves every thread back to the top priority
+ * level, so CPU-bound threads stuck at the bottom are not starved.
+ * Must be a multiple of SCHEDULE_HARDCLOCKS in clock.c.
+ */
+#define BOOST_HARDCLOCKS 128
+
+/*
+ * Most exited threads kept on each cpu's c_threadcache for reuse.
+ */
+#define THREAD_CACHE_MAX 8
+
+/*
+ * Wait queues. Threads sleep on a key, normally the address of the
+ * thing they're waiting for; keys hash to one of these buckets, whose
+ * list holds everyone asleep on any key that lands there. Unrelated
+ * keys share buckets, so nobody may hold two bucket locks at once.
+ */
+#define WAITQ_BITS	7
+#define WAITQ_BUCKETS	(1U << WAITQ_BITS)
+
+struct waitbucket {
+	struct spinlock wb_lock;
+	struct threadlist wb_threads;	/* sleepers, oldest first */
+};
+
+static struct waitbucket waitbuckets[WAITQ_BUCKETS];
+static void waitq_bootstrap(void);
+
+/* Wait channel: just a key with a name. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
-	struct threadlist wc_threads;	/* list of waiting threads */
-	struct spinlock wc_lock;	/* lock for mutual exclusion */
 };
 
 /* Master array of CPUs. */
@@ -111,9 +139,70 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Thread cache.
+ *
+ * Rather than freeing the struct thread and stack of every exited
+ * thread, keep a few on each cpu for thread_create to hand out again.
+ * This saves a trip through kmalloc and the page allocator for the
+ * stack, and redoing the stack guard band, on every fork. The guard
+ * band is checked before a thread goes in the cache, so it is known
+ * to be intact when the thread comes back out.
+ */
+
+/*
+ * Get a thread from the current cpu's cache, or NULL if it is empty.
+ * The thread comes back with its t_stack still set; all other fields
+ * need to be initialized.
+ */
+static
+struct thread *
+thread_cache_get(void)
+{
+	struct cpu *c;
+	struct thread *thread;
+
+	/* Nothing to get before curcpu is set up. */
+	if (!CURCPU_EXISTS()) {
+		return NULL;
+	}
+
+	c = curcpu->c_self;
+	spinlock_acquire(&c->c_threadcache_lock);
+	thread = threadlist_remhead(&c->c_threadcache);
+	spinlock_release(&c->c_threadcache_lock);
+
+	return thread;
+}
+
+/*
+ * Try to put a dead thread in the current cpu's cache. Returns false
+ * (and does nothing) if the cache is full.
+ */
+static
+bool
+thread_cache_put(struct thread *thread)
+{
+	struct cpu *c;
+	bool ret;
+
+	c = curcpu->c_self;
+	spinlock_acquire(&c->c_threadcache_lock);
+	ret = c->c_threadcache.tl_count < THREAD_CACHE_MAX;
+	if (ret) {
+		threadlist_addhead(&c->c_threadcache, thread);
+	}
+	spinlock_release(&c->c_threadcache_lock);
+
+	return ret;
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
+ *
+ * If the thread comes from the thread cache it already has a stack;
+ * otherwise t_stack is NULL and it's up to the caller to provide one.
  */
 static
 struct thread *
@@ -123,32 +212,54 @@ thread_create(const char *name)
 
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
+	thread = thread_cache_get();
 	if (thread == NULL) {
-		return NULL;
+		thread = kmalloc(sizeof(*thread));
+		if (thread == NULL) {
+			return NULL;
+		}
+		thread->t_stack = NULL;
 	}
 
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
-		kfree(thread);
+		if (thread->t_stack == NULL || !thread_cache_put(thread)) {
+			kfree(thread->t_stack);
+			kfree(thread);
+		}
 		return NULL;
 	}
 	thread->t_wchan_name = "NEW";
+	thread->t_wchan = NULL;
+	thread->t_killable = false;
 	thread->t_state = S_READY;
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
+	thread->t_priority = 0;
+	thread->t_ticks = 0;
+	thread->t_lastcpu = NULL;
+	thread->t_lastrun = 0;
+	thread->t_affinity = THREAD_ALLCPUS;
+	thread->t_wakenext = NULL;
+#if OPT_SCHEDSTAT
+	thread->t_readystamp = 0;
+	thread->t_runstamp = 0;
+#endif
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Public fields */
+	thread->t_handedoff = false;
+	thread->t_killed = false;
+
 	/* If you add to struct thread, be sure to initialize here */
 
 	return thread;
@@ -167,6 +278,7 @@ cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
 	int result;
+	unsigned i;
 	char namebuf[16];
 
 	c = kmalloc(sizeof(*c));
@@ -179,11 +291,24 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	c->c_migrating = NULL;
 	c->c_hardclocks = 0;
 
 	c->c_isidle = false;
-	threadlist_init(&c->c_runqueue);
-	spinlock_init(&c->c_runqueue_lock);
+	for (i=0; i<RUNQUEUE_LEVELS; i++) {
+		threadlist_init(&c->c_runqueue[i]);
+	}
+	spinlock_init_mcs(&c->c_runqueue_lock);
+	spinlock_setname(&c->c_runqueue_lock, "runqueue");
+
+	threadlist_init(&c->c_threadcache);
+	spinlock_init(&c->c_threadcache_lock);
+
+	spinlock_data_set(&c->c_wakeups, 0);
+
+	for (i=0; i<SPINLOCK_MCSNODES; i++) {
+		c->c_mcsnodes[i].mn_inuse = false;
+	}
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -193,6 +318,9 @@ cpu_create(unsigned hardware_number)
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	if (c->c_number >= THREAD_MAXCPUS) {
+		panic("cpu_create: too many cpus\n");
+	}
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -210,10 +338,13 @@ cpu_create(unsigned hardware_number)
 		 * cpu. This means we're using the boot stack, which
 		 * can't be freed. (Exercise: what would it take to
 		 * make it possible to free the boot stack?)
+		 *
+		 * (The thread can't have come from the thread cache,
+		 * because there's no curcpu yet.)
 		 */
-		/*c->c_curthread->t_stack = ... */
+		KASSERT(c->c_curthread->t_stack == NULL);
 	}
-	else {
+	else if (c->c_curthread->t_stack == NULL) {
 		c->c_curthread->t_stack = kmalloc(STACK_SIZE);
 		if (c->c_curthread->t_stack == NULL) {
 			panic("cpu_create: couldn't allocate stack");
@@ -234,6 +365,9 @@ cpu_create(unsigned hardware_number)
  * Nor can it be called on a running thread.
  *
  * (Freeing the stack you're actually using to run is ... inadvisable.)
+ *
+ * If there's room, the struct thread and its stack go in the thread
+ * cache instead of being freed.
  */
 static
 void
@@ -249,9 +383,6 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
-	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
-	}
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
 
@@ -259,9 +390,54 @@ thread_destroy(struct thread *thread)
 	thread->t_wchan_name = "DESTROYED";
 
 	kfree(thread->t_name);
+	thread->t_name = NULL;
+
+	if (thread->t_stack != NULL) {
+		thread_checkstack(thread);
+		if (thread_cache_put(thread)) {
+			return;
+		}
+		kfree(thread->t_stack);
+	}
 	kfree(thread);
 }
 
+/*
+ * Empty every cpu's thread cache.
+ *
+ * The threads are moved to a private list first so we don't call
+ * kfree while holding a cache lock.
+ */
+unsigned
+thread_cache_shrink(void)
+{
+	struct threadlist victims;
+	struct thread *t;
+	struct cpu *c;
+	unsigned i, count;
+
+	threadlist_init(&victims);
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		spinlock_acquire(&c->c_threadcache_lock);
+		while ((t = threadlist_remhead(&c->c_threadcache)) != NULL) {
+			threadlist_addtail(&victims, t);
+		}
+		spinlock_release(&c->c_threadcache_lock);
+	}
+
+	count = 0;
+	while ((t = threadlist_remhead(&victims)) != NULL) {
+		threadlistnode_cleanup(&t->t_listnode);
+		kfree(t->t_stack);
+		kfree(t);
+		count++;
+	}
+	threadlist_cleanup(&victims);
+
+	return count;
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
  * need to have thread_destroy called on them.)
@@ -289,6 +465,8 @@ exorcise(void)
 void
 thread_panic(void)
 {
+	unsigned i;
+
 	/*
 	 * Kill off other CPUs.
 	 *
@@ -303,9 +481,11 @@ thread_panic(void)
 	 * to.  Instead, blat the list structure by hand, and take the
 	 * risk that it might not be quite atomic.
 	 */
-	curcpu->c_runqueue.tl_count = 0;
-	curcpu->c_runqueue.tl_head.tln_next = NULL;
-	curcpu->c_runqueue.tl_tail.tln_prev = NULL;
+	for (i=0; i<RUNQUEUE_LEVELS; i++) {
+		curcpu->c_runqueue[i].tl_count = 0;
+		curcpu->c_runqueue[i].tl_head.tln_next = NULL;
+		curcpu->c_runqueue[i].tl_tail.tln_prev = NULL;
+	}
 
 	/*
 	 * Ideally, we want to make sure sleeping threads don't wake
@@ -350,6 +530,7 @@ thread_bootstrap(void)
 	struct thread *bootthread;
 
 	cpuarray_init(&allcpus);
+	waitq_bootstrap();
 
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
@@ -406,6 +587,15 @@ cpu_hatch(unsigned software_number)
 	thread_exit();
 }
 
+/*
+ * Return the number of cpus.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
 /*
  * Start up secondary cpus. Called from boot().
  */
@@ -426,21 +616,311 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Run queue helpers. The run queue of each cpu is an array of thread
+ * lists, one per priority level, with level 0 the most urgent. All of
+ * these must be called with the cpu's runqueue lock held.
+ */
+
+/* Return the number of threads waiting on C's run queue. */
+static
+unsigned
+runqueue_count(struct cpu *c)
+{
+	unsigned i, count;
+
+	count = 0;
+	for (i=0; i<RUNQUEUE_LEVELS; i++) {
+		count += c->c_runqueue[i].tl_count;
+	}
+	return count;
+}
+
+/*
+ * Return the highest-priority level with a thread waiting on it, or
+ * RUNQUEUE_LEVELS if C's run queue is empty.
+ */
+static
+unsigned
+runqueue_toplevel(struct cpu *c)
+{
+	unsigned i;
+
+	for (i=0; i<RUNQUEUE_LEVELS; i++) {
+		if (!threadlist_isempty(&c->c_runqueue[i])) {
+			break;
+		}
+	}
+	return i;
+}
+
+/* Take the next thread to run, from the highest nonempty level. */
+static
+struct thread *
+runqueue_remhead(struct cpu *c)
+{
+	unsigned level;
+
+	level = runqueue_toplevel(c);
+	if (level == RUNQUEUE_LEVELS) {
+		return NULL;
+	}
+	return threadlist_remhead(&c->c_runqueue[level]);
+}
+
+/* Take the thread that would run last, from the lowest nonempty level. */
+static
+struct thread *
+runqueue_remtail(struct cpu *c)
+{
+	unsigned i;
+	struct thread *t;
+
+	for (i=RUNQUEUE_LEVELS; i-- > 0; ) {
+		t = threadlist_remtail(&c->c_runqueue[i]);
+		if (t != NULL) {
+			return t;
+		}
+	}
+	return NULL;
+}
+
+/* Queue T on C at the end of its priority level. */
+static
+void
+runqueue_addtail(struct cpu *c, struct thread *t)
+{
+	KASSERT(t->t_priority < RUNQUEUE_LEVELS);
+	threadlist_addtail(&c->c_runqueue[t->t_priority], t);
+}
+
+/*
+ * Cpu affinity.
+ *
+ * t_affinity is read by other cpus without locking. It is only ever
+ * changed with a single store, and a stale value at worst moves a
+ * thread one step late; everywhere a thread is placed on a cpu
+ * checks the mask again.
+ */
+
+/* Return true if T may run on C. */
+static
+bool
+thread_canrun(struct thread *t, struct cpu *c)
+{
+	return (t->t_affinity & ((uint32_t)1 << c->c_number)) != 0;
+}
+
+/*
+ * Choose a cpu for a thread with affinity MASK that is about to be
+ * placed: the current cpu if allowed, since that's where whatever
+ * the thread is going to touch was last touched; otherwise the
+ * allowed cpu with the fewest threads waiting. The counts are peeked
+ * at without locking; they're only a hint.
+ */
+static
+struct cpu *
+thread_pickcpu(uint32_t mask)
+{
+	struct cpu *c, *best;
+	unsigned i, numcpus, count, bestcount;
+
+	if (mask & ((uint32_t)1 << curcpu->c_number)) {
+		return curcpu->c_self;
+	}
+
+	best = NULL;
+	bestcount = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		if ((mask & ((uint32_t)1 << i)) == 0) {
+			continue;
+		}
+		c = cpuarray_get(&allcpus, i);
+		count = runqueue_count(c);
+		if (best == NULL || count < bestcount) {
+			best = c;
+			bestcount = count;
+		}
+	}
+	KASSERT(best != NULL);
+	return best;
+}
+
+/*
+ * Work stealing.
+ *
+ * Called by a cpu that is about to go idle, without its own runqueue
+ * lock held. Find the peer with the most threads waiting to run and
+ * take one of them, preferring the one that has gone longest without
+ * running, since its cache working set has most likely been pushed
+ * out anyway. Returns the thread, already reassigned to the current
+ * cpu, or NULL if there was nothing worth taking.
+ *
+ * The cpus' hardclock counters aren't in step with each other, so a
+ * thread's age is measured on the clock of the cpu it last ran on,
+ * which needn't be the victim if it has migrated since. A thread
+ * that has never run has nothing cached and counts as oldest.
+ *
+ * We only hold one runqueue lock at a time here; otherwise two cpus
+ * stealing from each other could deadlock.
+ */
+static
+struct thread *
+thread_steal(void)
+{
+	struct cpu *c, *victim;
+	struct thread *t, *best;
+	unsigned i, numcpus, count, maxcount, age, bestage;
+
+	/*
+	 * Pick the busiest peer. Peek at the counts without locking;
+	 * they are only a hint and we check again below.
+	 */
+	victim = NULL;
+	maxcount = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self) {
+			continue;
+		}
+		count = runqueue_count(c);
+		if (count > maxcount) {
+			maxcount = count;
+			victim = c;
+		}
+	}
+	if (victim == NULL) {
+		return NULL;
+	}
+
+	best = NULL;
+	bestage = 0;
+	spinlock_acquire(&victim->c_runqueue_lock);
+	for (i=0; i<RUNQUEUE_LEVELS; i++) {
+		THREADLIST_FORALL(t, victim->c_runqueue[i]) {
+			/*
+			 * Never take the victim's curthread (see the
+			 * comment in thread_consider_migration) or a
+			 * thread that isn't allowed to run here.
+			 */
+			if (t == victim->c_curthread ||
+			    !thread_canrun(t, curcpu->c_self)) {
+				continue;
+			}
+			age = t->t_lastcpu == NULL ? ~0U :
+				t->t_lastcpu->c_hardclocks - t->t_lastrun;
+			if (best == NULL || age > bestage) {
+				best = t;
+				bestage = age;
+			}
+		}
+	}
+	if (best != NULL) {
+		threadlist_remove(&victim->c_runqueue[best->t_priority], best);
+		best->t_cpu = curcpu->c_self;
+#if OPT_SCHEDSTAT
+		schedstat_stolen();
+#endif
+		DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+		      best->t_name, victim->c_number, curcpu->c_number);
+	}
+	spinlock_release(&victim->c_runqueue_lock);
+
+	return best;
+}
+
+/*
+ * Move the threads other cpus have staged on C's c_wakeups to its run
+ * queue, in the order they were woken. C's run queue must be locked.
+ */
+static
+void
+thread_take_wakeups(struct cpu *c)
+{
+	struct thread *t, *prev, *next;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	t = (struct thread *)spinlock_data_swap(&c->c_wakeups, 0);
+	if (t == NULL) {
+		return;
+	}
+
+	/* It's a stack, so newest first; turn it around. */
+	prev = NULL;
+	while (t != NULL) {
+		next = t->t_wakenext;
+		t->t_wakenext = prev;
+		prev = t;
+		t = next;
+	}
+
+	for (t = prev; t != NULL; t = next) {
+		next = t->t_wakenext;
+		t->t_wakenext = NULL;
+		KASSERT(t->t_cpu == c);
+		runqueue_addtail(c, t);
+	}
+}
+
 /*
  * Make a thread runnable.
  *
  * targetcpu might be curcpu; it might not be, too. 
+ *
+ * If it isn't, and we don't already hold its run queue lock, don't
+ * take the lock: push the thread on the target's c_wakeups stack and
+ * let the target put it on its run queue itself. Only the push that
+ * finds the stack empty sends an IPI; the rest ride along with it, so
+ * waking a crowd of threads (e.g. everyone on lbolt) costs each cpu
+ * one interrupt instead of one per thread. The stack is emptied from
+ * interprocessor_interrupt, and also by thread_switch in case the cpu
+ * gets there first.
+ *
+ * The thread is on no list while it's staged, so nothing can migrate
+ * it and t_cpu stays put. curcpu can be stale if we're preempted
+ * here, but that's harmless either way: a thread staged for our own
+ * cpu is picked up when our IPI arrives, and one put directly on
+ * another cpu's run queue is handled the old way, below.
  */
 static
 void
 thread_make_runnable(struct thread *target, bool already_have_lock)
 {
 	struct cpu *targetcpu;
+	spinlock_data_t old;
 	bool isidle;
 
+	/*
+	 * If the target's affinity changed while it was asleep, this
+	 * is the time to move it. (With already_have_lock, the target
+	 * is curthread, which thread_switch has already checked.)
+	 */
+	if (!already_have_lock && !thread_canrun(target, target->t_cpu)) {
+		target->t_cpu = thread_pickcpu(target->t_affinity);
+	}
+
 	/* Lock the run queue of the target thread's cpu. */
 	targetcpu = target->t_cpu;
 
+#if OPT_SCHEDSTAT
+	target->t_readystamp = schedstat_now();
+#endif
+
+	if (!already_have_lock && targetcpu != curcpu->c_self) {
+		do {
+			old = spinlock_data_get(&targetcpu->c_wakeups);
+			target->t_wakenext = (struct thread *)old;
+		} while (spinlock_data_cas(&targetcpu->c_wakeups, old,
+					   (spinlock_data_t)target) != old);
+		if (old == 0) {
+			ipi_send(targetcpu, IPI_UNIDLE);
+		}
+		return;
+	}
+
 	if (already_have_lock) {
 		/* The target thread's cpu should be already locked. */
 		KASSERT(spinlock_do_i_hold(&targetcpu->c_runqueue_lock));
@@ -450,7 +930,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 
 	isidle = targetcpu->c_isidle;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	runqueue_addtail(targetcpu, target);
 	if (isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
@@ -465,20 +945,16 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 }
 
 /*
- * Create a new thread based on an existing one.
- *
- * The new thread has name NAME, and starts executing in function
- * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
- *
- * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * Common code for thread_fork and thread_fork_bound. The new thread
+ * starts on cpu TARGETCPU and may run on the cpus in AFFINITY.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_oncpu(const char *name,
+		  struct proc *proc,
+		  struct cpu *targetcpu, uint32_t affinity,
+		  void (*entrypoint)(void *data1, unsigned long data2),
+		  void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
@@ -492,20 +968,23 @@ thread_fork(const char *name,
 		return ENOMEM;
 	}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
+	/* Allocate a stack, unless we got one from the thread cache */
 	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
 	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_cpu = targetcpu;
+	newthread->t_affinity = affinity;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -528,27 +1007,136 @@ thread_fork(const char *name,
 	/* Set up the switchframe so entrypoint() gets called */
 	switchframe_init(newthread, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock the target cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
 
 	return 0;
 }
 
+/*
+ * Create a new thread based on an existing one.
+ *
+ * The new thread has name NAME, and starts executing in function
+ * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
+ *
+ * The new thread is created in the process P. If P is null, the
+ * process is inherited from the caller. It gets the caller's cpu
+ * affinity, and starts on the same CPU as the caller if that's
+ * allowed (it might not be, if the caller is about to move) or else
+ * on the least busy allowed one.
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	uint32_t affinity = curthread->t_affinity;
+
+	return thread_fork_oncpu(name, proc, thread_pickcpu(affinity),
+				 affinity, entrypoint, data1, data2);
+}
+
+/*
+ * Create a new thread that runs only on cpu number CPUNUM.
+ */
+int
+thread_fork_bound(const char *name,
+		  struct proc *proc,
+		  unsigned cpunum,
+		  void (*entrypoint)(void *data1, unsigned long data2),
+		  void *data1, unsigned long data2)
+{
+	KASSERT(cpunum < cpuarray_num(&allcpus));
+	return thread_fork_oncpu(name, proc, cpuarray_get(&allcpus, cpunum),
+				 (uint32_t)1 << cpunum, entrypoint, data1, data2);
+}
+
+/*
+ * If the thread this cpu just switched away from had to leave (see
+ * the S_READY case in thread_switch), put it on an allowed cpu now
+ * that we're off its stack. Called from the end of thread_switch and
+ * thread_startup, with interrupts off.
+ */
+static
+void
+thread_send_migrating(void)
+{
+	struct thread *t;
+
+	t = curcpu->c_migrating;
+	if (t == NULL) {
+		return;
+	}
+	curcpu->c_migrating = NULL;
+	t->t_cpu = thread_pickcpu(t->t_affinity);
+	thread_make_runnable(t, false);
+}
+
+/*
+ * Work function whose only job is to be something else for a cpu to
+ * switch to; see thread_setaffinity.
+ */
+static
+void
+thread_nudge(void *junk1, unsigned long junk2)
+{
+	(void)junk1;
+	(void)junk2;
+}
+
+int
+thread_setaffinity(struct thread *t, uint32_t mask)
+{
+	unsigned numcpus;
+
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus < THREAD_MAXCPUS) {
+		mask &= ((uint32_t)1 << numcpus) - 1;
+	}
+	if (mask == 0) {
+		return EINVAL;
+	}
+	t->t_affinity = mask;
+
+	if (t != curthread) {
+		return 0;
+	}
+
+	/*
+	 * thread_switch moves a running thread only by switching to
+	 * something else first. Make sure there is something else,
+	 * by giving this cpu's worker a job, and yield. The loop is
+	 * in case we were preempted and ended up somewhere else, or
+	 * the workqueue was out of memory.
+	 */
+	while (!thread_canrun(curthread, curcpu->c_self)) {
+		(void)workqueue_submit(curcpu->c_number, thread_nudge,
+				       NULL, 0);
+		thread_yield();
+	}
+	return 0;
+}
+
 /*
  * High level, machine-independent context switch code.
  *
  * The current thread is queued appropriately and its state is changed
  * to NEWSTATE; another thread to run is selected and switched to.
  *
- * If NEWSTATE is S_SLEEP, the thread is queued on the wait channel
- * WC. Otherwise WC should be NULL.
+ * If NEWSTATE is S_SLEEP, the thread is queued on wait queue bucket
+ * WB, which must be locked, for the key already in t_wchan. Otherwise
+ * WB should be NULL.
  */
 static
 void
-thread_switch(threadstate_t newstate, struct wchan *wc)
+thread_switch(threadstate_t newstate, struct waitbucket *wb)
 {
 	struct thread *cur, *next;
 	int spl;
+#if OPT_SCHEDSTAT
+	uint64_t now;
+#endif
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
 	DEBUGASSERT(curthread->t_cpu == curcpu->c_self);
@@ -573,37 +1161,73 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. This
+	 * includes the case where only lower-priority threads are
+	 * waiting; they don't get to preempt us. (thread_yield has
+	 * already moved us down to their level if it wants them run.)
+	 */
+	if (newstate == S_READY && thread_canrun(cur, curcpu->c_self) &&
+	    runqueue_toplevel(curcpu) > cur->t_priority) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
 	}
 
+	/* Remember where and when we last ran, for thread_steal. */
+	cur->t_lastcpu = curcpu->c_self;
+	cur->t_lastrun = curcpu->c_hardclocks;
+
+#if OPT_SCHEDSTAT
+	/* Yielding from an interrupt handler means we were preempted. */
+	now = schedstat_now();
+	schedstat_slice(cur->t_runstamp, now);
+	schedstat_switch(newstate == S_READY && cur->t_in_interrupt);
+#endif
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
+		if (!thread_canrun(cur, curcpu->c_self)) {
+			/*
+			 * Our affinity no longer includes this cpu.
+			 * We can't go on another cpu's run queue while
+			 * we're still running on this one, so leave
+			 * ourselves for whoever runs next to send
+			 * along (see thread_send_migrating).
+			 */
+			KASSERT(curcpu->c_migrating == NULL);
+			curcpu->c_migrating = cur;
+			break;
+		}
 		thread_make_runnable(cur, true /*have lock*/);
 		break;
 	    case S_SLEEP:
-		cur->t_wchan_name = wc->wc_name;
 		/*
-		 * Add the thread to the list in the wait channel, and
+		 * Add the thread to the list in the wait queue, and
 		 * unlock same. To avoid a race with someone else
-		 * calling wchan_wake*, we must keep the wchan locked
-		 * from the point the caller of wchan_sleep locked it
+		 * calling waitq_wake*, we must keep the queue locked
+		 * from the point the caller of waitq_sleep locked it
 		 * until the thread is on the list.
 		 *
-		 * (We could for symmetry relock the channel before
-		 * returning from wchan_sleep, but we don't, for two
+		 * (We could for symmetry relock the queue before
+		 * returning from waitq_sleep, but we don't, for two
 		 * reasons. One is that the caller is unlikely to need
 		 * or want it locked and if it does can lock it itself
 		 * without racing. Exercise: what's the other?)
 		 */
-		threadlist_addtail(&wc->wc_threads, cur);
-		wchan_unlock(wc);
+		threadlist_addtail(&wb->wb_threads, cur);
+		spinlock_release(&wb->wb_lock);
+
+		/*
+		 * A thread that blocks before using up its quantum
+		 * is probably interactive; move it to the top level
+		 * so it runs promptly when it wakes up.
+		 */
+		cur->t_priority = 0;
+		cur->t_ticks = 0;
 		break;
 	    case S_ZOMBIE:
 		cur->t_wchan_name = "ZOMBIE";
@@ -613,8 +1237,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	cur->t_state = newstate;
 
 	/*
-	 * Get the next thread. While there isn't one, call md_idle().
-	 * curcpu->c_isidle must be true when md_idle is
+	 * Get the next thread. While there isn't one, try to steal
+	 * one from another cpu, and failing that call cpu_idle().
+	 * curcpu->c_isidle must be true when cpu_idle is
 	 * called. Unlock the runqueue while idling too, to make sure
 	 * things can be added to it.
 	 *
@@ -632,15 +1257,48 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
+		thread_take_wakeups(curcpu);
+		next = runqueue_remhead(curcpu);
+		if (next != NULL && next != cur &&
+		    !thread_canrun(next, curcpu->c_self)) {
+			/*
+			 * Its affinity changed while it was waiting
+			 * here; send it on. (If it's cur, which can
+			 * happen as described in thread_consider_migration,
+			 * we're on its stack; let it run, and it'll
+			 * move when it next yields.)
+			 */
+			next->t_cpu = thread_pickcpu(next->t_affinity);
+			thread_make_runnable(next, false);
+			next = NULL;
+			continue;
+		}
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			next = thread_steal();
+			if (next == NULL && curcpu->c_migrating == NULL) {
+				cpu_idle();
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
+			if (next == NULL && curcpu->c_migrating != NULL) {
+				/*
+				 * There's nothing else to switch to,
+				 * so cur can't get off this cpu yet.
+				 * Run it here again for now.
+				 */
+				next = curcpu->c_migrating;
+				curcpu->c_migrating = NULL;
+			}
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+#if OPT_SCHEDSTAT
+	now = schedstat_now();
+	schedstat_rqwait(next->t_readystamp, now);
+	next->t_runstamp = now;
+#endif
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -708,6 +1366,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Unlock the run queue. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send along the thread we switched away from, if it's moving. */
+	thread_send_migrating();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -741,6 +1402,9 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Release the runqueue lock acquired in thread_switch. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send along the thread we switched away from, if it's moving. */
+	thread_send_migrating();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -810,9 +1474,39 @@ thread_exit(void)
 
 /*
  * Yield the cpu to another process, but stay runnable.
+ *
+ * Callers are usually waiting for some other thread to get something
+ * done, so go behind everyone waiting here, not just those at our
+ * level: otherwise a thread spinning on thread_yield would keep the
+ * cpu from lower-priority threads until it used up its quantum.
  */
 void
 thread_yield(void)
+{
+	struct thread *cur = curthread;
+	unsigned level;
+	int spl;
+
+	spl = splhigh();
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	for (level = RUNQUEUE_LEVELS; level-- > cur->t_priority + 1; ) {
+		if (!threadlist_isempty(&curcpu->c_runqueue[level])) {
+			cur->t_priority = level;
+			cur->t_ticks = 0;
+			break;
+		}
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+	splx(spl);
+
+	thread_switch(S_READY, NULL);
+}
+
+/*
+ * Yield the cpu to threads at our level or above, if there are any.
+ */
+void
+thread_preempt(void)
 {
 	thread_switch(S_READY, NULL);
 }
@@ -822,17 +1516,72 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is a multi-level feedback queue. Each cpu has RUNQUEUE_LEVELS
+ * run queues; thread_switch always picks from the highest-priority
+ * nonempty one, and threads within a level run round-robin.
+ *
+ *    - New threads start at level 0.
+ *    - A thread that uses up its quantum drops a level (see
+ *      thread_charge_tick).
+ *    - A thread that blocks in wchan_sleep goes back to level 0.
+ *    - Every BOOST_HARDCLOCKS, everything is moved back to level 0.
+ *
+ * The upshot is that threads that mostly wait for I/O, such as the
+ * shell, are picked ahead of CPU hogs, but the hogs still get to run.
  */
 
+/*
+ * This is called periodically from hardclock(). It reshuffles the
+ * current CPU's run queue by job priority.
+ */
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct thread *t;
+	unsigned i;
+
+	if ((curcpu->c_hardclocks % BOOST_HARDCLOCKS) != 0) {
+		return;
+	}
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	for (i=1; i<RUNQUEUE_LEVELS; i++) {
+		while (!threadlist_isempty(&curcpu->c_runqueue[i])) {
+			t = threadlist_remhead(&curcpu->c_runqueue[i]);
+			t->t_priority = 0;
+			t->t_ticks = 0;
+			threadlist_addtail(&curcpu->c_runqueue[0], t);
+		}
+	}
+	curthread->t_priority = 0;
+	curthread->t_ticks = 0;
+	spinlock_release(&curcpu->c_runqueue_lock);
+}
+
+/*
+ * Charge one hardclock to the current thread.
+ *
+ * The quantum doubles at each level, so threads that have already
+ * shown themselves to be CPU-bound are demoted less often.
+ */
+void
+thread_charge_tick(unsigned quantum)
+{
+	struct thread *cur;
+
+	cur = curthread;
+
+	/* An idle cpu's curthread isn't actually running. */
+	if (cur->t_state != S_RUN) {
+		return;
+	}
+
+	cur->t_ticks++;
+	if (cur->t_ticks >= (quantum << cur->t_priority) &&
+	    cur->t_priority < RUNQUEUE_LEVELS - 1) {
+		cur->t_priority++;
+		cur->t_ticks = 0;
+	}
 }
 
 /*
@@ -866,9 +1615,9 @@ thread_consider_migration(void)
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
 		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
+		total_count += runqueue_count(c);
 		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
+			my_count = runqueue_count(c);
 		}
 		spinlock_release(&c->c_runqueue_lock);
 	}
@@ -882,7 +1631,7 @@ thread_consider_migration(void)
 	threadlist_init(&victims);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
+		t = runqueue_remtail(curcpu);
 		threadlist_addhead(&victims, t);
 	}
 	spinlock_release(&curcpu->c_runqueue_lock);
@@ -893,7 +1642,7 @@ thread_consider_migration(void)
 			continue;
 		}
 		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
+		while (runqueue_count(c) < one_share && to_send > 0) {
 			t = threadlist_remhead(&victims);
 			/*
 			 * Ordinarily, curthread will not appear on
@@ -916,15 +1665,21 @@ thread_consider_migration(void)
 			 * the list and decrement to_send in order to
 			 * skip it. Then it goes back on our own run
 			 * queue below.
+			 *
+			 * Threads whose affinity doesn't include c are
+			 * skipped the same way.
 			 */
-			if (t == curthread) {
+			if (t == curthread || !thread_canrun(t, c)) {
 				threadlist_addtail(&victims, t);
 				to_send--;
 				continue;
 			}
 
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			runqueue_addtail(c, t);
+#if OPT_SCHEDSTAT
+			schedstat_migrated();
+#endif
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -948,7 +1703,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			runqueue_addtail(curcpu, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -960,128 +1715,232 @@ thread_consider_migration(void)
 ////////////////////////////////////////////////////////////
 
 /*
- * Wait channel functions
+ * Wait queue functions
  */
 
 /*
- * Create a wait channel. NAME is a symbolic string name for it.
- * This is what's displayed by ps -alx in Unix.
- *
- * NAME should generally be a string constant. If it isn't, alternate
- * arrangements should be made to free it after the wait channel is
- * destroyed.
+ * Find the bucket for KEY. The low bits of a pointer are mostly
+ * zero, so mix with a multiplicative (Fibonacci) hash and keep the
+ * top bits.
  */
-struct wchan *
-wchan_create(const char *name)
+static
+struct waitbucket *
+waitq_bucket(const void *key)
 {
-	struct wchan *wc;
+	uint32_t h;
 
-	wc = kmalloc(sizeof(*wc));
-	if (wc == NULL) {
-		return NULL;
-	}
-	spinlock_init(&wc->wc_lock);
-	threadlist_init(&wc->wc_threads);
-	wc->wc_name = name;
-	return wc;
+	h = (uint32_t)(uintptr_t)key * 2654435761U;
+	return &waitbuckets[h >> (32 - WAITQ_BITS)];
 }
 
 /*
- * Destroy a wait channel. Must be empty and unlocked.
- * (The corresponding cleanup functions require this.)
+ * Set up the buckets. Called from thread_bootstrap, before anyone
+ * can sleep.
  */
+static
 void
-wchan_destroy(struct wchan *wc)
+waitq_bootstrap(void)
 {
-	spinlock_cleanup(&wc->wc_lock);
-	threadlist_cleanup(&wc->wc_threads);
-	kfree(wc);
+	unsigned i;
+
+	for (i=0; i<WAITQ_BUCKETS; i++) {
+		spinlock_init(&waitbuckets[i].wb_lock);
+		spinlock_setname(&waitbuckets[i].wb_lock, "waitq");
+		threadlist_init(&waitbuckets[i].wb_threads);
+	}
 }
 
 /*
- * Lock and unlock a wait channel, respectively.
+ * Lock and unlock the wait queue for KEY, respectively.
  */
 void
-wchan_lock(struct wchan *wc)
+waitq_lock(const void *key)
 {
-	spinlock_acquire(&wc->wc_lock);
+	spinlock_acquire(&waitq_bucket(key)->wb_lock);
 }
 
 void
-wchan_unlock(struct wchan *wc)
+waitq_unlock(const void *key)
 {
-	spinlock_release(&wc->wc_lock);
+	spinlock_release(&waitq_bucket(key)->wb_lock);
 }
 
 /*
- * Yield the cpu to another process, and go to sleep, on the specified
- * wait channel WC. Calling wakeup on the channel will make the thread
- * runnable again. The channel must be locked, and will be *unlocked*
- * upon return.
+ * Yield the cpu to another process, and go to sleep, on KEY. NAME
+ * is shown as what we're waiting for. Waking up KEY will make the
+ * thread runnable again. The queue must be locked, and will be
+ * *unlocked* upon return.
  */
 void
-wchan_sleep(struct wchan *wc)
+waitq_sleep(const void *key, const char *name)
 {
+	struct waitbucket *wb = waitq_bucket(key);
+
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
+	KASSERT(spinlock_do_i_hold(&wb->wb_lock));
 
-	thread_switch(S_SLEEP, wc);
+	curthread->t_wchan_name = name;
+	curthread->t_wchan = key;
+	curthread->t_killable = false;
+	thread_switch(S_SLEEP, wb);
 }
 
 /*
- * Wake up one thread sleeping on a wait channel.
+ * Like waitq_sleep, but thread_kill can end the sleep. Returns EINTR,
+ * without sleeping if need be, once the thread has been killed, and
+ * 0 otherwise.
+ *
+ * We set t_wchan before looking at t_killed, and thread_kill sets
+ * t_killed before looking at t_wchan, so either it finds us asleep or
+ * we see that we've been killed. Like the rest of the kernel, this
+ * counts on the cpus seeing each other's stores in order.
  */
+int
+waitq_sleep_killable(const void *key, const char *name)
+{
+	struct waitbucket *wb = waitq_bucket(key);
+
+	KASSERT(!curthread->t_in_interrupt);
+	KASSERT(spinlock_do_i_hold(&wb->wb_lock));
+
+	curthread->t_wchan_name = name;
+	curthread->t_wchan = key;
+	curthread->t_killable = true;
+	if (curthread->t_killed) {
+		curthread->t_wchan = NULL;
+		curthread->t_wchan_name = NULL;
+		spinlock_release(&wb->wb_lock);
+		return EINTR;
+	}
+	thread_switch(S_SLEEP, wb);
+	return curthread->t_killed ? EINTR : 0;
+}
+
 void
-wchan_wakeone(struct wchan *wc)
+thread_kill(struct thread *t)
+{
+	struct waitbucket *wb;
+	const void *key;
+	bool wake;
+
+	t->t_killed = true;
+
+	/*
+	 * If T is asleep, lock the queue it's on and check it's still
+	 * there. If it moved on meanwhile, look again: it may have gone
+	 * to sleep somewhere else before seeing t_killed.
+	 */
+	while ((key = t->t_wchan) != NULL) {
+		wb = waitq_bucket(key);
+		spinlock_acquire(&wb->wb_lock);
+		if (t->t_wchan != key) {
+			spinlock_release(&wb->wb_lock);
+			continue;
+		}
+		wake = t->t_killable;
+		if (wake) {
+			threadlist_remove(&wb->wb_threads, t);
+			t->t_wchan = NULL;
+		}
+		spinlock_release(&wb->wb_lock);
+		if (wake) {
+			thread_make_runnable(t, false);
+		}
+		/* Otherwise its sleep isn't killable; it'll see later. */
+		return;
+	}
+}
+
+/*
+ * Take the oldest thread sleeping on KEY off WB's list, or return
+ * NULL. WB must be KEY's bucket, locked.
+ */
+static
+struct thread *
+waitq_remfirst(struct waitbucket *wb, const void *key)
+{
+	struct threadlistnode *tln;
+	struct thread *t;
+
+	for (tln = wb->wb_threads.tl_head.tln_next; tln->tln_next != NULL;
+	     tln = tln->tln_next) {
+		t = tln->tln_self;
+		if (t->t_wchan == key) {
+			threadlist_remove(&wb->wb_threads, t);
+			t->t_wchan = NULL;
+			return t;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Wake up one thread sleeping on KEY.
+ */
+void
+waitq_wakeone(const void *key)
+{
+	(void)waitq_wakehead(key);
+}
+
+/*
+ * Wake up the oldest thread sleeping on KEY, and return it.
+ */
+struct thread *
+waitq_wakehead(const void *key)
 {
+	struct waitbucket *wb = waitq_bucket(key);
 	struct thread *target;
 
-	/* Lock the channel and grab a thread from it */
-	spinlock_acquire(&wc->wc_lock);
-	target = threadlist_remhead(&wc->wc_threads);
+	/* Lock the queue and grab a thread from it */
+	spinlock_acquire(&wb->wb_lock);
+	target = waitq_remfirst(wb, key);
 	/*
 	 * Nobody else can wake up this thread now, so we don't need
 	 * to hang onto the lock.
 	 */
-	spinlock_release(&wc->wc_lock);
+	spinlock_release(&wb->wb_lock);
 
 	if (target == NULL) {
 		/* Nobody was sleeping. */
-		return;
+		return NULL;
 	}
 
 	thread_make_runnable(target, false);
+	return target;
 }
 
 /*
- * Wake up all threads sleeping on a wait channel.
+ * Wake up all threads sleeping on KEY.
  */
 void
-wchan_wakeall(struct wchan *wc)
+waitq_wakeall(const void *key)
 {
+	struct waitbucket *wb = waitq_bucket(key);
 	struct thread *target;
 	struct threadlist list;
 
 	threadlist_init(&list);
 
 	/*
-	 * Lock the channel and grab all the threads, moving them to a
+	 * Lock the queue and grab all the threads, moving them to a
 	 * private list.
 	 */
-	spinlock_acquire(&wc->wc_lock);
-	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+	spinlock_acquire(&wb->wb_lock);
+	while ((target = waitq_remfirst(wb, key)) != NULL) {
 		threadlist_addtail(&list, target);
 	}
 	/*
 	 * Nobody else can wake up these threads now, so we don't need
 	 * to hang onto the lock.
 	 */
-	spinlock_release(&wc->wc_lock);
+	spinlock_release(&wb->wb_lock);
 
 	/*
-	 * We could conceivably sort by cpu first to cause fewer lock
-	 * ops and fewer IPIs, but for now at least don't bother. Just
-	 * make each thread runnable.
+	 * Make each thread runnable. Threads for other cpus get staged
+	 * there, so this sends each cpu at most one IPI or so no matter
+	 * how many of its threads were waiting.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
 		thread_make_runnable(target, false);
@@ -1091,21 +1950,199 @@ wchan_wakeall(struct wchan *wc)
 }
 
 /*
- * Return nonzero if there are no threads sleeping on the channel.
- * This is meant to be used only for diagnostic purposes.
+ * Return true if nobody is sleeping on KEY. This is meant to be used
+ * only for diagnostic purposes.
  */
 bool
-wchan_isempty(struct wchan *wc)
+waitq_isempty(const void *key)
 {
-	bool ret;
-
-	spinlock_acquire(&wc->wc_lock);
-	ret = threadlist_isempty(&wc->wc_threads);
-	spinlock_release(&wc->wc_lock);
+	struct waitbucket *wb = waitq_bucket(key);
+	struct threadlistnode *tln;
+	bool ret = true;
+
+	spinlock_acquire(&wb->wb_lock);
+	for (tln = wb->wb_threads.tl_head.tln_next; tln->tln_next != NULL;
+	     tln = tln->tln_next) {
+		if (tln->tln_self->t_wchan == key) {
+			ret = false;
+			break;
+		}
+	}
+	spinlock_release(&wb->wb_lock);
 
 	return ret;
 }
 
+/*
+ * Timeout function for waitq_timer: if the thread is still asleep on
+ * the key, take it off and wake it.
+ *
+ * The sleeper doesn't leave its timed wait until wt_done is set (see
+ * waitq_timer_stop), so the timer stays valid until then; after
+ * setting it we must not touch it.
+ */
+static
+void
+waitq_timer_expire(void *data, unsigned long junk)
+{
+	struct waitq_timer *wt = data;
+	struct waitbucket *wb = waitq_bucket(wt->wt_key);
+	struct thread *target = NULL;
+
+	(void)junk;
+
+	spinlock_acquire(&wb->wb_lock);
+	wt->wt_expired = true;
+	if (wt->wt_thread->t_wchan == wt->wt_key) {
+		target = wt->wt_thread;
+		threadlist_remove(&wb->wb_threads, target);
+		target->t_wchan = NULL;
+	}
+	spinlock_release(&wb->wb_lock);
+
+	if (target != NULL) {
+		thread_make_runnable(target, false);
+	}
+	wt->wt_done = true;
+}
+
+void
+waitq_timer_start(struct waitq_timer *wt, const void *key, unsigned ticks)
+{
+	timeout_init(&wt->wt_timeout, waitq_timer_expire, wt, 0);
+	wt->wt_key = key;
+	wt->wt_thread = curthread;
+	wt->wt_expired = (ticks == 0);
+	wt->wt_done = wt->wt_expired;
+	if (ticks > 0) {
+		timeout_add(&wt->wt_timeout, ticks);
+	}
+}
+
+int
+waitq_sleep_timed(struct waitq_timer *wt, const char *name)
+{
+	KASSERT(spinlock_do_i_hold(&waitq_bucket(wt->wt_key)->wb_lock));
+	KASSERT(wt->wt_thread == curthread);
+
+	/* Checked with the queue locked, so we can't miss the expiry */
+	if (wt->wt_expired) {
+		waitq_unlock(wt->wt_key);
+		return ETIMEDOUT;
+	}
+	waitq_sleep(wt->wt_key, name);
+	return wt->wt_expired ? ETIMEDOUT : 0;
+}
+
+int
+waitq_sleep_timed_killable(struct waitq_timer *wt, const char *name)
+{
+	KASSERT(spinlock_do_i_hold(&waitq_bucket(wt->wt_key)->wb_lock));
+	KASSERT(wt->wt_thread == curthread);
+
+	if (wt->wt_expired) {
+		waitq_unlock(wt->wt_key);
+		return ETIMEDOUT;
+	}
+	if (waitq_sleep_killable(wt->wt_key, name)) {
+		return EINTR;
+	}
+	return wt->wt_expired ? ETIMEDOUT : 0;
+}
+
+void
+waitq_timer_stop(struct waitq_timer *wt)
+{
+	if (timeout_cancel(&wt->wt_timeout)) {
+		return;
+	}
+	/*
+	 * Too late: it has run or is running, maybe on another cpu.
+	 * It's short and can't sleep, so just wait it out.
+	 */
+	while (!wt->wt_done) {
+		/* spin */
+	}
+}
+
+/*
+ * Wait channel functions. A wait channel is a named key of its own,
+ * for sleeping on when there's no more natural object to use.
+ */
+
+/*
+ * Create a wait channel. NAME is a symbolic string name for it.
+ * This is what's displayed by ps -alx in Unix.
+ *
+ * NAME should generally be a string constant. If it isn't, alternate
+ * arrangements should be made to free it after the wait channel is
+ * destroyed.
+ */
+struct wchan *
+wchan_create(const char *name)
+{
+	struct wchan *wc;
+
+	wc = kmalloc(sizeof(*wc));
+	if (wc == NULL) {
+		return NULL;
+	}
+	wc->wc_name = name;
+	return wc;
+}
+
+/*
+ * Destroy a wait channel. Must be empty and unlocked.
+ */
+void
+wchan_destroy(struct wchan *wc)
+{
+	KASSERT(waitq_isempty(wc));
+	kfree(wc);
+}
+
+void
+wchan_lock(struct wchan *wc)
+{
+	waitq_lock(wc);
+}
+
+void
+wchan_unlock(struct wchan *wc)
+{
+	waitq_unlock(wc);
+}
+
+void
+wchan_sleep(struct wchan *wc)
+{
+	waitq_sleep(wc, wc->wc_name);
+}
+
+void
+wchan_wakeone(struct wchan *wc)
+{
+	waitq_wakeone(wc);
+}
+
+struct thread *
+wchan_wakehead(struct wchan *wc)
+{
+	return waitq_wakehead(wc);
+}
+
+void
+wchan_wakeall(struct wchan *wc)
+{
+	waitq_wakeall(wc);
+}
+
+bool
+wchan_isempty(struct wchan *wc)
+{
+	return waitq_isempty(wc);
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -1189,7 +2226,7 @@ interprocessor_interrupt(void)
 	if (bits & (1U << IPI_UNIDLE)) {
 		/*
 		 * The cpu has already unidled itself to take the
-		 * interrupt; don't need to do anything else.
+		 * interrupt; staged wakeups are collected below.
 		 */
 	}
 	if (bits & (1U << IPI_TLBSHOOTDOWN)) {
@@ -1206,4 +2243,15 @@ interprocessor_interrupt(void)
 
 	curcpu->c_ipi_pending = 0;
 	spinlock_release(&curcpu->c_ipi_lock);
+
+	/*
+	 * Collect threads woken for us by other cpus. This has to wait
+	 * until the IPI lock is released, because ipi_send can be
+	 * called with a run queue lock held.
+	 */
+	if (bits & (1U << IPI_UNIDLE)) {
+		spinlock_acquire(&curcpu->c_runqueue_lock);
+		thread_take_wakeups(curcpu);
+		spinlock_release(&curcpu->c_runqueue_lock);
+	}
 }
@@ -0,0 +1,255 @@
+/*
+ * Timeouts, kept in a per-cpu hierarchical timer wheel.
+ *
+ * Level 0 of the wheel has one slot per tick for the next TW_SIZE
+ * ticks. Each level above has slots TW_SIZE times as wide. A timeout
+ * goes in the lowest level whose range covers it; whenever level 0
+ * wraps around, the next slot of level 1 is emptied and its timeouts
+ * redistributed ("cascaded") into level 0, and likewise up the
+ * levels. Timeouts further off than the whole wheel spans wait in
+ * the top level and get cascaded back into it as needed.
+ *
+ * Slots are doubly linked lists so a timeout can be cancelled without
+ * searching for it.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <current.h>
+#include <timeout.h>
+
+#define TW_BITS    6
+#define TW_SIZE    (1U << TW_BITS)
+#define TW_MASK    (TW_SIZE - 1)
+#define TW_LEVELS  4
+#define TW_SPAN    (1U << (TW_BITS * TW_LEVELS))	/* in ticks */
+
+struct timeoutwheel {
+	struct spinlock tw_lock;
+	unsigned tw_now;		/* Next tick to be processed */
+	struct timeout *tw_slots[TW_LEVELS][TW_SIZE];
+	struct timeout *tw_due;		/* Being run by timeout_hardclock */
+};
+
+/* One per cpu, indexed by c_number; NULL until bootstrap is done. */
+static struct timeoutwheel *wheels;
+
+/*
+ * Link TO onto list *HEAD.
+ */
+static
+void
+tw_link(struct timeout **head, struct timeout *to)
+{
+	to->to_next = *head;
+	if (to->to_next != NULL) {
+		to->to_next->to_prevp = &to->to_next;
+	}
+	to->to_prevp = head;
+	*head = to;
+}
+
+/*
+ * Unlink TO from whatever list it's on.
+ */
+static
+void
+tw_unlink(struct timeout *to)
+{
+	*to->to_prevp = to->to_next;
+	if (to->to_next != NULL) {
+		to->to_next->to_prevp = to->to_prevp;
+	}
+	to->to_next = NULL;
+	to->to_prevp = NULL;
+}
+
+/*
+ * Put TO in the right slot for its expiry time.
+ */
+static
+void
+tw_insert(struct timeoutwheel *tw, struct timeout *to)
+{
+	unsigned delta, when, level;
+
+	when = to->to_expires;
+	delta = when - tw->tw_now;
+	if (delta >= TW_SPAN) {
+		/* Park it as far out as we can see; it'll come back. */
+		delta = TW_SPAN - 1;
+		when = tw->tw_now + delta;
+	}
+
+	level = 0;
+	while (delta >= (1U << (TW_BITS * (level + 1)))) {
+		level++;
+	}
+	tw_link(&tw->tw_slots[level][(when >> (TW_BITS * level)) & TW_MASK],
+		to);
+}
+
+/*
+ * Empty the current slot of LEVEL into the levels below. Returns the
+ * slot index, so the caller knows whether this level wrapped too.
+ */
+static
+unsigned
+tw_cascade(struct timeoutwheel *tw, unsigned level)
+{
+	struct timeout *list, *to;
+	unsigned idx;
+
+	idx = (tw->tw_now >> (TW_BITS * level)) & TW_MASK;
+	list = tw->tw_slots[level][idx];
+	tw->tw_slots[level][idx] = NULL;
+	while (list != NULL) {
+		to = list;
+		list = to->to_next;
+		tw_insert(tw, to);
+	}
+	return idx;
+}
+
+void
+timeout_bootstrap(void)
+{
+	struct timeoutwheel *tw;
+	unsigned i, j, k, num;
+
+	num = cpu_count();
+	tw = kmalloc(num * sizeof(*tw));
+	if (tw == NULL) {
+		panic("timeout_bootstrap: Out of memory\n");
+	}
+	for (i=0; i<num; i++) {
+		spinlock_init(&tw[i].tw_lock);
+		spinlock_setname(&tw[i].tw_lock, "timeout");
+		tw[i].tw_now = 0;
+		for (j=0; j<TW_LEVELS; j++) {
+			for (k=0; k<TW_SIZE; k++) {
+				tw[i].tw_slots[j][k] = NULL;
+			}
+		}
+		tw[i].tw_due = NULL;
+	}
+	wheels = tw;
+}
+
+void
+timeout_init(struct timeout *to, void (*func)(void *, unsigned long),
+	     void *data1, unsigned long data2)
+{
+	to->to_next = NULL;
+	to->to_prevp = NULL;
+	to->to_wheel = NULL;
+	to->to_expires = 0;
+	to->to_func = func;
+	to->to_data1 = data1;
+	to->to_data2 = data2;
+}
+
+void
+timeout_add(struct timeout *to, unsigned ticks)
+{
+	struct timeoutwheel *tw;
+
+	KASSERT(wheels != NULL);
+	KASSERT(to->to_wheel == NULL);
+	KASSERT(ticks <= TIMEOUT_MAXTICKS);
+
+	if (ticks == 0) {
+		ticks = 1;
+	}
+
+	tw = &wheels[curcpu->c_number];
+	spinlock_acquire(&tw->tw_lock);
+	to->to_expires = tw->tw_now + ticks - 1;
+	to->to_wheel = tw;
+	tw_insert(tw, to);
+	spinlock_release(&tw->tw_lock);
+}
+
+bool
+timeout_cancel(struct timeout *to)
+{
+	struct timeoutwheel *tw;
+	bool ret;
+
+	tw = to->to_wheel;
+	if (tw == NULL) {
+		return false;
+	}
+
+	spinlock_acquire(&tw->tw_lock);
+	/* It may have fired while we were getting the lock. */
+	ret = (to->to_wheel == tw);
+	if (ret) {
+		tw_unlink(to);
+		to->to_wheel = NULL;
+	}
+	spinlock_release(&tw->tw_lock);
+
+	return ret;
+}
+
+/*
+ * Advance the current cpu's wheel by one tick and run whatever is due.
+ *
+ * The due list is moved aside and tw_now advanced before anything
+ * runs, so timeouts added by the functions we call (or by other cpus
+ * meanwhile) can't land in it. Each timeout is unlinked and its
+ * function copied out under the lock, so once it's off the list its
+ * owner is free to reuse it.
+ */
+void
+timeout_hardclock(void)
+{
+	struct timeoutwheel *tw;
+	struct timeout *to;
+	void (*func)(void *, unsigned long);
+	void *data1;
+	unsigned long data2;
+	unsigned idx, level;
+
+	if (wheels == NULL) {
+		return;
+	}
+	tw = &wheels[curcpu->c_number];
+
+	spinlock_acquire(&tw->tw_lock);
+
+	idx = tw->tw_now & TW_MASK;
+	if (idx == 0) {
+		for (level = 1; level < TW_LEVELS; level++) {
+			if (tw_cascade(tw, level) != 0) {
+				break;
+			}
+		}
+	}
+
+	KASSERT(tw->tw_due == NULL);
+	tw->tw_due = tw->tw_slots[0][idx];
+	if (tw->tw_due != NULL) {
+		tw->tw_due->to_prevp = &tw->tw_due;
+	}
+	tw->tw_slots[0][idx] = NULL;
+	tw->tw_now++;
+
+	while ((to = tw->tw_due) != NULL) {
+		KASSERT(to->to_expires == tw->tw_now - 1);
+		tw_unlink(to);
+		to->to_wheel = NULL;
+		func = to->to_func;
+		data1 = to->to_data1;
+		data2 = to->to_data2;
+
+		spinlock_release(&tw->tw_lock);
+		func(data1, data2);
+		spinlock_acquire(&tw->tw_lock);
+	}
+
+	spinlock_release(&tw->tw_lock);
+}
@@ -0,0 +1,161 @@
+/*
+ * Kernel workqueues: one worker thread per cpu running deferred work.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <workqueue.h>
+
+/*
+ * One queued call.
+ */
+struct work {
+	struct work *w_next;
+	void (*w_func)(void *, unsigned long);
+	void *w_data1;
+	unsigned long w_data2;
+};
+
+/*
+ * Per-cpu queue. The list is FIFO: new work goes on the tail, the
+ * worker takes the whole list at once.
+ *
+ * Lock order is wq_lock, then the wchan lock, as for semaphores.
+ */
+struct workqueue {
+	struct spinlock wq_lock;
+	struct work *wq_head;
+	struct work *wq_tail;
+	struct wchan *wq_wchan;		/* Worker sleeps here when idle */
+};
+
+/* One per cpu, indexed by c_number; NULL until bootstrap is done. */
+static struct workqueue *workqueues;
+static unsigned numworkqueues;
+
+/*
+ * Worker thread. DATA2 is the cpu number it serves (and is bound to).
+ */
+static
+void
+workqueue_worker(void *data1, unsigned long data2)
+{
+	struct workqueue *wq = data1;
+	struct work *batch, *w;
+
+	(void)data2;
+
+	while (1) {
+		spinlock_acquire(&wq->wq_lock);
+		while (wq->wq_head == NULL) {
+			wchan_lock(wq->wq_wchan);
+			spinlock_release(&wq->wq_lock);
+			wchan_sleep(wq->wq_wchan);
+			spinlock_acquire(&wq->wq_lock);
+		}
+		batch = wq->wq_head;
+		wq->wq_head = wq->wq_tail = NULL;
+		spinlock_release(&wq->wq_lock);
+
+		while (batch != NULL) {
+			w = batch;
+			batch = w->w_next;
+			w->w_func(w->w_data1, w->w_data2);
+			kfree(w);
+		}
+	}
+}
+
+void
+workqueue_bootstrap(void)
+{
+	struct workqueue *wq;
+	unsigned i, num;
+	char name[16];
+	int result;
+
+	num = cpu_count();
+	wq = kmalloc(num * sizeof(*wq));
+	if (wq == NULL) {
+		panic("workqueue_bootstrap: Out of memory\n");
+	}
+
+	for (i=0; i<num; i++) {
+		spinlock_init(&wq[i].wq_lock);
+		spinlock_setname(&wq[i].wq_lock, "workqueue");
+		wq[i].wq_head = wq[i].wq_tail = NULL;
+		wq[i].wq_wchan = wchan_create("workqueue");
+		if (wq[i].wq_wchan == NULL) {
+			panic("workqueue_bootstrap: Out of memory\n");
+		}
+	}
+
+	for (i=0; i<num; i++) {
+		snprintf(name, sizeof(name), "worker/%u", i);
+		result = thread_fork_bound(name, NULL, i, workqueue_worker,
+					   &wq[i], i);
+		if (result) {
+			panic("workqueue_bootstrap: thread_fork_bound: %s\n",
+			      strerror(result));
+		}
+	}
+
+	/* Only now start handing out work. */
+	numworkqueues = num;
+	workqueues = wq;
+}
+
+int
+workqueue_submit(int cpunum, void (*func)(void *, unsigned long),
+		 void *data1, unsigned long data2)
+{
+	struct workqueue *wq;
+	struct work *w;
+	bool wasempty;
+
+	if (workqueues == NULL) {
+		func(data1, data2);
+		return 0;
+	}
+
+	if (cpunum == WQ_ANYCPU) {
+		cpunum = curcpu->c_number;
+	}
+	KASSERT(cpunum >= 0 && (unsigned)cpunum < numworkqueues);
+	wq = &workqueues[cpunum];
+
+	w = kmalloc(sizeof(*w));
+	if (w == NULL) {
+		return ENOMEM;
+	}
+	w->w_next = NULL;
+	w->w_func = func;
+	w->w_data1 = data1;
+	w->w_data2 = data2;
+
+	spinlock_acquire(&wq->wq_lock);
+	wasempty = (wq->wq_head == NULL);
+	if (wasempty) {
+		wq->wq_head = w;
+	}
+	else {
+		wq->wq_tail->w_next = w;
+	}
+	wq->wq_tail = w;
+	/*
+	 * If the queue already had work in it, the worker has been
+	 * woken already and will pick this up in the same batch.
+	 */
+	if (wasempty) {
+		wchan_wakeone(wq->wq_wchan);
+	}
+	spinlock_release(&wq->wq_lock);
+
+	return 0;
+}
@@ -87,17 +87,18 @@
  */
 
 /*
- * Recovery function. If a fatal fault occurs during copyin, copyout,
- * copyinstr, or copyoutstr, execution resumes here. (This behavior is
- * caused by setting t_machdep.tm_badfaultfunc and is implemented in
- * machine-dependent code.)
+ * Recovery function. If a fatal fault occurs between
+ * user_access_begin and user_access_end, which includes inside
+ * copyin, copyout, copyinstr, and copyoutstr, execution resumes here.
+ * (This behavior is caused by setting t_machdep.tm_badfaultfunc and
+ * is implemented in machine-dependent code.)
  *
  * We use the C standard function longjmp() to teleport up the call
- * stack to where setjmp() was called. At that point we return EFAULT.
+ * stack to where setjmp() was called, in user_access_begin. At that
+ * point the caller's fail label returns EFAULT.
  */
-static
 void
-copyfail(void)
+user_access_fail(void)
 {
 	longjmp(curthread->t_machdep.tm_copyjmp, 1);
 }
@@ -143,14 +144,47 @@ copycheck(const_userptr_t userptr, size_t len, size_t *stoplen)
 }
 
 /*
- * copyin
+ * Copy memory for copyin and copyout. memcpy only goes a word at a
+ * time when the length is a whole number of words too; here, as long
+ * as the two addresses are aligned alike, copy any odd bytes at the
+ * ends by themselves and the rest by words.
+ */
+static
+void
+copymem(void *dst, const void *src, size_t len)
+{
+	char *d = dst;
+	const char *s = src;
+	size_t i, nwords;
+
+	if (((uintptr_t)d ^ (uintptr_t)s) % sizeof(long) == 0) {
+		while (len > 0 && (uintptr_t)d % sizeof(long) != 0) {
+			*d++ = *s++;
+			len--;
+		}
+		nwords = len / sizeof(long);
+		for (i=0; i<nwords; i++) {
+			((long *)d)[i] = ((const long *)s)[i];
+		}
+		d += nwords * sizeof(long);
+		s += nwords * sizeof(long);
+		len -= nwords * sizeof(long);
+	}
+	while (len > 0) {
+		*d++ = *s++;
+		len--;
+	}
+}
+
+/*
+ * user_copyin
  *
- * Copy a block of memory of length LEN from user-level address USERSRC 
- * to kernel address DEST. We can use memcpy because it's protected by
- * the tm_badfaultfunc/copyfail logic.
+ * Copy a block of memory of length LEN from user-level address USERSRC
+ * to kernel address DEST. Only between user_access_begin and
+ * user_access_end, which catch any fault.
  */
 int
-copyin(const_userptr_t usersrc, void *dest, size_t len)
+user_copyin(const_userptr_t usersrc, void *dest, size_t len)
 {
 	int result;
 	size_t stoplen;
@@ -164,29 +198,19 @@ copyin(const_userptr_t usersrc, void *dest, size_t len)
 		return EFAULT;
 	}
 
-	curthread->t_machdep.tm_badfaultfunc = copyfail;
-
-	result = setjmp(curthread->t_machdep.tm_copyjmp);
-	if (result) {
-		curthread->t_machdep.tm_badfaultfunc = NULL;
-		return EFAULT;
-	}
-
-	memcpy(dest, (const void *)usersrc, len);
-
-	curthread->t_machdep.tm_badfaultfunc = NULL;
+	copymem(dest, (const void *)usersrc, len);
 	return 0;
 }
 
 /*
- * copyout
+ * user_copyout
  *
  * Copy a block of memory of length LEN from kernel address SRC to
- * user-level address USERDEST. We can use memcpy because it's
- * protected by the tm_badfaultfunc/copyfail logic.
+ * user-level address USERDEST. Only between user_access_begin and
+ * user_access_end, which catch any fault.
  */
 int
-copyout(const void *src, userptr_t userdest, size_t len)
+user_copyout(const void *src, userptr_t userdest, size_t len)
 {
 	int result;
 	size_t stoplen;
@@ -200,20 +224,13 @@ copyout(const void *src, userptr_t userdest, size_t len)
 		return EFAULT;
 	}
 
-	curthread->t_machdep.tm_badfaultfunc = copyfail;
-
-	result = setjmp(curthread->t_machdep.tm_copyjmp);
-	if (result) {
-		curthread->t_machdep.tm_badfaultfunc = NULL;
-		return EFAULT;
-	}
-
-	memcpy((void *)userdest, src, len);
-
-	curthread->t_machdep.tm_badfaultfunc = NULL;
+	copymem((void *)userdest, src, len);
 	return 0;
 }
 
+/* True if any byte of the 32-bit word W is zero. */
+#define HASZERO(w)  ((((w) - 0x01010101U) & ~(w) & 0x80808080U) != 0)
+
 /*
  * Common string copying function that behaves the way that's desired
  * for copyinstr and copyoutstr.
@@ -229,21 +246,45 @@ copyout(const void *src, userptr_t userdest, size_t len)
  * hit STOPLEN it's because the string has run into the end of
  * userspace. Thus in the latter case we return EFAULT, not 
  * ENAMETOOLONG.
+ *
+ * If SRC and DEST are aligned alike, the string is moved a word at a
+ * time until the word holding the terminator, and then finished by
+ * bytes. An aligned word never straddles a page, so this touches no
+ * page that the byte-by-byte copy wouldn't.
  */
 static
 int
 copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 	size_t *gotlen)
 {
-	size_t i;
+	size_t i, lim;
+	uint32_t w;
 
-	for (i=0; i<maxlen && i<stoplen; i++) {
+	lim = maxlen < stoplen ? maxlen : stoplen;
+	i = 0;
+
+	if (((uintptr_t)dest ^ (uintptr_t)src) % sizeof(uint32_t) == 0) {
+		while (i < lim && (uintptr_t)(src + i) % sizeof(uint32_t) != 0) {
+			dest[i] = src[i];
+			if (src[i] == 0) {
+				goto found;
+			}
+			i++;
+		}
+		while (lim - i >= sizeof(uint32_t)) {
+			w = *(const uint32_t *)(src + i);
+			if (HASZERO(w)) {
+				break;
+			}
+			*(uint32_t *)(dest + i) = w;
+			i += sizeof(uint32_t);
+		}
+	}
+
+	for (; i<lim; i++) {
 		dest[i] = src[i];
 		if (src[i] == 0) {
-			if (gotlen != NULL) {
-				*gotlen = i+1;
-			}
-			return 0;
+			goto found;
 		}
 	}
 	if (stoplen < maxlen) {
@@ -252,18 +293,24 @@ copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 	}
 	/* otherwise just ran out of space */
 	return ENAMETOOLONG;
+
+ found:
+	if (gotlen != NULL) {
+		*gotlen = i+1;
+	}
+	return 0;
 }
 
 /*
- * copyinstr
+ * user_copyinstr
  *
  * Copy a string from user-level address USERSRC to kernel address
- * DEST, as per copystr above. Uses the tm_badfaultfunc/copyfail
- * logic to protect against invalid addresses supplied by a user
- * process.
+ * DEST, as per copystr above. Only between user_access_begin and
+ * user_access_end.
  */
 int
-copyinstr(const_userptr_t usersrc, char *dest, size_t len, size_t *actual)
+user_copyinstr(const_userptr_t usersrc, char *dest, size_t len,
+	       size_t *actual)
 {
 	int result;
 	size_t stoplen;
@@ -272,31 +319,19 @@ copyinstr(const_userptr_t usersrc, char *dest, size_t len, size_t *actual)
 	if (result) {
 		return result;
 	}
-
-	curthread->t_machdep.tm_badfaultfunc = copyfail;
-
-	result = setjmp(curthread->t_machdep.tm_copyjmp);
-	if (result) {
-		curthread->t_machdep.tm_badfaultfunc = NULL;
-		return EFAULT;
-	}
-
-	result = copystr(dest, (const char *)usersrc, len, stoplen, actual);
-
-	curthread->t_machdep.tm_badfaultfunc = NULL;
-	return result;
+	return copystr(dest, (const char *)usersrc, len, stoplen, actual);
 }
 
 /*
- * copyoutstr
+ * user_copyoutstr
  *
  * Copy a string from kernel address SRC to user-level address
- * USERDEST, as per copystr above. Uses the tm_badfaultfunc/copyfail
- * logic to protect against invalid addresses supplied by a user
- * process.
+ * USERDEST, as per copystr above. Only between user_access_begin and
+ * user_access_end.
  */
 int
-copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *actual)
+user_copyoutstr(const char *src, userptr_t userdest, size_t len,
+		size_t *actual)
 {
 	int result;
 	size_t stoplen;
@@ -305,17 +340,65 @@ copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *actual)
 	if (result) {
 		return result;
 	}
+	return copystr((char *)userdest, src, len, stoplen, actual);
+}
 
-	curthread->t_machdep.tm_badfaultfunc = copyfail;
+/*
+ * copyin, copyout, copyinstr, and copyoutstr: each of the above in a
+ * user access window of its own.
+ */
+int
+copyin(const_userptr_t usersrc, void *dest, size_t len)
+{
+	int result;
 
-	result = setjmp(curthread->t_machdep.tm_copyjmp);
-	if (result) {
-		curthread->t_machdep.tm_badfaultfunc = NULL;
-		return EFAULT;
-	}
+	user_access_begin(fail);
+	result = user_copyin(usersrc, dest, len);
+	user_access_end();
+	return result;
+
+ fail:
+	return EFAULT;
+}
+
+int
+copyout(const void *src, userptr_t userdest, size_t len)
+{
+	int result;
 
-	result = copystr((char *)userdest, src, len, stoplen, actual);
+	user_access_begin(fail);
+	result = user_copyout(src, userdest, len);
+	user_access_end();
+	return result;
+
+ fail:
+	return EFAULT;
+}
+
+int
+copyinstr(const_userptr_t usersrc, char *dest, size_t len, size_t *actual)
+{
+	int result;
 
-	curthread->t_machdep.tm_badfaultfunc = NULL;
+	user_access_begin(fail);
+	result = user_copyinstr(usersrc, dest, len, actual);
+	user_access_end();
 	return result;
+
+ fail:
+	return EFAULT;
+}
+
+int
+copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *actual)
+{
+	int result;
+
+	user_access_begin(fail);
+	result = user_copyoutstr(src, userdest, len, actual);
+	user_access_end();
+	return result;
+
+ fail:
+	return EFAULT;
 }
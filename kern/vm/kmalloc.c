@@ -31,6 +31,7 @@
 #include <lib.h>
 #include <spinlock.h>
 #include <vm.h>
+#include <thread.h>	/* for thread_cache_shrink */
 
 /*
  * Kernel malloc.
@@ -195,7 +196,7 @@ static struct pageref *allbase;
  * OS/161 performance and scalability aren't super-critical.
  */
 
-static struct spinlock kmalloc_spinlock = SPINLOCK_INITIALIZER;
+static struct spinlock kmalloc_spinlock = SPINLOCK_MCS_INITIALIZER("kmalloc");
 
 ////////////////////////////////////////
 
@@ -461,6 +462,10 @@ subpage_kmalloc(size_t sz)
 
 	spinlock_release(&kmalloc_spinlock);
 	prpage = alloc_kpages(1);
+	if (prpage==0 && thread_cache_shrink() > 0) {
+		/* Freed some cached thread stacks; try again. */
+		prpage = alloc_kpages(1);
+	}
 	if (prpage==0) {
 		/* Out of memory. */
 		kprintf("kmalloc: Subpage allocator couldn't get a page\n"); 
@@ -608,6 +613,10 @@ kmalloc(size_t sz)
 		/* Round up to a whole number of pages. */
 		npages = (sz + PAGE_SIZE - 1)/PAGE_SIZE;
 		address = alloc_kpages(npages);
+		if (address==0 && thread_cache_shrink() > 0) {
+			/* Freed some cached thread stacks; try again. */
+			address = alloc_kpages(npages);
+		}
 		if (address==0) {
 			return NULL;
 		}
@@ -0,0 +1,106 @@
+/*
+ * sgcp - copy a file, with scatter/gather I/O.
+ * Usage: sgcp oldfile newfile
+ *
+ * Does the same as cp, but moves NBUFS buffers' worth of data per
+ * system call with readv and writev instead of one small buffer per
+ * read and write.
+ */
+
+#include <sys/uio.h>
+#include <unistd.h>
+#include <err.h>
+
+#define NBUFS   16
+#define BUFSIZE 4096
+
+static char bufs[NBUFS][BUFSIZE];
+
+/*
+ * Write out the first LEN bytes described by IOV. writev may write
+ * less than asked, so after a short write, drop the iovecs that are
+ * done and trim the one it stopped in, and go again.
+ */
+static
+void
+writeall(int fd, const char *name, struct iovec *iov, int iovcnt, int len)
+{
+	int wr;
+
+	while (len > 0) {
+		wr = writev(fd, iov, iovcnt);
+		if (wr < 0) {
+			err(1, "%s", name);
+		}
+		len -= wr;
+		while (iovcnt > 0 && wr >= (int)iov->iov_len) {
+			wr -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + wr;
+			iov->iov_len -= wr;
+		}
+	}
+}
+
+/* Copy one file to another. */
+static
+void
+copy(const char *from, const char *to)
+{
+	struct iovec iov[NBUFS];
+	int fromfd, tofd;
+	int len, rem, i, n;
+
+	fromfd = open(from, O_RDONLY);
+	if (fromfd<0) {
+		err(1, "%s", from);
+	}
+	tofd = open(to, O_WRONLY|O_CREAT|O_TRUNC);
+	if (tofd<0) {
+		err(1, "%s", to);
+	}
+
+	while (1) {
+		for (i=0; i<NBUFS; i++) {
+			iov[i].iov_base = bufs[i];
+			iov[i].iov_len = BUFSIZE;
+		}
+		len = readv(fromfd, iov, NBUFS);
+		if (len < 0) {
+			err(1, "%s", from);
+		}
+		if (len == 0) {
+			break;
+		}
+
+		/* Only write back as many buffers as the read filled. */
+		rem = len;
+		for (n=0; rem > 0; n++) {
+			if (rem < BUFSIZE) {
+				iov[n].iov_len = rem;
+			}
+			rem -= iov[n].iov_len;
+		}
+		writeall(tofd, to, iov, n, len);
+	}
+
+	if (close(fromfd) < 0) {
+		err(1, "%s: close", from);
+	}
+	if (close(tofd) < 0) {
+		err(1, "%s: close", to);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc!=3) {
+		errx(1, "Usage: sgcp OLDFILE NEWFILE");
+	}
+	copy(argv[1], argv[2]);
+	return 0;
+}
@@ -39,6 +39,7 @@
 #include <sys/wait.h>
 #include <assert.h>
 #include <unistd.h>
+#include <spawn.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -308,6 +309,7 @@ docommand(char *buf)
 	char *s;
 	pid_t pid;
 	int status;
+	int result;
 	int bg=0;
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
@@ -354,29 +356,18 @@ docommand(char *buf)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			return _MKWAIT_EXIT(255);
-		case 0:
-			/* child */
-			execv(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
-			break;
-	}
-
-	/* parent */
+	/*
+	 * Start the command with posix_spawn rather than fork and
+	 * execv, so we don't copy our whole address space just to
+	 * throw it away again.
+	 */
+	result = posix_spawn(&pid, args[0], NULL, NULL, args, NULL);
+	if (result) {
+		errno = result;
+		warn("%s", args[0]);
+		return _MKWAIT_EXIT(1);
+	}
+
 	if (bg) {
 		/* background this command */
 		remember_bg(pid);
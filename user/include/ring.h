@@ -0,0 +1,17 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+/*
+ * System call submission ring: queue several calls in shared memory
+ * and run them all with one trap. See <kern/ring.h> for the layout
+ * and the rules.
+ */
+#include <kern/ring.h>
+
+/* Map the ring; returns it, or (struct ring *)-1 on error. */
+struct ring *ring_setup(void);
+
+/* Run up to TO_SUBMIT queued entries; returns how many were run. */
+int ring_enter(unsigned to_submit);
+
+#endif /* _RING_H_ */
@@ -0,0 +1,27 @@
+#ifndef _SPAWN_H_
+#define _SPAWN_H_
+
+#include <sys/types.h>
+
+/*
+ * posix_spawn: start PATH with arguments ARGV as a new child process
+ * and put its pid in *PID, without the fork-then-exec round trip of
+ * copying our address space only to throw it away. Unlike most
+ * calls, it returns 0 or an error number rather than setting errno.
+ *
+ * File actions and spawn attributes aren't supported: pass NULL for
+ * both. There are no environments, so ENVP is ignored. The child
+ * inherits our open files and current directory, as after fork.
+ */
+typedef struct __posix_spawn_file_actions posix_spawn_file_actions_t;
+typedef struct __posix_spawnattr posix_spawnattr_t;
+
+int posix_spawn(pid_t *pid, const char *path,
+		const posix_spawn_file_actions_t *file_actions,
+		const posix_spawnattr_t *attrp,
+		char *const argv[], char *const envp[]);
+
+/* The system call behind it; returns the pid, or -1 and sets errno. */
+pid_t __spawn(const char *path, char *const *argv);
+
+#endif /* _SPAWN_H_ */
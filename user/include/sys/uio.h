@@ -0,0 +1,22 @@
+#ifndef _SYS_UIO_H_
+#define _SYS_UIO_H_
+
+#include <sys/types.h>
+
+/*
+ * Get struct iovec from the kernel.
+ */
+#include <kern/iovec.h>
+
+/*
+ * Scatter/gather I/O: like read and write, only with IOVCNT buffers
+ * (at most IOV_MAX) filled or drained in order in one call. preadv
+ * and pwritev work at POS, like pread and pwrite, and leave the seek
+ * position alone.
+ */
+int readv(int filehandle, const struct iovec *iov, int iovcnt);
+int writev(int filehandle, const struct iovec *iov, int iovcnt);
+int preadv(int filehandle, const struct iovec *iov, int iovcnt, off_t pos);
+int pwritev(int filehandle, const struct iovec *iov, int iovcnt, off_t pos);
+
+#endif /* _SYS_UIO_H_ */
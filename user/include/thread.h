@@ -0,0 +1,33 @@
+#ifndef _THREAD_H_
+#define _THREAD_H_
+
+/*
+ * Threads: more than one thread of control in a process, sharing its
+ * memory and open files, and running on as many cpus as there are.
+ *
+ * thread_create runs FUNC(ARG) in a new thread and returns its id, or
+ * -1 and sets errno (EAGAIN if there are too many threads). The
+ * thread ends when FUNC returns, or when it calls thread_exit;
+ * thread_join waits for that and collects the value. Every thread
+ * should be joined, or its id isn't freed. The thread that started
+ * the process is thread 0.
+ *
+ * The last thread to exit ends the process, as if by exit(0). _exit,
+ * exit, execv, and a fatal fault in any thread end all the others.
+ * Each thread gets a 32k stack.
+ *
+ * libc is not thread-safe: errno is shared, and no two threads should
+ * be in malloc, free or the same stdio stream at once.
+ */
+
+#include <unistd.h>	/* for __DEAD */
+
+int thread_create(void *(*func)(void *), void *arg);
+int thread_join(int tid, void **retval);
+__DEAD void thread_exit(void *retval);
+
+/* The system call behind thread_create. */
+int __thread_create(void (*entry)(void *(*)(void *), void *),
+		    void *(*func)(void *), void *arg);
+
+#endif /* _THREAD_H_ */
@@ -118,6 +118,13 @@
 __DEAD void _exit(int code);
 int execv(const char *prog, char *const *args);
 pid_t fork(void);
+/*
+ * vfork is fork without copying the address space: the child runs in
+ * ours, and we don't return until it calls execv or _exit, which are
+ * the only things it may safely do. For the common fork-then-exec,
+ * see also posix_spawn in spawn.h.
+ */
+pid_t vfork(void);
 int waitpid(pid_t pid, int *returncode, int flags);
 /* 
  * Open actually takes either two or three args: the optional third
@@ -151,7 +158,15 @@ int getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
+/* Read or write at POS without using or moving the seek position. */
+int pread(int filehandle, void *buf, size_t size, off_t pos);
+int pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+/* readv, writev, preadv, pwritev - see sys/uio.h */
 int pipe(int filehandles[2]);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+/* Cpu affinity masks have one bit per cpu; pid 0 means the caller. */
+int sched_setaffinity(pid_t pid, unsigned mask);
+int sched_getaffinity(pid_t pid, unsigned *mask);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
 int __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
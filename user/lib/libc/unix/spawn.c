@@ -0,0 +1,34 @@
+/*
+ * posix_spawn, on top of the __spawn system call.
+ */
+
+#include <spawn.h>
+#include <errno.h>
+
+int
+posix_spawn(pid_t *pid, const char *path,
+	    const posix_spawn_file_actions_t *file_actions,
+	    const posix_spawnattr_t *attrp,
+	    char *const argv[], char *const envp[])
+{
+	pid_t child;
+	int saved;
+
+	(void)envp;
+
+	if (file_actions != NULL || attrp != NULL) {
+		return ENOSYS;
+	}
+
+	saved = errno;
+	child = __spawn(path, argv);
+	if (child < 0) {
+		child = errno;
+		errno = saved;
+		return child;
+	}
+	if (pid != NULL) {
+		*pid = child;
+	}
+	return 0;
+}
@@ -0,0 +1,22 @@
+/*
+ * thread_create, on top of the __thread_create system call.
+ */
+
+#include <thread.h>
+
+/*
+ * Where every new thread starts. The kernel sets it going with FUNC
+ * and ARG as arguments, and with nowhere to return to.
+ */
+static
+void
+thread_start(void *(*func)(void *), void *arg)
+{
+	thread_exit(func(arg));
+}
+
+int
+thread_create(void *(*func)(void *), void *arg)
+{
+	return __thread_create(thread_start, func, arg);
+}
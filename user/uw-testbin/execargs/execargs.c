@@ -0,0 +1,101 @@
+/*
+ * execargs
+ *
+ *	time execv with a big argument list
+ *
+ *   relies on fork, execv, waitpid, open, dup2 and __time
+ *
+ *   Each child sends its output to null: and execs /testbin/argtest
+ *   with nargs arguments; the parent waits for it and checks that it
+ *   exited cleanly. Usage: execargs [count [nargs]]; the defaults are
+ *   20 execs of 1000 arguments each.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+#include "../lib/testutils.h"
+
+#define DEFAULT_COUNT  20
+#define DEFAULT_NARGS  1000
+#define MAX_NARGS      4000
+#define PROG           "/testbin/argtest"
+
+static char *xargv[MAX_NARGS + 2];
+static char argstore[MAX_NARGS][8];
+
+static
+void
+child(void)
+{
+	int fd;
+
+	fd = open("null:", O_WRONLY);
+	if (fd < 0) {
+		err(1, "null:");
+	}
+	if (dup2(fd, STDOUT_FILENO) < 0) {
+		err(1, "dup2");
+	}
+	close(fd);
+	execv(PROG, xargv);
+	err(1, "%s", PROG);
+}
+
+int
+main(int argc, char *argv[])
+{
+	time_t s1, s2;
+	unsigned long ns1, ns2, msec;
+	int count, nargs, i, status, errors;
+	pid_t pid;
+
+	count = DEFAULT_COUNT;
+	nargs = DEFAULT_NARGS;
+	if (argc > 1) {
+		count = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		nargs = atoi(argv[2]);
+	}
+	if (count <= 0 || nargs <= 0 || nargs > MAX_NARGS) {
+		errx(1, "Usage: execargs [count [nargs]]");
+	}
+
+	xargv[0] = (char *)PROG;
+	for (i=0; i<nargs; i++) {
+		snprintf(argstore[i], sizeof(argstore[i]), "a%d", i);
+		xargv[i+1] = argstore[i];
+	}
+	xargv[nargs+1] = NULL;
+
+	errors = 0;
+	__time(&s1, &ns1);
+	for (i=0; i<count; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			child();
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			warn("waitpid %d", pid);
+			errors++;
+			continue;
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			warnx("pid %d: bad exit status 0x%x", pid, status);
+			errors++;
+		}
+	}
+	__time(&s2, &ns2);
+
+	msec = elapsed_usec(s1, ns1, s2, ns2) / 1000;
+	printf("execargs: %d execs of %d args in %lu ms (%lu us each), "
+	       "%d errors\n", count, nargs, msec,
+	       msec * 1000 / count, errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * forkreap
+ *
+ *	fork and reap lots of children, to exercise pid allocation,
+ *	reuse and lookup
+ *
+ *   relies on fork, _exit, waitpid and __time
+ *
+ *   Children are made in batches and waited for in reverse order,
+ *   so waitpid has to find a child among many live siblings. Each
+ *   child exits with a status derived from its index, which the
+ *   parent checks. Usage: forkreap [count]; the default is 10000.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+#include "../lib/testutils.h"
+
+#define DEFAULT_COUNT  10000
+#define BATCH          50
+
+int
+main(int argc, char *argv[])
+{
+	pid_t pids[BATCH];
+	pid_t maxpid;
+	time_t s1, s2;
+	unsigned long ns1, ns2, msec;
+	int count, done, n, i, status, errors;
+
+	count = DEFAULT_COUNT;
+	if (argc > 1) {
+		count = atoi(argv[1]);
+	}
+	if (count <= 0) {
+		errx(1, "Usage: forkreap [count]");
+	}
+
+	errors = 0;
+	maxpid = 0;
+	__time(&s1, &ns1);
+	for (done = 0; done < count; done += n) {
+		n = count - done < BATCH ? count - done : BATCH;
+		for (i=0; i<n; i++) {
+			pids[i] = fork();
+			if (pids[i] < 0) {
+				err(1, "fork");
+			}
+			if (pids[i] == 0) {
+				_exit((done + i) & 0xff);
+			}
+			if (pids[i] > maxpid) {
+				maxpid = pids[i];
+			}
+		}
+		for (i=n-1; i>=0; i--) {
+			if (waitpid(pids[i], &status, 0) < 0) {
+				warn("waitpid %d", pids[i]);
+				errors++;
+				continue;
+			}
+			if (!WIFEXITED(status) ||
+			    WEXITSTATUS(status) != ((done + i) & 0xff)) {
+				warnx("pid %d: bad exit status 0x%x",
+				      pids[i], status);
+				errors++;
+			}
+		}
+		if (done % 1000 < BATCH) {
+			printf(".");
+		}
+	}
+	__time(&s2, &ns2);
+
+	msec = elapsed_usec(s1, ns1, s2, ns2) / 1000;
+	printf("\nforkreap: %d children in %lu ms (%lu per second), "
+	       "highest pid %d, %d errors\n", count, msec,
+	       msec ? (unsigned long)count * 1000 / msec : 0,
+	       maxpid, errors);
+	return errors ? 1 : 0;
+}
@@ -225,3 +225,25 @@ main()
    printf("Should have 7 passes and 7 failures\n");
 }
 #endif /* UNIT_TEST */
+
+/* Elapsed time from (s1,ns1) to (s2,ns2), in microseconds */
+unsigned long
+elapsed_usec(time_t s1, unsigned long ns1, time_t s2, unsigned long ns2)
+{
+  if (ns2 < ns1) {
+    ns2 += 1000000000;
+    s2--;
+  }
+  return (unsigned long)(s2 - s1) * 1000000 + (ns2 - ns1) / 1000;
+}
+
+/* The same, in nanoseconds */
+unsigned long
+elapsed_nsec(time_t s1, unsigned long ns1, time_t s2, unsigned long ns2)
+{
+  if (ns2 < ns1) {
+    ns2 += 1000000000;
+    s2--;
+  }
+  return (unsigned long)(s2 - s1) * 1000000000 + (ns2 - ns1);
+}
@@ -1,6 +1,8 @@
 #ifndef TESTUTILS_H
 #define TESTUTILS_H
 
+#include <sys/types.h>
+
 #define SUCCESS     (0)
 
 #define TEST_EQUAL(a, b, s)  \
@@ -42,4 +44,14 @@ void test_reset_stats(void);
 void test_verbose_on(void);
 void test_verbose_off(void);
 
+/*
+ * Time from one __time reading (s1, ns1) to a later one (s2, ns2).
+ * elapsed_usec is good for about 71 minutes, elapsed_nsec for about
+ * 4 seconds.
+ */
+unsigned long elapsed_usec(time_t s1, unsigned long ns1,
+     time_t s2, unsigned long ns2);
+unsigned long elapsed_nsec(time_t s1, unsigned long ns1,
+     time_t s2, unsigned long ns2);
+
 #endif /* TESTUTILS_H */
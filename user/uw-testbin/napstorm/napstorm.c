@@ -0,0 +1,79 @@
+/*
+ * napstorm
+ *
+ *	many processes doing short nanosleeps at once
+ *
+ *   relies on fork, waitpid, _exit, __time and nanosleep
+ *
+ *   Each child sleeps NNAPS times for a different short interval and
+ *   reports how long past its deadline it woke up, on average. If
+ *   every tick woke every sleeper, the oversleep would grow with the
+ *   number of children; with per-thread timeouts it should stay
+ *   around one clock tick no matter how many there are.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+#include "../lib/testutils.h"
+
+#define NCHILDREN  16
+#define NNAPS      20
+
+static
+void
+napper(int num)
+{
+	struct timespec ts;
+	time_t s1, s2;
+	unsigned long ns1, ns2, usec, want, over;
+	int i;
+
+	/* 10 to 85 msec, so the children's deadlines interleave */
+	want = 10000 + 5000 * num;
+	ts.tv_sec = 0;
+	ts.tv_nsec = want * 1000;
+
+	over = 0;
+	for (i=0; i<NNAPS; i++) {
+		__time(&s1, &ns1);
+		if (nanosleep(&ts, NULL)) {
+			err(1, "nanosleep");
+		}
+		__time(&s2, &ns2);
+
+		usec = elapsed_usec(s1, ns1, s2, ns2);
+		if (usec < want) {
+			errx(1, "child %d: woke %lu usec early", num,
+			     want - usec);
+		}
+		over += usec - want;
+	}
+	printf("napstorm: child %2d: %6lu usec naps, avg oversleep %lu usec\n",
+	       num, want, over / NNAPS);
+}
+
+int
+main(void)
+{
+	pid_t pids[NCHILDREN];
+	int i, status;
+
+	for (i=0; i<NCHILDREN; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			napper(i);
+			_exit(0);
+		}
+	}
+
+	for (i=0; i<NCHILDREN; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * pinmat
+ *
+ *	time matrix multiplications, unpinned and pinned to one cpu,
+ *	while cpu hogs keep the scheduler busy moving threads around
+ *
+ *   relies on fork, _exit, waitpid, __time, sched_setaffinity and
+ *   sched_getaffinity
+ *
+ *   Each round multiplies the same matrices once free to run on any
+ *   cpu and once pinned to the last cpu, alternating so both see the
+ *   same background load. An unpinned run can be migrated or stolen
+ *   partway through and lose its cache; a pinned one can't, so its
+ *   times should be more even. Prints the average, the spread and
+ *   the mean deviation of each.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+#include "../lib/testutils.h"
+
+#define Dim       32
+#define NMULTS    4	/* multiplications per timed run */
+#define NROUNDS   10
+#define HOGSECS   10	/* how long the background hogs run */
+#define MAXHOGS   16
+
+static int A[Dim][Dim];
+static int B[Dim][Dim];
+static int C[Dim][Dim];
+
+static unsigned long freetimes[NROUNDS];
+static unsigned long pintimes[NROUNDS];
+
+static
+void
+hog(void)
+{
+	time_t start, now;
+	unsigned long ns;
+	volatile unsigned long i;
+
+	__time(&start, &ns);
+	do {
+		for (i=0; i<100000; i++);
+		__time(&now, &ns);
+	} while (now - start < HOGSECS);
+	_exit(0);
+}
+
+static
+unsigned long
+timed_matmult(void)
+{
+	time_t s1, s2;
+	unsigned long ns1, ns2;
+	int i, j, k, n;
+
+	__time(&s1, &ns1);
+	for (n = 0; n < NMULTS; n++) {
+		for (i = 0; i < Dim; i++) {
+			for (j = 0; j < Dim; j++) {
+				C[i][j] = 0;
+				for (k = 0; k < Dim; k++) {
+					C[i][j] += A[i][k] * B[k][j];
+				}
+			}
+		}
+	}
+	__time(&s2, &ns2);
+	return elapsed_usec(s1, ns1, s2, ns2);
+}
+
+static
+void
+report(const char *what, unsigned long *times)
+{
+	unsigned long total, avg, min, max, dev;
+	int i;
+
+	total = max = 0;
+	min = times[0];
+	for (i=0; i<NROUNDS; i++) {
+		total += times[i];
+		if (times[i] < min) {
+			min = times[i];
+		}
+		if (times[i] > max) {
+			max = times[i];
+		}
+	}
+	avg = total / NROUNDS;
+
+	dev = 0;
+	for (i=0; i<NROUNDS; i++) {
+		dev += times[i] > avg ? times[i] - avg : avg - times[i];
+	}
+	dev /= NROUNDS;
+
+	printf("pinmat: %s: avg %lu usec, min %lu, max %lu, "
+	       "mean deviation %lu usec\n", what, avg, min, max, dev);
+}
+
+int
+main(void)
+{
+	unsigned allmask, pinmask;
+	pid_t pids[MAXHOGS];
+	int i, j, ncpus, nhogs, status;
+
+	if (sched_getaffinity(0, &allmask) < 0) {
+		err(1, "sched_getaffinity");
+	}
+	ncpus = 0;
+	pinmask = 0;
+	for (i=0; i<32; i++) {
+		if (allmask & (1U << i)) {
+			ncpus++;
+			pinmask = 1U << i;
+		}
+	}
+	printf("pinmat: %d cpus, pinning to mask 0x%x\n", ncpus, pinmask);
+
+	for (i = 0; i < Dim; i++) {
+		for (j = 0; j < Dim; j++) {
+			A[i][j] = i;
+			B[i][j] = j;
+		}
+	}
+
+	nhogs = 2 * ncpus;
+	if (nhogs > MAXHOGS) {
+		nhogs = MAXHOGS;
+	}
+	for (i=0; i<nhogs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			hog();
+		}
+	}
+
+	for (i=0; i<NROUNDS; i++) {
+		if (sched_setaffinity(0, allmask) < 0) {
+			err(1, "sched_setaffinity");
+		}
+		freetimes[i] = timed_matmult();
+
+		if (sched_setaffinity(0, pinmask) < 0) {
+			err(1, "sched_setaffinity");
+		}
+		pintimes[i] = timed_matmult();
+	}
+	sched_setaffinity(0, allmask);
+
+	report("unpinned", freetimes);
+	report("pinned  ", pintimes);
+
+	for (i=0; i<nhogs; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+		}
+	}
+	return 0;
+}
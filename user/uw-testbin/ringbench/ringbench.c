@@ -0,0 +1,151 @@
+/*
+ * ringbench
+ *
+ *	compare making system calls one trap at a time against
+ *	batching them through the submission ring
+ *
+ *   relies on open, write, getpid, ring_setup, ring_enter and __time
+ *
+ *   Does count one-byte writes to null:, and count getpids, first
+ *   with ordinary calls and then through the ring, batch at a time,
+ *   and prints the average cost of each. Every completion is
+ *   checked. Usage: ringbench [count [batch]]; the defaults are
+ *   10000 calls in batches of 32.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ring.h>
+#include <err.h>
+#include "../lib/testutils.h"
+
+#define DEFAULT_COUNT  10000
+#define DEFAULT_BATCH  32
+
+static time_t s1;
+static unsigned long ns1;
+
+static
+void
+start(void)
+{
+	__time(&s1, &ns1);
+}
+
+static
+void
+stop(const char *name, int count)
+{
+	time_t s2;
+	unsigned long ns2, nsec;
+
+	__time(&s2, &ns2);
+	/* good for about 4 seconds, plenty here */
+	nsec = elapsed_nsec(s1, ns1, s2, ns2);
+	printf("%-14s %8lu ns per call\n", name, nsec / count);
+}
+
+/*
+ * Run COUNT copies of the entry TEMPLATE through the ring, BATCH at a
+ * time, and check each result against WANT.
+ */
+static
+int
+ringrun(struct ring *r, const struct ring_sqe *template, int want,
+	int count, int batch)
+{
+	struct ring_cqe *cqe;
+	int done, n, i, ran, errors;
+
+	errors = 0;
+	for (done = 0; done < count; done += n) {
+		n = count - done < batch ? count - done : batch;
+		for (i=0; i<n; i++) {
+			r->r_sq[r->r_sqtail % RING_ENTRIES] = *template;
+			r->r_sq[r->r_sqtail % RING_ENTRIES].sqe_data = done + i;
+			r->r_sqtail++;
+		}
+		ran = ring_enter(n);
+		if (ran != n) {
+			errx(1, "ring_enter ran %d of %d", ran, n);
+		}
+		while (r->r_cqhead != r->r_cqtail) {
+			cqe = &r->r_cq[r->r_cqhead % RING_ENTRIES];
+			if (cqe->cqe_res != want) {
+				warnx("entry %u: got %d, expected %d",
+				      cqe->cqe_data, cqe->cqe_res, want);
+				errors++;
+			}
+			r->r_cqhead++;
+		}
+	}
+	return errors;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct ring *r;
+	struct ring_sqe sqe;
+	int count, batch, fd, i, errors;
+	pid_t pid;
+	char c = 'x';
+
+	count = DEFAULT_COUNT;
+	batch = DEFAULT_BATCH;
+	if (argc > 1) {
+		count = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		batch = atoi(argv[2]);
+	}
+	if (count <= 0 || batch <= 0 || batch > RING_ENTRIES) {
+		errx(1, "Usage: ringbench [count [batch]]");
+	}
+
+	fd = open("null:", O_WRONLY);
+	if (fd < 0) {
+		err(1, "null:");
+	}
+	r = ring_setup();
+	if (r == (struct ring *)-1) {
+		err(1, "ring_setup");
+	}
+	pid = getpid();
+	errors = 0;
+
+	start();
+	for (i=0; i<count; i++) {
+		if (write(fd, &c, 1) != 1) {
+			err(1, "write");
+		}
+	}
+	stop("write", count);
+
+	sqe.sqe_op = RING_OP_WRITE;
+	sqe.sqe_fd = fd;
+	sqe.sqe_buf = &c;
+	sqe.sqe_len = 1;
+	start();
+	errors += ringrun(r, &sqe, 1, count, batch);
+	stop("ring write", count);
+
+	start();
+	for (i=0; i<count; i++) {
+		if (getpid() != pid) {
+			errx(1, "getpid changed");
+		}
+	}
+	stop("getpid", count);
+
+	sqe.sqe_op = RING_OP_GETPID;
+	start();
+	errors += ringrun(r, &sqe, pid, count, batch);
+	stop("ring getpid", count);
+
+	if (errors) {
+		printf("ringbench: %d errors\n", errors);
+	}
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * schedlat
+ *
+ *	measure how quickly an interactive process gets the cpu back
+ *	while hogparty is running
+ *
+ *   relies on fork, execv, waitpid, _exit, __time and console write
+ *
+ *   The probe loop stands in for the shell: it repeatedly writes one
+ *   character to the console (which blocks) and times how long it
+ *   takes to get back to user level. This is done once on an idle
+ *   system and once while hogparty's hogs compete for the cpu. With
+ *   plain round-robin the loaded number grows with the number of
+ *   hogs; with a feedback scheduler it should stay close to idle.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+#include "../lib/testutils.h"
+
+#define NPROBES   200
+#define NPARTIES  4
+
+static char *hpargv[2] = { (char *)"hogparty", NULL };
+
+static
+pid_t
+spawn_hogparty(void)
+{
+	pid_t pid = fork();
+	switch (pid) {
+	case -1:
+		err(1, "fork");
+	case 0:
+		/* child */
+		execv("/uw-testbin/hogparty", hpargv);
+		err(1, "/uw-testbin/hogparty");
+	default:
+		/* parent */
+		break;
+	}
+	return pid;
+}
+
+static
+void
+probe(const char *what)
+{
+	time_t s1, s2;
+	unsigned long ns1, ns2, usec, total, max;
+	int i;
+
+	total = max = 0;
+	for (i=0; i<NPROBES; i++) {
+		__time(&s1, &ns1);
+		write(STDOUT_FILENO, ".", 1);
+		__time(&s2, &ns2);
+
+		usec = elapsed_usec(s1, ns1, s2, ns2);
+		total += usec;
+		if (usec > max) {
+			max = usec;
+		}
+	}
+	printf("\nschedlat: %s: avg %lu usec, max %lu usec over %d probes\n",
+	       what, total / NPROBES, max, NPROBES);
+}
+
+int
+main(void)
+{
+	pid_t pids[NPARTIES];
+	int i, status;
+
+	probe("idle");
+
+	for (i=0; i<NPARTIES; i++) {
+		pids[i] = spawn_hogparty();
+	}
+	probe("hogparty");
+
+	for (i=0; i<NPARTIES; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+		}
+	}
+	return 0;
+}
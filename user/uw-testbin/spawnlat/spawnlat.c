@@ -0,0 +1,123 @@
+/*
+ * spawnlat
+ *
+ *	compare ways of starting a program: fork+execv, vfork+execv
+ *	and posix_spawn
+ *
+ *   relies on fork, vfork, execv, __spawn, waitpid and __time
+ *
+ *   Each method is used to run /bin/true count times, waiting for
+ *   each child before starting the next, and the average time per
+ *   launch is printed. Usage: spawnlat [count]; the default is 100.
+ */
+
+#include <unistd.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+#include "../lib/testutils.h"
+
+#define DEFAULT_COUNT  100
+#define PROG           "/bin/true"
+
+static char *xargv[] = { (char *)PROG, NULL };
+
+static
+pid_t
+launch_fork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid == 0) {
+		execv(PROG, xargv);
+		_exit(1);
+	}
+	return pid;
+}
+
+static
+pid_t
+launch_vfork(void)
+{
+	pid_t pid;
+
+	pid = vfork();
+	if (pid == 0) {
+		execv(PROG, xargv);
+		_exit(1);
+	}
+	return pid;
+}
+
+static
+pid_t
+launch_spawn(void)
+{
+	pid_t pid;
+	int result;
+
+	result = posix_spawn(&pid, PROG, NULL, NULL, xargv, NULL);
+	if (result) {
+		return -1;
+	}
+	return pid;
+}
+
+static
+int
+measure(const char *name, pid_t (*launch)(void), int count)
+{
+	time_t s1, s2;
+	unsigned long ns1, ns2, usec;
+	int i, status, errors;
+	pid_t pid;
+
+	errors = 0;
+	__time(&s1, &ns1);
+	for (i=0; i<count; i++) {
+		pid = launch();
+		if (pid < 0) {
+			err(1, "%s", name);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			warn("waitpid %d", pid);
+			errors++;
+			continue;
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			warnx("%s: pid %d: bad exit status 0x%x",
+			      name, pid, status);
+			errors++;
+		}
+	}
+	__time(&s2, &ns2);
+
+	usec = elapsed_usec(s1, ns1, s2, ns2);
+	printf("%-12s %8lu us per launch\n", name, usec / count);
+	return errors;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int count, errors;
+
+	count = DEFAULT_COUNT;
+	if (argc > 1) {
+		count = atoi(argv[1]);
+	}
+	if (count <= 0) {
+		errx(1, "Usage: spawnlat [count]");
+	}
+
+	errors = 0;
+	errors += measure("fork+execv", launch_fork, count);
+	errors += measure("vfork+execv", launch_vfork, count);
+	errors += measure("posix_spawn", launch_spawn, count);
+	if (errors) {
+		printf("spawnlat: %d errors\n", errors);
+	}
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * threadscale
+ *
+ *	see how cpu-bound work scales with the number of threads
+ *
+ *   relies on thread_create, thread_join and __time
+ *
+ *   Splits a fixed amount of arithmetic among 1, 2, 4, ... threads,
+ *   up to maxthreads, and prints how long each split takes. With
+ *   more cpus than threads the time should drop as threads are
+ *   added. Each thread's answer is checked. Usage:
+ *   threadscale [maxthreads [work]]; the defaults are 8 threads and
+ *   4000000 steps of work.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <thread.h>
+#include <err.h>
+#include "../lib/testutils.h"
+
+#define DEFAULT_MAXTHREADS  8
+#define DEFAULT_WORK        4000000
+#define MAXTHREADS          15
+
+struct job {
+	unsigned j_start;
+	unsigned j_count;
+	unsigned j_sum;
+};
+
+static struct job jobs[MAXTHREADS];
+
+/* Something the compiler can't skip or fold: a sum of hashes. */
+static
+unsigned
+hash(unsigned x)
+{
+	x ^= x >> 16;
+	x *= 0x45d9f3b;
+	x ^= x >> 16;
+	return x;
+}
+
+static
+void *
+work(void *arg)
+{
+	struct job *j = arg;
+	unsigned i, sum;
+
+	sum = 0;
+	for (i=0; i<j->j_count; i++) {
+		sum += hash(j->j_start + i);
+	}
+	j->j_sum = sum;
+	return j;
+}
+
+/* Do WORK steps with NTHREADS threads; return the total. */
+static
+unsigned
+run(int nthreads, unsigned work_total)
+{
+	int tids[MAXTHREADS];
+	void *ret;
+	unsigned sum, share;
+	int i;
+
+	share = work_total / nthreads;
+	for (i=0; i<nthreads; i++) {
+		jobs[i].j_start = i * share;
+		jobs[i].j_count = i == nthreads - 1 ?
+			work_total - i * share : share;
+		tids[i] = thread_create(work, &jobs[i]);
+		if (tids[i] < 0) {
+			err(1, "thread_create");
+		}
+	}
+	sum = 0;
+	for (i=0; i<nthreads; i++) {
+		if (thread_join(tids[i], &ret) < 0) {
+			err(1, "thread_join");
+		}
+		if (ret != &jobs[i]) {
+			errx(1, "thread %d returned the wrong value", i);
+		}
+		sum += jobs[i].j_sum;
+	}
+	return sum;
+}
+
+int
+main(int argc, char *argv[])
+{
+	time_t s1, s2;
+	unsigned long ns1, ns2, msec, msec1;
+	unsigned work_total, want, got;
+	int maxthreads, n;
+
+	maxthreads = DEFAULT_MAXTHREADS;
+	work_total = DEFAULT_WORK;
+	if (argc > 1) {
+		maxthreads = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		work_total = atoi(argv[2]);
+	}
+	if (maxthreads < 1 || maxthreads > MAXTHREADS) {
+		errx(1, "Usage: threadscale [maxthreads [work]]");
+	}
+
+	/* The answer, worked out without threads. */
+	jobs[0].j_start = 0;
+	jobs[0].j_count = work_total;
+	work(&jobs[0]);
+	want = jobs[0].j_sum;
+
+	msec1 = 0;
+	for (n=1; n<=maxthreads; n*=2) {
+		__time(&s1, &ns1);
+		got = run(n, work_total);
+		__time(&s2, &ns2);
+		if (got != want) {
+			errx(1, "%d threads: got %u, expected %u",
+			     n, got, want);
+		}
+		msec = elapsed_usec(s1, ns1, s2, ns2) / 1000;
+		if (n == 1) {
+			msec1 = msec;
+		}
+		printf("%2d threads: %6lu ms", n, msec);
+		if (msec > 0) {
+			printf(", speedup %lu.%02lu", msec1 / msec,
+			       (msec1 * 100 / msec) % 100);
+		}
+		printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * timebench
+ *
+ *	compare reading the clock with the __time system call against
+ *	reading the time page with time()
+ *
+ *   relies on __time and the time page
+ *
+ *   Calls each of them count times and prints the average cost of
+ *   a call, then checks that time() agrees with __time to within
+ *   a second and that it moves forward. Usage: timebench [count];
+ *   the default is 100000 calls.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+#include "../lib/testutils.h"
+
+#define DEFAULT_COUNT  100000
+
+static time_t s1;
+static unsigned long ns1;
+
+static
+void
+start(void)
+{
+	__time(&s1, &ns1);
+}
+
+static
+void
+stop(const char *name, int count)
+{
+	time_t s2;
+	unsigned long ns2, nsec;
+
+	__time(&s2, &ns2);
+	/* good for about 4 seconds, plenty here */
+	nsec = elapsed_nsec(s1, ns1, s2, ns2);
+	printf("%-8s %8lu ns per call\n", name, nsec / count);
+}
+
+int
+main(int argc, char *argv[])
+{
+	time_t t, prev, sys;
+	unsigned long ns;
+	int count, i;
+
+	count = DEFAULT_COUNT;
+	if (argc > 1) {
+		count = atoi(argv[1]);
+	}
+	if (count <= 0) {
+		errx(1, "Usage: timebench [count]");
+	}
+
+	start();
+	for (i=0; i<count; i++) {
+		__time(&t, &ns);
+	}
+	stop("__time", count);
+
+	prev = time(NULL);
+	start();
+	for (i=0; i<count; i++) {
+		t = time(NULL);
+		if (t < prev) {
+			errx(1, "time went backwards: %ld then %ld",
+			     (long)prev, (long)t);
+		}
+		prev = t;
+	}
+	stop("time", count);
+
+	__time(&sys, &ns);
+	t = time(NULL);
+	if (t < sys - 1 || t > sys + 1) {
+		errx(1, "time() says %ld but __time says %ld",
+		     (long)t, (long)sys);
+	}
+	return 0;
+}